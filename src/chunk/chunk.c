@@ -54,6 +54,15 @@ uint32_t addConstant(Chunk* chunk, Value value)
     return chunk->constants.count - 1;
 }
 
+// Throws away the code from count on and the constants from constantCount on, together with
+// their lines.
+void truncateChunk(Chunk* chunk, BytecodeIndex count, uint32_t constantCount)
+{
+    removeLinenumbers(&chunk->sourceinfo, chunk->count - count);
+    chunk->count = count;
+    chunk->constants.count = constantCount;
+}
+
 Linenumber getLinenumber(Chunk* chunk, BytecodeIndex offset)
 {
     return getSourceInfoLinenumber(&chunk->sourceinfo, offset);
@@ -26,10 +26,11 @@ typedef enum {
     OP_SET_UPVALUE,
     OP_GET_PROPERTY,
     OP_GET_PROPERTY_LONG,
-    OP_GET_PROPERTY_STACK,
+    OP_GET_INDEX,
+    OP_GET_INDEX_PROPERTY,
     OP_SET_PROPERTY,
     OP_SET_PROPERTY_LONG,
-    OP_SET_PROPERTY_STACK,
+    OP_SET_INDEX,
     OP_GET_SUPER,
     OP_GET_SUPER_LONG,
     OP_EQUAL,
@@ -64,6 +65,35 @@ typedef enum {
     OP_METHOD_LONG,
     OP_ARRAY_INIT,
     OP_ARRAY_ADD,
+    OP_MAP_INIT,
+    // variants without type checks, for operands the compiler knows to be numbers
+    OP_ADD_NUMBER,
+    OP_SUBTRACT_NUMBER,
+    OP_MULTIPLY_NUMBER,
+    OP_DIVIDE_NUMBER,
+    OP_NEGATE_NUMBER,
+    OP_GREATER_NUMBER,
+    OP_GREATER_EQUAL_NUMBER,
+    OP_LESS_NUMBER,
+    OP_LESS_EQUAL_NUMBER,
+    // calls inlined by the optimizer, the checks jump to the real call when the callee differs
+    OP_CHECK_CALL,
+    OP_CHECK_INVOKE,
+    OP_INLINE_RETURN,
+    // the increment, condition and jump back of a for loop counting a local
+    OP_FOR_LOOP,
+    // the variables a direct function captures, in the frame of the function calling it
+    OP_GET_OUTER_LOCAL,
+    OP_SET_OUTER_LOCAL,
+    OP_GET_OUTER_UPVALUE,
+    OP_SET_OUTER_UPVALUE,
+    // variables copied into a closure, as they never change
+    OP_GET_CAPTURED,
+    OP_GET_OUTER_CAPTURED,
+    // joins the values of a template string into one string, numbers, booleans and nil as printed
+    OP_CONCAT_N,
+    // joins a chain of + with a string operand, the other operands need to be strings as well
+    OP_ADD_STRINGS,
     OP_UNDEFINED = 0xFF,
 } OpCode;
 
@@ -79,5 +109,6 @@ void initChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
 void writeConstant(Chunk* chunk, Value value, int line, OpCode opCodeShort, OpCode opCodeLong);
 uint32_t addConstant(Chunk* chunk, Value value);
+void truncateChunk(Chunk* chunk, BytecodeIndex count, uint32_t constantCount);
 Linenumber getLinenumber(Chunk* chunk, BytecodeIndex offset);
 void freeChunk(Chunk* chunk);
@@ -0,0 +1,96 @@
+#include <string.h>
+
+#include "constantindex.h"
+#include "../util/memory.h"
+
+#define SLOT_FREE UINT32_MAX
+#define INDEX_MAX_LOAD 0.75
+
+void initConstantIndex(ConstantIndex* index)
+{
+    index->count = 0;
+    index->capacity = 0;
+    index->slots = NULL;
+}
+
+void freeConstantIndex(ConstantIndex* index)
+{
+    FREE_ARRAY(ConstantSlot, index->slots, index->capacity);
+    initConstantIndex(index);
+}
+
+bool isIndexedConstant(Value value)
+{
+    return IS_NUMBER(value) || IS_STRING(value);
+}
+
+static uint64_t constantBits(Value value)
+{
+    if (IS_NUMBER(value)) {
+        double number = AS_NUMBER(value);
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return bits;
+    }
+    return (uintptr_t)AS_OBJ(value);
+}
+
+static uint32_t hashBits(uint64_t bits)
+{
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+static ConstantSlot* findSlot(ConstantSlot* slots, uint32_t capacity, uint64_t bits, bool isNumber)
+{
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = hashBits(bits) & mask;; i = (i + 1) & mask) {
+        ConstantSlot* slot = &slots[i];
+        if (slot->index == SLOT_FREE || (slot->bits == bits && slot->isNumber == isNumber)) {
+            return slot;
+        }
+    }
+}
+
+static void resize(ConstantIndex* index, uint32_t capacity)
+{
+    ConstantSlot* slots = ALLOCATE(ConstantSlot, capacity);
+    for (uint32_t i = 0; i < capacity; i++) {
+        slots[i].index = SLOT_FREE;
+    }
+    for (uint32_t i = 0; i < index->capacity; i++) {
+        const ConstantSlot* slot = &index->slots[i];
+        if (slot->index != SLOT_FREE) {
+            *findSlot(slots, capacity, slot->bits, slot->isNumber) = *slot;
+        }
+    }
+    FREE_ARRAY(ConstantSlot, index->slots, index->capacity);
+    index->slots = slots;
+    index->capacity = capacity;
+}
+
+uint32_t findOrAddConstant(ConstantIndex* index, Chunk* chunk, Value value)
+{
+    if (index->count + 1 > index->capacity * INDEX_MAX_LOAD) {
+        resize(index, GROW_CAPACITY(index->capacity));
+    }
+
+    uint64_t bits = constantBits(value);
+    bool isNumber = IS_NUMBER(value);
+    ConstantSlot* slot = findSlot(index->slots, index->capacity, bits, isNumber);
+    if (slot->index == SLOT_FREE) {
+        index->count++;
+    } else if (slot->index < chunk->constants.count) {
+        Value constant = chunk->constants.values[slot->index];
+        if (IS_NUMBER(constant) == isNumber && constantBits(constant) == bits) {
+            return slot->index;
+        }
+    }
+    // the slot is new, or the pool was cut back and lost the constant
+    slot->bits = bits;
+    slot->isNumber = isNumber;
+    slot->index = addConstant(chunk, value);
+    return slot->index;
+}
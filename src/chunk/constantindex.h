@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../common.h"
+#include "chunk.h"
+
+// Finds the numbers and strings already in the constant pool of a chunk, so every one is only
+// stored once. Numbers are keyed by their bits (0 and -0 stay apart), strings by identity, as
+// they are interned.
+typedef struct {
+    uint64_t bits;
+    uint32_t index; // position in the pool, UINT32_MAX for free slots
+    bool isNumber;
+} ConstantSlot;
+
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+    ConstantSlot* slots;
+} ConstantIndex;
+
+void initConstantIndex(ConstantIndex* index);
+void freeConstantIndex(ConstantIndex* index);
+
+// Whether the value can be shared through the index, only numbers and strings can.
+bool isIndexedConstant(Value value);
+// The position of the value in the pool of the chunk, it is added when it is not there yet.
+// Entries for constants that were removed from the pool since are replaced.
+uint32_t findOrAddConstant(ConstantIndex* index, Chunk* chunk, Value value);
@@ -9,6 +9,9 @@ void initSourceInfo(SourceInfo* info)
     info->capacity = 0;
     info->linenumbers = NULL;
     info->linenumberCounter = NULL;
+    info->inlinedCount = 0;
+    info->inlinedCapacity = 0;
+    info->inlined = NULL;
 }
 
 static void writeLine(SourceInfo* info, Linenumber line)
@@ -30,13 +33,14 @@ void freeSourceInfo(SourceInfo* info)
 {
     FREE_ARRAY(Linenumber, info->linenumbers, info->capacity);
     FREE_ARRAY(uint32_t, info->linenumberCounter, info->capacity);
+    FREE_ARRAY(InlinedCode, info->inlined, info->inlinedCapacity);
 
     initSourceInfo(info);
 }
 
 void addLinenumer(SourceInfo* info, Linenumber linenumber)
 {
-    if (info->linenumbers == NULL) {
+    if (info->count == 0) {
         writeLine(info, linenumber);
         return;
     }
@@ -49,6 +53,19 @@ void addLinenumer(SourceInfo* info, Linenumber linenumber)
     }
 }
 
+void removeLinenumbers(SourceInfo* info, BytecodeIndex bytes)
+{
+    while (bytes > 0 && info->count > 0) {
+        uint32_t* counter = &info->linenumberCounter[info->count - 1];
+        if (*counter > bytes) {
+            *counter -= bytes;
+            return;
+        }
+        bytes -= *counter;
+        info->count--;
+    }
+}
+
 Linenumber getSourceInfoLinenumber(SourceInfo* info, BytecodeIndex offset)
 {
     int64_t lastOffset = -1;
@@ -64,3 +81,31 @@ Linenumber getSourceInfoLinenumber(SourceInfo* info, BytecodeIndex offset)
     }
     return -1;
 }
+
+void addInlinedCode(SourceInfo* info, BytecodeIndex start, BytecodeIndex end, uint32_t function,
+    Linenumber callLine)
+{
+    if (info->inlinedCount > 0) {
+        InlinedCode* last = &info->inlined[info->inlinedCount - 1];
+        if (last->end == start && last->function == function && last->callLine == callLine) {
+            last->end = end;
+            return;
+        }
+    }
+    if (info->inlinedCapacity < info->inlinedCount + 1) {
+        int oldCapacity = info->inlinedCapacity;
+        info->inlinedCapacity = GROW_CAPACITY(oldCapacity);
+        info->inlined = GROW_ARRAY(InlinedCode, info->inlined, oldCapacity, info->inlinedCapacity);
+    }
+    info->inlined[info->inlinedCount++] = (InlinedCode) { start, end, function, callLine };
+}
+
+const InlinedCode* getInlinedCode(const SourceInfo* info, BytecodeIndex offset)
+{
+    for (BytecodeIndex i = 0; i < info->inlinedCount; i++) {
+        if (info->inlined[i].start <= offset && offset < info->inlined[i].end) {
+            return &info->inlined[i];
+        }
+    }
+    return NULL;
+}
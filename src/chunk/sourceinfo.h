@@ -3,16 +3,37 @@
 #include "../common.h"
 #include "chunkDefs.h"
 
+// Code the optimizer copied in from a function it inlined.
+typedef struct {
+    BytecodeIndex start;
+    BytecodeIndex end;
+    uint32_t function; // the constant holding it
+    Linenumber callLine;
+} InlinedCode;
+
 typedef struct {
     BytecodeIndex capacity;
     BytecodeIndex count;
 
     Linenumber* linenumbers; // lines per file
     uint32_t* linenumberCounter; // chunk bytes per line
+
+    BytecodeIndex inlinedCapacity;
+    BytecodeIndex inlinedCount;
+    InlinedCode* inlined;
 } SourceInfo;
 
 void initSourceInfo(SourceInfo* info);
 void freeSourceInfo(SourceInfo* info);
 
 void addLinenumer(SourceInfo* info, Linenumber linenumber);
+// drops the lines of the last bytes of the chunk
+void removeLinenumbers(SourceInfo* info, BytecodeIndex bytes);
 Linenumber getSourceInfoLinenumber(SourceInfo* info, BytecodeIndex offset);
+
+// Marks the bytes from start to end as inlined, joining them to the code right before, when that
+// came from the same call.
+void addInlinedCode(SourceInfo* info, BytecodeIndex start, BytecodeIndex end, uint32_t function,
+    Linenumber callLine);
+// The inlined code the byte at offset belongs to, NULL if it is the function's own.
+const InlinedCode* getInlinedCode(const SourceInfo* info, BytecodeIndex offset);
@@ -15,6 +15,9 @@
 
 // #define DEBUG_LOG_GC
 
+// #define DEBUG_TABLE_STATS
+// #define DEBUG_CONSTANT_STATS
+
 #ifdef DEBUG_LOG_GC
 #define DEBUG_LOG_GC_MARK
 #define DEBUG_LOG_GC_BLACKEN
@@ -4,10 +4,13 @@
 
 #include "common.h"
 #include "compiler.h"
+#include "optimizer.h"
 #include "scanner.h"
+#include "chunk/constantindex.h"
 #include "util/addresstable.h"
 #include "util/VarArray.h"
 #include "util/memory.h"
+#include "values/struct.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
@@ -44,6 +47,9 @@ typedef struct {
 
 typedef enum {
     TYPE_FUNCTION,
+    // a local function only ever called by name from the function declaring it, it reads the
+    // variables it captures from the frame below its own
+    TYPE_DIRECT_FUNCTION,
     TYPE_INITIALIZER,
     TYPE_METHOD,
     TYPE_SCRIPT,
@@ -52,20 +58,57 @@ typedef enum {
 typedef struct {
     uint8_t index;
     bool isLocal;
+    // the variable never changes, so its value is copied into the closure instead of boxed
+    bool isCopy;
+    uint8_t slot; // in the upvalues or the copied values of the closure
     Var* varProps;
 } Upvalue;
 
 
+// A check-free numeric opcode, and the opcode with checks it replaced.
+typedef struct {
+    int offset;
+    uint8_t genericOp;
+    SlotSet operands; // the locals the operands were computed from
+} NumericOp;
+
+// The code of a literal or of a folded expression, which the next operator may fold further.
+typedef struct {
+    int start;
+    int end; // -1, when there is no such constant
+    uint32_t constantCount; // size of the constant pool before the constant was added
+    Value value;
+} ConstantExpression;
+
 typedef struct Compiler {
     struct Compiler* enclosing;
     ObjFunction* function;
     FunctionType type;
 
     AddressTable locals;
+    // numbers and strings already in the constant pool
+    ConstantIndex constants;
 
     Upvalue upvalues[UINT8_COUNT];
+    int upvalueCount; // the boxed and the copied ones
 
     int scopeDepth;
+    // where the last OP_GET_INDEX ends, a property read right after it is fused with it
+    int getIndexEnd;
+    // the constant emitted last, and where the left operand of the current infix operator starts
+    ConstantExpression lastConstant;
+    int operandStart;
+    // the code of the last expression known to produce a number, -1 when there is none
+    int numberStart;
+    int numberEnd;
+    SlotSet numberSources; // the locals it was computed from
+    // the code of the last expression known to produce a string, -1 when there is none
+    int stringStart;
+    int stringEnd;
+    // the numeric opcodes relying on the types of the locals
+    NumericOp* numericOps;
+    int numericOpCount;
+    int numericOpCapacity;
 } Compiler;
 
 typedef struct ClassCompiler {
@@ -195,9 +238,36 @@ static void emitReturn()
     emitByte(OP_RETURN);
 }
 
+#ifdef DEBUG_CONSTANT_STATS
+static struct {
+    uint64_t constants;
+    uint64_t shared;
+    uint64_t longAvoided;
+} stats;
+#endif
+
 static uint32_t makeConstant(Value value)
 {
-    uint32_t addrerss = addConstant(currentChunk(), value);
+    Chunk* chunk = currentChunk();
+    if (!isIndexedConstant(value)) {
+        return addConstant(chunk, value);
+    }
+#ifdef DEBUG_CONSTANT_STATS
+    uint32_t count = chunk->constants.count;
+#endif
+    push(value);
+    uint32_t addrerss = findOrAddConstant(&current->constants, chunk, value);
+    pop();
+#ifdef DEBUG_CONSTANT_STATS
+    stats.constants++;
+    if (addrerss < count) {
+        stats.shared++;
+        // a new constant would have gone to the end of the pool
+        if (count > 0xFF && addrerss <= 0xFF) {
+            stats.longAvoided++;
+        }
+    }
+#endif
     return addrerss;
 }
 
@@ -227,25 +297,204 @@ static void patchJump(int offset)
     }
     currentChunk()->code[offset] = (jump >> 8) & 0xFF;
     currentChunk()->code[offset + 1] = jump & 0xFF;
+    // code jumping here may skip the OP_GET_INDEX or the constant, so nothing can be fused with
+    // or folded into them
+    current->getIndexEnd = -1;
+    current->lastConstant.end = -1;
+}
+
+static void addSlot(SlotSet* set, uint32_t slot)
+{
+    set->bits[slot / 64] |= (uint64_t)1 << (slot % 64);
+}
+
+static void addSlots(SlotSet* set, const SlotSet* other)
+{
+    for (int i = 0; i < UINT8_COUNT / 64; i++) {
+        set->bits[i] |= other->bits[i];
+    }
+}
+
+static bool shareSlots(const SlotSet* a, const SlotSet* b)
+{
+    for (int i = 0; i < UINT8_COUNT / 64; i++) {
+        if (a->bits[i] & b->bits[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The code from start on is an expression producing a number, computed from the locals in sources.
+static void markNumber(int start, SlotSet sources)
+{
+    current->numberStart = start;
+    current->numberEnd = (int)currentChunk()->count;
+    current->numberSources = sources;
+}
+
+static bool isNumberFrom(int start)
+{
+    return current->numberStart == start && current->numberEnd == (int)currentChunk()->count;
+}
+
+// The code from start on is an expression producing a string.
+static void markString(int start)
+{
+    current->stringStart = start;
+    current->stringEnd = (int)currentChunk()->count;
+}
+
+// Emits the variant without type checks, when the operands are known to be numbers.
+static void emitOperator(bool numbers, const SlotSet* operands, OpCode numberOp, OpCode op)
+{
+    if (!numbers) {
+        emitByte(op);
+        return;
+    }
+    if (current->numericOpCount + 1 > current->numericOpCapacity) {
+        int oldCapacity = current->numericOpCapacity;
+        current->numericOpCapacity = GROW_CAPACITY(oldCapacity);
+        current->numericOps = GROW_ARRAY(
+            NumericOp, current->numericOps, oldCapacity, current->numericOpCapacity);
+    }
+    current->numericOps[current->numericOpCount++]
+        = (NumericOp) { (int)currentChunk()->count, op, *operands };
+    emitByte(numberOp);
+}
+
+// The local in the slot got something else than a number after all. Loops may run the code
+// compiled so far again after the assignment, so the locals it was copied to are no numbers
+// either, and every numeric opcode computed from one of them gets its checks back.
+static void forgetNumber(Compiler* compiler, uint32_t slot)
+{
+    SlotSet forgotten = { { 0 } };
+    addSlot(&forgotten, slot);
+    VarArray* locals = &compiler->locals.props;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (unsigned int i = 0; i < locals->count; i++) {
+            Var* local = &locals->values[i];
+            if (local->type == VAR_TYPE_NUMBER
+                && (i == slot || shareSlots(&local->sources, &forgotten))) {
+                local->type = VAR_TYPE_UNKNOWN;
+                addSlot(&forgotten, i);
+                changed = true;
+            }
+        }
+    }
+
+    uint8_t* code = compiler->function->chunk.code;
+    int kept = 0;
+    for (int i = 0; i < compiler->numericOpCount; i++) {
+        NumericOp* op = &compiler->numericOps[i];
+        if (shareSlots(&op->operands, &forgotten)) {
+            code[op->offset] = op->genericOp;
+        } else {
+            compiler->numericOps[kept++] = *op;
+        }
+    }
+    compiler->numericOpCount = kept;
+    compiler->numberEnd = -1;
+}
+
+// The compiler declaring the local, NULL for globals.
+static Compiler* ownerOf(const Var* var)
+{
+    for (Compiler* compiler = current; compiler != NULL; compiler = compiler->enclosing) {
+        const VarArray* locals = &compiler->locals.props;
+        if (var >= locals->values && var < locals->values + locals->count) {
+            return compiler;
+        }
+    }
+    return NULL;
+}
+
+// Emits the value, remembering it for folding.
+static void emitLiteral(Value value)
+{
+    Chunk* chunk = currentChunk();
+    ConstantExpression constant = {
+        .start = (int)chunk->count,
+        .constantCount = chunk->constants.count,
+        .value = value,
+    };
+    if (IS_NIL(value)) {
+        emitByte(OP_NIL);
+    } else if (IS_BOOL(value)) {
+        emitByte(AS_BOOL(value) ? OP_TRUE : OP_FALSE);
+    } else {
+        emitConstant(makeConstant(value), parser.previous.line, OP_CONSTANT, OP_CONSTANT_LONG);
+    }
+    constant.end = (int)chunk->count;
+    current->lastConstant = constant;
+    if (IS_NUMBER(value)) {
+        markNumber(constant.start, (SlotSet) { { 0 } });
+    }
+}
+
+// Whether all code from start on is one constant.
+static bool constantFrom(int start, Value* value)
+{
+    const ConstantExpression* constant = &current->lastConstant;
+    if (constant->start != start || constant->end != (int)currentChunk()->count) {
+        return false;
+    }
+    *value = constant->value;
+    return true;
+}
+
+static bool isStringFrom(int start)
+{
+    Value value;
+    if (constantFrom(start, &value)) {
+        return IS_STRING(value);
+    }
+    return current->stringStart == start && current->stringEnd == (int)currentChunk()->count;
+}
+
+// Drops the code from start on, and the constants only it used.
+static void discardCode(int start, uint32_t constantCount)
+{
+    truncateChunk(currentChunk(), start, constantCount);
+    current->getIndexEnd = -1;
+    current->lastConstant.end = -1;
+    current->numberEnd = -1;
+    current->stringEnd = -1;
+    while (current->numericOpCount > 0
+        && current->numericOps[current->numericOpCount - 1].offset >= start) {
+        current->numericOpCount--;
+    }
 }
 
-static void initCompiler(Compiler* compiler, FunctionType type)
+// Compiles into function, when it was declared already, or into a new one.
+static void initCompiler(Compiler* compiler, FunctionType type, ObjFunction* function)
 {
     compiler->enclosing = current;
     compiler->function = NULL;
     compiler->type = type;
 
     initAddressTable(&compiler->locals);
+    initConstantIndex(&compiler->constants);
 
     compiler->scopeDepth = 0;
-    compiler->function = newFunction();
+    compiler->getIndexEnd = -1;
+    compiler->lastConstant.end = -1;
+    compiler->operandStart = -1;
+    compiler->numberEnd = -1;
+    compiler->stringEnd = -1;
+    compiler->numericOps = NULL;
+    compiler->numericOpCount = 0;
+    compiler->numericOpCapacity = 0;
+    compiler->upvalueCount = 0;
+    compiler->function = function != NULL ? function : newFunction();
     current = compiler;
 
-    if (type != TYPE_SCRIPT) {
+    if (type != TYPE_SCRIPT && function == NULL) {
         current->function->name = copyString(parser.previous.start, parser.previous.length);
     }
 
-    if (type != TYPE_FUNCTION) {
+    if (type != TYPE_FUNCTION && type != TYPE_DIRECT_FUNCTION) {
         // if (type == TYPE_METHOD) {
         ObjString* identifier = copyString("this", 4);
         push(OBJ_VAL(identifier));
@@ -280,12 +529,17 @@ static void initCompiler(Compiler* compiler, FunctionType type)
 static void freeCompiler(Compiler* compiler)
 {
     freeAddressTable(&compiler->locals);
+    freeConstantIndex(&compiler->constants);
+    FREE_ARRAY(NumericOp, compiler->numericOps, compiler->numericOpCapacity);
 }
 
 static ObjFunction* endCompiler()
 {
     emitReturn();
     ObjFunction* function = current->function;
+    if (vm.optimize && !parser.hadError) {
+        optimizeFunction(function);
+    }
 #ifdef DEBUG_PRINT_CODE
     if (!parser.hadError) {
         disassembleChunk(
@@ -328,19 +582,143 @@ static void declaration();
 static ParseRule* getRule(TokenType type);
 static void parsePrecedence(Precedence precedence);
 static uint32_t identifierConstant(Token* name);
+static uint32_t selectorConstant(Token* name);
 static uint32_t firstOrMakeGlobal(Token* name);
 static int resolveLocal(Compiler* compiler, Token* name);
 static void and_(bool canAssign);
 static void or_(bool canAssign);
 static uint8_t argumentList(TokenType endToken);
 
+static bool isFalsey(Value value)
+{
+    return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// Evaluates the operator at compile time. Operands the vm would reject are left to it, so it can
+// report the error.
+static bool foldBinary(TokenType operatorType, Value a, Value b, Value* result)
+{
+    if (operatorType == TOKEN_EQUAL_EQUAL || operatorType == TOKEN_BANG_EQUAL) {
+        *result = BOOL_VAL(valuesEqual(a, b) == (operatorType == TOKEN_EQUAL_EQUAL));
+        return true;
+    }
+    if (operatorType == TOKEN_PLUS && IS_STRING(a) && IS_STRING(b)) {
+        const ObjString* left = AS_STRING(a);
+        const ObjString* right = AS_STRING(b);
+        int length = left->length + right->length;
+        char* chars = ALLOCATE(char, length + 1);
+        memcpy(chars, left->chars, left->length);
+        memcpy(chars + left->length, right->chars, right->length);
+        chars[length] = '\0';
+        *result = OBJ_VAL(takeString(chars, length));
+        return true;
+    }
+    if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+        return false;
+    }
+
+    double x = AS_NUMBER(a);
+    double y = AS_NUMBER(b);
+    switch (operatorType) {
+    case TOKEN_GREATER:
+        *result = BOOL_VAL(x > y);
+        return true;
+    case TOKEN_GREATER_EQUAL:
+        *result = BOOL_VAL(x >= y);
+        return true;
+    case TOKEN_LESS:
+        *result = BOOL_VAL(x < y);
+        return true;
+    case TOKEN_LESS_EQUAL:
+        *result = BOOL_VAL(x <= y);
+        return true;
+    case TOKEN_PLUS:
+        *result = NUMBER_VAL(x + y);
+        return true;
+    case TOKEN_MINUS:
+        *result = NUMBER_VAL(x - y);
+        return true;
+    case TOKEN_STAR:
+        *result = NUMBER_VAL(x * y);
+        return true;
+    case TOKEN_SLASH:
+        *result = NUMBER_VAL(x / y);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Replaces the code from start on with the constant.
+static void replaceWithLiteral(int start, uint32_t constantCount, Value value)
+{
+    // a folded string is only reachable from here, until it is in the constant pool again
+    push(value);
+    discardCode(start, constantCount);
+    emitLiteral(value);
+    pop();
+}
+
+static void emitConcatenation(int count)
+{
+    if (count == 2) {
+        emitByte(OP_ADD);
+    } else {
+        emitBytes(OP_ADD_STRINGS, count);
+    }
+}
+
+// A + with a string operand either concatenates or fails, so the operands of the rest of the
+// chain are joined in one go. That only holds while the operands joined so far are known to be
+// strings, otherwise they are joined first, so a failing + stops the chain before the next operand
+// runs.
+static void concatenation(int start, bool strings)
+{
+    int count = 2;
+    while (match(TOKEN_PLUS)) {
+        if (!strings || count == UINT8_MAX) {
+            emitConcatenation(count);
+            count = 1;
+        }
+        int operandStart = currentChunk()->count;
+        parsePrecedence(PREC_FACTOR);
+        strings = isStringFrom(operandStart);
+        count++;
+    }
+    emitConcatenation(count);
+    markString(start);
+}
+
 static void binary(bool canAssign)
 {
     (void)canAssign;
     TokenType operatorType = parser.previous.type;
     ParseRule* rule = getRule(operatorType);
+
+    ConstantExpression left = current->lastConstant;
+    int leftStart = current->operandStart;
+    Value a;
+    bool foldable = constantFrom(leftStart, &a);
+    bool leftIsNumber = isNumberFrom(leftStart);
+    bool leftIsString = isStringFrom(leftStart);
+    SlotSet operands = current->numberSources;
+    int rightStart = currentChunk()->count;
     parsePrecedence((Precedence)(rule->precedence + 1));
 
+    Value b, result;
+    if (foldable && constantFrom(rightStart, &b) && foldBinary(operatorType, a, b, &result)) {
+        replaceWithLiteral(left.start, left.constantCount, result);
+        return;
+    }
+
+    bool rightIsString = isStringFrom(rightStart);
+    if (operatorType == TOKEN_PLUS && (leftIsString || rightIsString)) {
+        concatenation(leftStart, leftIsString && rightIsString);
+        return;
+    }
+
+    bool numbers = leftIsNumber && isNumberFrom(rightStart);
+    addSlots(&operands, &current->numberSources);
     switch (operatorType) {
     case TOKEN_BANG_EQUAL:
         emitByte(OP_NOT_EQUAL);
@@ -349,32 +727,36 @@ static void binary(bool canAssign)
         emitByte(OP_EQUAL);
         break;
     case TOKEN_GREATER:
-        emitByte(OP_GREATER);
+        emitOperator(numbers, &operands, OP_GREATER_NUMBER, OP_GREATER);
         break;
     case TOKEN_GREATER_EQUAL:
-        emitByte(OP_GREATER_EQUAL);
+        emitOperator(numbers, &operands, OP_GREATER_EQUAL_NUMBER, OP_GREATER_EQUAL);
         break;
     case TOKEN_LESS:
-        emitByte(OP_LESS);
+        emitOperator(numbers, &operands, OP_LESS_NUMBER, OP_LESS);
         break;
     case TOKEN_LESS_EQUAL:
-        emitByte(OP_LESS_EQUAL);
+        emitOperator(numbers, &operands, OP_LESS_EQUAL_NUMBER, OP_LESS_EQUAL);
         break;
     case TOKEN_PLUS:
-        emitByte(OP_ADD);
+        emitOperator(numbers, &operands, OP_ADD_NUMBER, OP_ADD);
         break;
     case TOKEN_MINUS:
-        emitByte(OP_SUBTRACT);
+        emitOperator(numbers, &operands, OP_SUBTRACT_NUMBER, OP_SUBTRACT);
         break;
     case TOKEN_STAR:
-        emitByte(OP_MULTIPLY);
+        emitOperator(numbers, &operands, OP_MULTIPLY_NUMBER, OP_MULTIPLY);
         break;
     case TOKEN_SLASH:
-        emitByte(OP_DIVIDE);
+        emitOperator(numbers, &operands, OP_DIVIDE_NUMBER, OP_DIVIDE);
         break;
     default:
         return;
     }
+    if (numbers && operatorType != TOKEN_GREATER && operatorType != TOKEN_GREATER_EQUAL
+        && operatorType != TOKEN_LESS && operatorType != TOKEN_LESS_EQUAL) {
+        markNumber(leftStart, operands);
+    }
 }
 
 static void call(bool canAssign)
@@ -388,7 +770,7 @@ static void call(bool canAssign)
 static void dot(bool canAssign)
 {
     consume(TOKEN_IDENTIFIER, "Expect property name after '.'.");
-    uint32_t addr = identifierConstant(&parser.previous);
+    uint32_t addr = selectorConstant(&parser.previous);
 
     if (canAssign && match(TOKEN_EQUAL)) {
         expression();
@@ -397,6 +779,9 @@ static void dot(bool canAssign)
         uint8_t argCount = argumentList(TOKEN_RIGHT_PAREN);
         emitConstant(addr, parser.previous.line, OP_INVOKE, OP_INVOKE_LONG);
         emitByte(argCount);
+    } else if (current->getIndexEnd == (int)currentChunk()->count && addr <= UINT8_MAX) {
+        currentChunk()->code[current->getIndexEnd - 1] = OP_GET_INDEX_PROPERTY;
+        emitByte(addr);
     } else {
         emitConstant(addr, parser.previous.line, OP_GET_PROPERTY, OP_GET_PROPERTY_LONG);
     }
@@ -421,10 +806,11 @@ static void bracket(bool canAssign)
         if (match(TOKEN_EQUAL)) {
             // property set
             expression();
-            emitByte(OP_SET_PROPERTY_STACK);
+            emitByte(OP_SET_INDEX);
         } else {
             // property get
-            emitByte(OP_GET_PROPERTY_STACK);
+            emitByte(OP_GET_INDEX);
+            current->getIndexEnd = (int)currentChunk()->count;
         }
     }
 }
@@ -434,13 +820,13 @@ static void literal(bool canAssign)
     (void)canAssign;
     switch (parser.previous.type) {
     case TOKEN_NIL:
-        emitByte(OP_NIL);
+        emitLiteral(NIL_VAL);
         break;
     case TOKEN_TRUE:
-        emitByte(OP_TRUE);
+        emitLiteral(BOOL_VAL(true));
         break;
     case TOKEN_FALSE:
-        emitByte(OP_FALSE);
+        emitLiteral(BOOL_VAL(false));
         break;
     default:
         return;
@@ -458,14 +844,44 @@ static void number(bool canAssign)
 {
     (void)canAssign;
     double value = strtod(parser.previous.start, NULL);
+    emitLiteral(NUMBER_VAL(value));
+}
 
-    uint32_t addr = makeConstant(NUMBER_VAL(value));
-    emitConstant(addr, parser.previous.line, OP_CONSTANT, OP_CONSTANT_LONG);
+// Compiles an operand that never runs, just to report its errors.
+static void deadExpression(Precedence precedence)
+{
+    int start = currentChunk()->count;
+    uint32_t constantCount = currentChunk()->constants.count;
+    parsePrecedence(precedence);
+    discardCode(start, constantCount);
+}
+
+// With a constant left operand, `and` and `or` either are the left operand, or the right one.
+// Returns false, when the left operand is not constant.
+static bool foldLogical(bool shortCircuitsOnFalse, Precedence precedence)
+{
+    ConstantExpression left = current->lastConstant;
+    Value value;
+    if (!constantFrom(current->operandStart, &value)) {
+        return false;
+    }
+    if (isFalsey(value) == shortCircuitsOnFalse) {
+        // the right operand never runs
+        deadExpression(precedence);
+        current->lastConstant = left;
+    } else {
+        discardCode(left.start, left.constantCount);
+        parsePrecedence(precedence);
+    }
+    return true;
 }
 
 static void or_(bool canAssign)
 {
     (void)canAssign;
+    if (foldLogical(false, PREC_OR)) {
+        return;
+    }
     int elseJump = emitJump(OP_JUMP_IF_FALSE);
     int endJump = emitJump(OP_JUMP);
 
@@ -479,9 +895,55 @@ static void or_(bool canAssign)
 static void string(bool canAssign)
 {
     (void)canAssign;
-    uint32_t addr
-        = makeConstant(OBJ_VAL(copyString(parser.previous.start + 1, parser.previous.length - 2)));
-    emitConstant(addr, parser.previous.line, OP_CONSTANT, OP_CONSTANT_LONG);
+    ObjString* string = copyString(parser.previous.start + 1, parser.previous.length - 2);
+    push(OBJ_VAL(string));
+    emitLiteral(OBJ_VAL(string));
+    pop();
+}
+
+// Emits the text of a template string part, unless it is empty.
+static void templateText(int trimEnd, uint8_t* count)
+{
+    int length = parser.previous.length - 1 - trimEnd;
+    if (length == 0) {
+        return;
+    }
+    ObjString* string = copyString(parser.previous.start + 1, length);
+    push(OBJ_VAL(string));
+    emitLiteral(OBJ_VAL(string));
+    pop();
+    (*count)++;
+}
+
+// Makes room for one more part, joining the parts so far when there are too many.
+static void templatePart(uint8_t* count)
+{
+    if (*count == UINT8_MAX) {
+        emitBytes(OP_CONCAT_N, *count);
+        *count = 1;
+    }
+}
+
+static void interpolation(bool canAssign)
+{
+    (void)canAssign;
+    int start = currentChunk()->count;
+    uint8_t count = 0;
+    do {
+        // the token ends with ${
+        templatePart(&count);
+        templateText(2, &count);
+        templatePart(&count);
+        expression();
+        count++;
+    } while (match(TOKEN_INTERPOLATION));
+    consume(TOKEN_STRING, "Expect '}' after interpolation.");
+    if (parser.previous.type == TOKEN_STRING) {
+        templatePart(&count);
+        templateText(1, &count);
+    }
+    emitBytes(OP_CONCAT_N, count);
+    markString(start);
 }
 
 static void array(bool canAssign)
@@ -492,6 +954,26 @@ static void array(bool canAssign)
     emitBytes(OP_ARRAY_INIT, argCount);
 }
 
+static void map(bool canAssign)
+{
+    (void)canAssign;
+
+    uint8_t entryCount = 0;
+    if (!check(TOKEN_RIGHT_BRACE)) {
+        do {
+            expression();
+            consume(TOKEN_COLON, "Expect ':' after map key.");
+            expression();
+            if (entryCount == 255) {
+                error("Can't have more than 255 entries in a map literal.");
+            }
+            entryCount++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after map entries.");
+    emitBytes(OP_MAP_INIT, entryCount);
+}
+
 static void namedVariable(Token name, bool canAssign)
 {
     OpCode getOp, getOpLong, setOp, setOpLong;
@@ -506,10 +988,23 @@ static void namedVariable(Token name, bool canAssign)
         setOp = OP_SET_LOCAL;
         setOpLong = OP_SET_LOCAL_LONG;
     } else if ((addr = resolveUpvalue(current, &name, &var)) != -1) {
-        getOp = OP_GET_UPVALUE;
+        const Upvalue* upvalue = &current->upvalues[addr];
+        getOp = upvalue->isCopy ? OP_GET_CAPTURED : OP_GET_UPVALUE;
         getOpLong = 0xFF; // not supported
+        // copies are never assigned to
         setOp = OP_SET_UPVALUE;
         setOpLong = 0xFF; // not supported
+        addr = upvalue->slot;
+        if (current->type == TYPE_DIRECT_FUNCTION) {
+            if (upvalue->isLocal) {
+                getOp = OP_GET_OUTER_LOCAL;
+                setOp = OP_SET_OUTER_LOCAL;
+            } else {
+                getOp = upvalue->isCopy ? OP_GET_OUTER_CAPTURED : OP_GET_OUTER_UPVALUE;
+                setOp = OP_SET_OUTER_UPVALUE;
+            }
+            addr = upvalue->index;
+        }
     } else {
         addr = firstOrMakeGlobal(&name);
         var = addresstableGetProps(&vm.gloablsTable, addr);
@@ -520,15 +1015,30 @@ static void namedVariable(Token name, bool canAssign)
         setOpLong = OP_SET_GLOBAL_LONG;
     }
     int line = parser.previous.line;
+    int start = currentChunk()->count;
 
     if (canAssign && match(TOKEN_EQUAL)) {
         if (var->readonly) {
             error("Can not assign to constant.");
         }
         expression();
+        if (var->type == VAR_TYPE_NUMBER) {
+            Compiler* owner = ownerOf(var);
+            if (owner == current && isNumberFrom(start)) {
+                addSlots(&var->sources, &current->numberSources);
+            } else {
+                forgetNumber(owner, (uint32_t)(var - owner->locals.props.values));
+            }
+        }
         emitConstant(addr, line, setOp, setOpLong);
     } else {
         emitConstant(addr, line, getOp, getOpLong);
+        // upvalues may be changed by other closures at any time
+        if (getOp == OP_GET_LOCAL && var->type == VAR_TYPE_NUMBER) {
+            SlotSet sources = { { 0 } };
+            addSlot(&sources, (uint32_t)addr);
+            markNumber(start, sources);
+        }
     }
 }
 
@@ -560,7 +1070,7 @@ static void super_(bool canAssign)
 
     consume(TOKEN_DOT, "Expect '.' after 'super'.");
     consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
-    uint32_t name = identifierConstant(&parser.previous);
+    uint32_t name = selectorConstant(&parser.previous);
 
     namedVariable(syntheticToken("this"), false);
 
@@ -591,14 +1101,34 @@ static void unary(bool canAssign)
     (void)canAssign;
     TokenType operatorType = parser.previous.type;
 
+    int start = currentChunk()->count;
+    uint32_t constantCount = currentChunk()->constants.count;
     parsePrecedence(PREC_UNARY);
 
+    Value value;
+    if (constantFrom(start, &value)) {
+        if (operatorType == TOKEN_BANG) {
+            replaceWithLiteral(start, constantCount, BOOL_VAL(isFalsey(value)));
+            return;
+        }
+        if (operatorType == TOKEN_MINUS && IS_NUMBER(value)) {
+            replaceWithLiteral(start, constantCount, NUMBER_VAL(-AS_NUMBER(value)));
+            return;
+        }
+    }
+
     switch (operatorType) {
     case TOKEN_BANG:
         emitByte(OP_NOT);
         break;
     case TOKEN_MINUS:
-        emitByte(OP_NEGATE);
+        if (isNumberFrom(start)) {
+            SlotSet operands = current->numberSources;
+            emitOperator(true, &operands, OP_NEGATE_NUMBER, OP_NEGATE);
+            markNumber(start, operands);
+        } else {
+            emitByte(OP_NEGATE);
+        }
         break;
 
     default:
@@ -609,11 +1139,12 @@ static void unary(bool canAssign)
 ParseRule rules[] = {
     [TOKEN_LEFT_PAREN] = { grouping, call, PREC_CALL },
     [TOKEN_RIGHT_PAREN] = { NULL, NULL, PREC_NONE },
-    [TOKEN_LEFT_BRACE] = { NULL, NULL, PREC_NONE },
+    [TOKEN_LEFT_BRACE] = { map, NULL, PREC_NONE },
     [TOKEN_RIGHT_BRACE] = { NULL, NULL, PREC_NONE },
     [TOKEN_LEFT_BRACKET] = { array, bracket, PREC_CALL },
     [TOKEN_RIGHT_BRACKET] = { NULL, NULL, PREC_NONE },
     [TOKEN_COMMA] = { NULL, NULL, PREC_NONE },
+    [TOKEN_COLON] = { NULL, NULL, PREC_NONE },
     [TOKEN_DOT] = { NULL, dot, PREC_CALL },
     [TOKEN_MINUS] = { unary, binary, PREC_TERM },
     [TOKEN_PLUS] = { NULL, binary, PREC_TERM },
@@ -630,6 +1161,7 @@ ParseRule rules[] = {
     [TOKEN_LESS_EQUAL] = { NULL, binary, PREC_COMPARISON },
     [TOKEN_IDENTIFIER] = { variable, NULL, PREC_NONE },
     [TOKEN_STRING] = { string, NULL, PREC_NONE },
+    [TOKEN_INTERPOLATION] = { interpolation, NULL, PREC_NONE },
     [TOKEN_NUMBER] = { number, NULL, PREC_NONE },
     [TOKEN_AND] = { NULL, and_, PREC_AND },
     [TOKEN_CLASS] = { NULL, NULL, PREC_NONE },
@@ -642,6 +1174,7 @@ ParseRule rules[] = {
     [TOKEN_OR] = { NULL, or_, PREC_OR },
     [TOKEN_PRINT] = { NULL, NULL, PREC_NONE },
     [TOKEN_RETURN] = { NULL, NULL, PREC_NONE },
+    [TOKEN_STRUCT] = { NULL, NULL, PREC_NONE },
     [TOKEN_SUPER] = { super_, NULL, PREC_NONE },
     [TOKEN_THIS] = { this_, NULL, PREC_NONE },
     [TOKEN_TRUE] = { literal, NULL, PREC_NONE },
@@ -662,11 +1195,13 @@ static void parsePrecedence(Precedence precedence)
     }
 
     bool canAssign = precedence <= PREC_ASSIGNMENT;
+    int start = currentChunk()->count;
     prefixRule(canAssign);
 
     while (precedence <= getRule(parser.current.type)->precedence) {
         advance();
         ParseFn infixRule = getRule(parser.previous.type)->infix;
+        current->operandStart = start;
         infixRule(canAssign);
     }
 
@@ -681,6 +1216,13 @@ static uint32_t identifierConstant(Token* name)
     return makeConstant(OBJ_VAL(identifier));
 }
 
+// Method and property names are not stored as constants, but addressed by selectors that are
+// shared between all chunks.
+static uint32_t selectorConstant(Token* name)
+{
+    return makeSelector(copyString(name->start, name->length));
+}
+
 static bool identifiersEqual(Token* a, Token* b)
 {
     if (a->length != b->length)
@@ -696,11 +1238,13 @@ static uint32_t firstOrMakeGlobal(Token* name)
         return addr;
     }
 
+    push(OBJ_VAL(identifier));
     addr = addresstableAdd(&vm.gloablsTable, identifier,
         (Var) {
             .identifier = identifier,
             .readonly = false,
         });
+    pop(); // identifier
 
     return addr;
 }
@@ -720,13 +1264,14 @@ static int resolveLocal(Compiler* compiler, Token* name)
     return -1;
 }
 
-static int addUpvalue(Compiler* compiler, uint32_t index, bool isLocal, Var* varProps)
+static int addUpvalue(Compiler* compiler, uint32_t index, bool isLocal, bool isCopy,
+    Var* varProps)
 {
-    int upvalueCount = compiler->function->upvalueCount;
+    int upvalueCount = compiler->upvalueCount;
 
     for (int i = 0; i < upvalueCount; i++) {
         Upvalue* upvalue = &compiler->upvalues[i];
-        if (upvalue->index == index && upvalue->isLocal == isLocal) {
+        if (upvalue->index == index && upvalue->isLocal == isLocal && upvalue->isCopy == isCopy) {
             return i;
         }
     }
@@ -736,10 +1281,68 @@ static int addUpvalue(Compiler* compiler, uint32_t index, bool isLocal, Var* var
         return 0;
     }
 
+    ObjFunction* function = compiler->function;
     compiler->upvalues[upvalueCount].isLocal = isLocal;
     compiler->upvalues[upvalueCount].index = index;
+    compiler->upvalues[upvalueCount].isCopy = isCopy;
+    compiler->upvalues[upvalueCount].slot
+        = isCopy ? function->capturedCount++ : function->upvalueCount++;
     compiler->upvalues[upvalueCount].varProps = varProps;
-    return compiler->function->upvalueCount++;
+    return compiler->upvalueCount++;
+}
+
+// Whether the local keeps the value it was declared with. Constants do, other locals when no
+// assignment to their name follows in their block.
+static bool isUnchanging(Var* local)
+{
+    if (local->readonly) {
+        return true;
+    }
+    if (local->scope.current == NULL) {
+        return false;
+    }
+    if (!local->isScanned) {
+        Scanner saved = saveScanner();
+        restoreScanner(local->scope);
+        Token name = {
+            .start = local->identifier->chars,
+            .length = local->identifier->length,
+        };
+        int depth = 0;
+        TokenType previous = TOKEN_EOF;
+        bool isNamed = false;
+        for (;;) {
+            Token token = scanToken();
+            if (isNamed && token.type == TOKEN_EQUAL) {
+                local->isReassigned = true;
+                break;
+            }
+            if (token.type == TOKEN_EOF || token.type == TOKEN_ERROR) {
+                break;
+            }
+            if (token.type == TOKEN_LEFT_BRACE) {
+                depth++;
+            } else if (token.type == TOKEN_RIGHT_BRACE && --depth < 0) {
+                break;
+            }
+            isNamed = token.type == TOKEN_IDENTIFIER && previous != TOKEN_DOT
+                && identifiersEqual(&token, &name);
+            previous = token.type;
+        }
+        restoreScanner(saved);
+        local->isScanned = true;
+    }
+    return !local->isReassigned;
+}
+
+// Starts the scope of the local at the token the parser looks at.
+static void startScope(Var* local)
+{
+    local->scope = (Scanner) {
+        .start = parser.current.start,
+        .current = parser.current.start,
+        .line = parser.current.line,
+    };
 }
 
 static int resolveUpvalue(Compiler* compiler, Token* name, Var** varProps)
@@ -750,15 +1353,22 @@ static int resolveUpvalue(Compiler* compiler, Token* name, Var** varProps)
 
     int local = resolveLocal(compiler->enclosing, name);
     if (local != -1) {
-        addresstableGetProps(&compiler->enclosing->locals, local)->isCaptured = true;
         *varProps = addresstableGetProps(
             &compiler->enclosing->locals, local); // TODO: check - added enclosing
-        return addUpvalue(compiler, (uint32_t)local, true, *varProps);
+        // direct functions read the local in its slot, and copies are made from it, so it never
+        // moves to the heap
+        bool isDirect = compiler->type == TYPE_DIRECT_FUNCTION;
+        bool isCopy = !isDirect && isUnchanging(*varProps);
+        if (!isDirect && !isCopy) {
+            (*varProps)->isCaptured = true;
+        }
+        return addUpvalue(compiler, (uint32_t)local, true, isCopy, *varProps);
     }
 
     int upvalue = resolveUpvalue(compiler->enclosing, name, varProps);
     if (upvalue != -1) {
-        return addUpvalue(compiler, upvalue, false, *varProps);
+        const Upvalue* enclosing = &compiler->enclosing->upvalues[upvalue];
+        return addUpvalue(compiler, enclosing->slot, false, enclosing->isCopy, *varProps);
     }
 
     return -1;
@@ -851,6 +1461,9 @@ static uint8_t argumentList(TokenType endToken)
 static void and_(bool canAssign)
 {
     (void)canAssign;
+    if (foldLogical(true, PREC_AND)) {
+        return;
+    }
     int endJump = emitJump(OP_JUMP_IF_FALSE);
     emitByte(OP_POP);
 
@@ -878,10 +1491,9 @@ static void block()
     consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
 }
 
-static void function(FunctionType type)
+// Declares the parameters as locals of the function being compiled.
+static void parameters()
 {
-    Compiler compiler;
-    initCompiler(&compiler, type);
     beginScope();
 
     consume(TOKEN_LEFT_PAREN, "Expect '(' after function name.");
@@ -897,31 +1509,133 @@ static void function(FunctionType type)
     }
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
     consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+}
+
+// The parameters and the body of the function being compiled.
+static void functionBody()
+{
+    parameters();
+    VarArray* locals = &current->locals.props;
+    for (unsigned int i = 0; i < locals->count; i++) {
+        startScope(&locals->values[i]);
+    }
     block();
+}
+
+// Functions and methods declared at the top level capture nothing, so they can be compiled apart
+// from the code around them.
+static bool isLazy(FunctionType type)
+{
+    return vm.lazy && current->type == TYPE_SCRIPT && current->scopeDepth == 0
+        && (type == TYPE_FUNCTION || type == TYPE_METHOD || type == TYPE_INITIALIZER);
+}
+
+// Only checks the parameters and the tokens of the body, which is kept to be compiled on the first
+// call.
+static ObjFunction* lazyFunction(FunctionType type)
+{
+    ObjFunction* function = newFunction();
+    push(OBJ_VAL(function));
+    function->name = copyString(parser.previous.start, parser.previous.length);
+    function->lazy.isMethod = type != TYPE_FUNCTION;
+
+    const char* start = parser.current.start;
+    int line = parser.current.line;
+    // the parameters are declared in a scratch compiler, which rejects duplicates
+    Compiler scratch;
+    initCompiler(&scratch, type, function);
+    parameters();
+    freeCompiler(&scratch);
+    current = scratch.enclosing;
+
+    // the compiler would recover in the body, after an error in front of it
+    if (parser.panicMode && !check(TOKEN_EOF)) {
+        parser.panicMode = false;
+    }
+    int depth = 1;
+    while (depth > 0 && !check(TOKEN_EOF)) {
+        advance();
+        if (parser.previous.type == TOKEN_LEFT_BRACE) {
+            depth++;
+        } else if (parser.previous.type == TOKEN_RIGHT_BRACE) {
+            depth--;
+        }
+    }
+    if (depth > 0) {
+        consume(TOKEN_RIGHT_BRACE, "Expect '}' after block.");
+    }
+
+    if (!parser.hadError) {
+        int length = (int)(parser.previous.start + parser.previous.length - start);
+        char* chars = ALLOCATE(char, length + 1);
+        memcpy(chars, start, length);
+        chars[length] = '\0';
+        function->lazy = (LazySource) {
+            .chars = chars,
+            .length = length,
+            .line = line,
+            .isMethod = function->lazy.isMethod,
+        };
+    }
+    emitConstant(
+        makeConstant(OBJ_VAL(function)), parser.previous.line, OP_CLOSURE, OP_CLOSURE_LONG);
+    pop();
+    return function;
+}
+
+static ObjFunction* function(FunctionType type)
+{
+    if (isLazy(type)) {
+        return lazyFunction(type);
+    }
+    Compiler compiler;
+    initCompiler(&compiler, type, NULL);
+    functionBody();
 
     ObjFunction* function = endCompiler();
+    if (type == TYPE_DIRECT_FUNCTION) {
+        // it captures nothing, so one closure serves every call
+        function->upvalueCount = 0;
+        function->capturedCount = 0;
+        push(OBJ_VAL(function));
+        ObjClosure* closure = newClosure(function);
+        push(OBJ_VAL(closure));
+        emitConstant(
+            makeConstant(OBJ_VAL(closure)), parser.previous.line, OP_CONSTANT, OP_CONSTANT_LONG);
+        pop();
+        pop();
+        return function;
+    }
     emitConstant(
         makeConstant(OBJ_VAL(function)), parser.previous.line, OP_CLOSURE, OP_CLOSURE_LONG);
 
-    for (int i = 0; i < function->upvalueCount; i++) {
-        emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
-        emitByte(compiler.upvalues[i].index);
+    // the boxed variables come first, then the copies
+    for (int copies = 0; copies < 2; copies++) {
+        for (int i = 0; i < compiler.upvalueCount; i++) {
+            if (compiler.upvalues[i].isCopy == copies) {
+                emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
+                emitByte(compiler.upvalues[i].index);
+            }
+        }
     }
+    return function;
 }
 
 static void method()
 {
     consume(TOKEN_IDENTIFIER, "Expect method name.");
-    // TODO: use addresses instead of strings to address methods
-    uint32_t constantAddr = identifierConstant(&parser.previous);
+    uint32_t selector = selectorConstant(&parser.previous);
 
     FunctionType type = TYPE_METHOD;
     if (parser.previous.length == 4 && memcmp(parser.previous.start, "init", 4) == 0) {
         type = TYPE_INITIALIZER;
     }
-    function(type);
+    ObjFunction* compiled = function(type);
+    if (vm.optimize && type == TYPE_METHOD) {
+        offerInlineMethod(selector, compiled);
+    }
 
-    emitConstant(constantAddr, parser.previous.line, OP_METHOD, OP_METHOD_LONG);
+    emitConstant(selector, parser.previous.line, OP_METHOD, OP_METHOD_LONG);
 }
 
 static void classDeclaration()
@@ -971,18 +1685,119 @@ static void classDeclaration()
     currentClass = currentClass->enclosing;
 }
 
+// struct Name { field, ... } declares a value type. The type is built right here and stored as a
+// constant, because its layout is fixed.
+static void structDeclaration()
+{
+    uint32_t varAddr = parseVariable("Expect struct name.");
+    ObjString* name = copyString(parser.previous.start, parser.previous.length);
+    push(OBJ_VAL(name));
+    ObjStructType* type = newStructType(name);
+    push(OBJ_VAL(type));
+    emitConstant(makeConstant(OBJ_VAL(type)), parser.previous.line, OP_CONSTANT, OP_CONSTANT_LONG);
+    pop();
+    pop();
+
+    consume(TOKEN_LEFT_BRACE, "Expect '{' before struct fields.");
+    do {
+        consume(TOKEN_IDENTIFIER, "Expect field name.");
+        if (!structAddField(type, selectorConstant(&parser.previous))) {
+            error("Already a field with this name in this struct.");
+        }
+    } while (match(TOKEN_COMMA));
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after struct fields.");
+
+    defineVariable(varAddr, true);
+}
+
+static bool isDeclaration(TokenType type)
+{
+    return type == TOKEN_VAR || type == TOKEN_CONST || type == TOKEN_FUN || type == TOKEN_CLASS;
+}
+
+// Whether the local function declared by name is only ever called by name from the function
+// declaring it, looking at the tokens up to the end of its block. Any other use of the name, or
+// one inside a function or class declared in between, could let it escape, and its own body may
+// not declare functions, which would capture from it.
+static bool isDirectFunction(Token name)
+{
+    if (current->scopeDepth == 0) {
+        return false;
+    }
+    Scanner saved = saveScanner();
+    int depth = 1; // the parameter list is open
+    bool inBody = true;
+    bool nested = false;
+    bool isDirect = true;
+    TokenType previous = TOKEN_LEFT_PAREN;
+    bool isCallee = false;
+    for (;;) {
+        Token token = scanToken();
+        if (isCallee && token.type != TOKEN_LEFT_PAREN) {
+            isDirect = false;
+        }
+        isCallee = false;
+        if (!isDirect || token.type == TOKEN_EOF || token.type == TOKEN_ERROR) {
+            break;
+        }
+        switch (token.type) {
+        case TOKEN_LEFT_PAREN:
+        case TOKEN_LEFT_BRACE:
+        case TOKEN_LEFT_BRACKET:
+            depth++;
+            break;
+        case TOKEN_RIGHT_PAREN:
+        case TOKEN_RIGHT_BRACKET:
+            depth--;
+            break;
+        case TOKEN_RIGHT_BRACE:
+            depth--;
+            inBody = inBody && depth > 0;
+            break;
+        case TOKEN_FUN:
+        case TOKEN_CLASS:
+            nested = true;
+            isDirect = !inBody;
+            break;
+        case TOKEN_IDENTIFIER:
+            if (previous != TOKEN_DOT && identifiersEqual(&token, &name)) {
+                isDirect = !inBody && !nested && !isDeclaration(previous);
+                isCallee = true;
+            }
+            break;
+        default:
+            break;
+        }
+        // the end of the block declaring the function
+        if (depth < 0) {
+            break;
+        }
+        previous = token.type;
+    }
+    restoreScanner(saved);
+    return isDirect;
+}
+
 static void funDeclaration()
 {
-    uint8_t addr = parseVariable("Expect function name.");
+    uint32_t addr = parseVariable("Expect function name.");
     markInitialized();
-    function(TYPE_FUNCTION);
+    bool isDirect = isDirectFunction(parser.previous);
+    ObjFunction* compiled = function(isDirect ? TYPE_DIRECT_FUNCTION : TYPE_FUNCTION);
+    if (vm.optimize && current->scopeDepth == 0) {
+        offerInlineFunction(addr, compiled);
+    }
     defineVariable(addr, true);
 }
 
 static void varDeclaration(bool readonly)
 {
     uint32_t addr = parseVariable("Expect variable name.");
+    if (current->scopeDepth > 0) {
+        startScope(addresstableGetProps(&current->locals, addr));
+    }
 
+    int start = currentChunk()->count;
     if (match(TOKEN_EQUAL)) {
         expression();
     } else {
@@ -992,6 +1807,11 @@ static void varDeclaration(bool readonly)
     consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
 
     defineVariable(addr, readonly);
+    if (current->scopeDepth > 0 && addr <= UINT8_MAX && isNumberFrom(start)) {
+        Var* local = addresstableGetProps(&current->locals, addr);
+        local->type = VAR_TYPE_NUMBER;
+        local->sources = current->numberSources;
+    }
 }
 
 static void expressionStatement()
@@ -1002,6 +1822,127 @@ static void expressionStatement()
     emitByte(OP_POP);
 }
 
+// Compiles a statement that never runs, just to report its errors.
+static void deadStatement()
+{
+    int start = currentChunk()->count;
+    uint32_t constantCount = currentChunk()->constants.count;
+    statement();
+    discardCode(start, constantCount);
+}
+
+// A for loop counting a local up or down, `for (...; i < limit; i = i + step)`, where the limit is
+// a constant or a variable and the step a number literal. Its increment and condition run as one
+// OP_FOR_LOOP at the end of the body.
+typedef struct {
+    uint8_t slot;
+    int limitStart;
+    int limitEnd;
+    uint8_t compare;
+    uint8_t increment;
+    Value step;
+    uint32_t stepConstant;
+    Linenumber line;
+} CountedLoop;
+
+// The size of an instruction loading a constant or a variable, 0 for other instructions.
+static int loadSize(uint8_t op)
+{
+    switch (op) {
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_GET_GLOBAL:
+    case OP_GET_UPVALUE:
+        return 2;
+    case OP_CONSTANT_LONG:
+    case OP_GET_LOCAL_LONG:
+    case OP_GET_GLOBAL_LONG:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static uint8_t genericComparison(uint8_t op)
+{
+    switch (op) {
+    case OP_LESS:
+    case OP_LESS_NUMBER:
+        return OP_LESS;
+    case OP_LESS_EQUAL:
+    case OP_LESS_EQUAL_NUMBER:
+        return OP_LESS_EQUAL;
+    case OP_GREATER:
+    case OP_GREATER_NUMBER:
+        return OP_GREATER;
+    case OP_GREATER_EQUAL:
+    case OP_GREATER_EQUAL_NUMBER:
+        return OP_GREATER_EQUAL;
+    default:
+        return OP_UNDEFINED;
+    }
+}
+
+// Whether the condition from start on compares a local with a limit. The limit is loaded before
+// the increment by OP_FOR_LOOP, so it can't be the counter itself.
+static bool isCountedCondition(int start, CountedLoop* loop)
+{
+    const Chunk* chunk = currentChunk();
+    const uint8_t* code = &chunk->code[start];
+    int count = (int)chunk->count - start;
+    if (count < 5 || code[0] != OP_GET_LOCAL || count != 2 + loadSize(code[2]) + 1
+        || (code[2] == OP_GET_LOCAL && code[3] == code[1])) {
+        return false;
+    }
+    loop->slot = code[1];
+    loop->limitStart = start + 2;
+    loop->limitEnd = start + count - 1;
+    loop->compare = genericComparison(code[count - 1]);
+    return loop->compare != OP_UNDEFINED;
+}
+
+// Whether the increment from start on adds a number literal to the counter, or subtracts it.
+static bool isCountedIncrement(int start, CountedLoop* loop)
+{
+    Chunk* chunk = currentChunk();
+    const uint8_t* code = &chunk->code[start];
+    if ((int)chunk->count - start != 7 || code[0] != OP_GET_LOCAL || code[1] != loop->slot
+        || code[2] != OP_CONSTANT || code[5] != OP_SET_LOCAL || code[6] != loop->slot) {
+        return false;
+    }
+    loop->step = chunk->constants.values[code[3]];
+    if (code[4] == OP_ADD || code[4] == OP_ADD_NUMBER) {
+        loop->increment = OP_ADD;
+    } else if (code[4] == OP_SUBTRACT || code[4] == OP_SUBTRACT_NUMBER) {
+        loop->increment = OP_SUBTRACT;
+    } else {
+        return false;
+    }
+    loop->line = getLinenumber(chunk, start);
+    return IS_NUMBER(loop->step);
+}
+
+// Loads the limit again and emits the OP_FOR_LOOP jumping back to the body.
+static void emitCountedLoop(const CountedLoop* loop, int bodyStart)
+{
+    Chunk* chunk = currentChunk();
+    for (int i = loop->limitStart; i < loop->limitEnd; i++) {
+        writeChunk(chunk, chunk->code[i], getLinenumber(chunk, i));
+    }
+    writeChunk(chunk, OP_FOR_LOOP, loop->line);
+    writeChunk(chunk, loop->slot, loop->line);
+    writeChunk(chunk, (uint8_t)loop->stepConstant, loop->line);
+    writeChunk(chunk, loop->increment, loop->line);
+    writeChunk(chunk, loop->compare, loop->line);
+
+    int offset = (int)chunk->count - bodyStart + 2;
+    if (offset > UINT16_MAX) {
+        error("Loop body too large.");
+    }
+    writeChunk(chunk, (offset >> 8) & 0xff, loop->line);
+    writeChunk(chunk, offset & 0xff, loop->line);
+}
+
 static void forStatement()
 {
     beginScope();
@@ -1016,28 +1957,71 @@ static void forStatement()
     }
 
     int loopStart = currentChunk()->count;
+    uint32_t constantCount = currentChunk()->constants.count;
     int exitJump = -1;
+    CountedLoop counted = { 0 };
+    bool isCounted = false;
     if (!match(TOKEN_SEMICOLON)) {
         expression();
         consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
 
-        // Jump out of the loop, when condition is false.
-        exitJump = emitJump(OP_JUMP_IF_FALSE);
-        emitByte(OP_POP); // Condition
+        Value condition;
+        if (!constantFrom(loopStart, &condition)) {
+            isCounted = isCountedCondition(loopStart, &counted);
+            // Jump out of the loop, when condition is false.
+            exitJump = emitJump(OP_JUMP_IF_FALSE);
+            emitByte(OP_POP); // Condition
+        } else if (isFalsey(condition)) {
+            // neither the increment nor the body ever run
+            if (!match(TOKEN_RIGHT_PAREN)) {
+                expression();
+                consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+            }
+            statement();
+            discardCode(loopStart, constantCount);
+            endScope();
+            return;
+        } else {
+            discardCode(loopStart, constantCount);
+        }
     }
 
     if (!match(TOKEN_RIGHT_PAREN)) {
+        uint32_t incrementConstants = currentChunk()->constants.count;
         int bodyJump = emitJump(OP_JUMP);
         int incrementStart = currentChunk()->count;
         expression();
-        emitByte(OP_POP);
+        isCounted = isCounted && isCountedIncrement(incrementStart, &counted);
+        if (isCounted) {
+            // the increment moves behind the body
+            discardCode(bodyJump - 1, incrementConstants);
+            counted.stepConstant = makeConstant(counted.step);
+        } else {
+            emitByte(OP_POP);
+        }
         consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
 
-        emitLoop(loopStart);
-        loopStart = incrementStart;
-        patchJump(bodyJump);
+        if (!isCounted) {
+            emitLoop(loopStart);
+            loopStart = incrementStart;
+            patchJump(bodyJump);
+        }
+    } else {
+        isCounted = false;
     }
 
+    if (isCounted) {
+        int bodyStart = currentChunk()->count;
+        statement();
+        emitCountedLoop(&counted, bodyStart);
+        // leaving through OP_FOR_LOOP, there is no condition to pop
+        int endJump = emitJump(OP_JUMP);
+        patchJump(exitJump);
+        emitByte(OP_POP); // Condition
+        patchJump(endJump);
+        endScope();
+        return;
+    }
 
     statement();
     emitLoop(loopStart);
@@ -1052,9 +2036,29 @@ static void forStatement()
 static void ifStatement()
 {
     consume(TOKEN_LEFT_PAREN, "Expect '(' after 'if'.");
+    int conditionStart = currentChunk()->count;
+    uint32_t constantCount = currentChunk()->constants.count;
     expression();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
 
+    Value condition;
+    if (constantFrom(conditionStart, &condition)) {
+        // only one of the branches can run
+        discardCode(conditionStart, constantCount);
+        if (isFalsey(condition)) {
+            deadStatement();
+            if (match(TOKEN_ELSE)) {
+                statement();
+            }
+        } else {
+            statement();
+            if (match(TOKEN_ELSE)) {
+                deadStatement();
+            }
+        }
+        return;
+    }
+
     int thenJump = emitJump(OP_JUMP_IF_FALSE);
     emitByte(OP_POP);
     statement();
@@ -1098,11 +2102,25 @@ static void returnStatement()
 static void whileStatement()
 {
     int loopStart = currentChunk()->count;
+    uint32_t constantCount = currentChunk()->constants.count;
 
     consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
     expression();
     consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
 
+    Value condition;
+    if (constantFrom(loopStart, &condition)) {
+        // the loop either never runs, or never stops on its own
+        discardCode(loopStart, constantCount);
+        if (isFalsey(condition)) {
+            deadStatement();
+        } else {
+            statement();
+            emitLoop(loopStart);
+        }
+        return;
+    }
+
     int exitJump = emitJump(OP_JUMP_IF_FALSE);
     emitByte(OP_POP);
     statement();
@@ -1123,6 +2141,7 @@ static void synchronize()
         }
         switch (parser.current.type) {
         case TOKEN_CLASS:
+        case TOKEN_STRUCT:
         case TOKEN_FUN:
         case TOKEN_VAR:
         case TOKEN_CONST:
@@ -1142,6 +2161,8 @@ static void declaration()
 {
     if (match(TOKEN_CLASS)) {
         classDeclaration();
+    } else if (match(TOKEN_STRUCT)) {
+        structDeclaration();
     } else if (match(TOKEN_FUN)) {
         funDeclaration();
     } else if (match(TOKEN_VAR)) {
@@ -1197,9 +2218,9 @@ void defineNative(const char* name, NativeFn function)
 
 ObjFunction* compile(const char* source)
 {
-    initScanner(source);
+    initScanner(source, 1);
     Compiler compiler;
-    initCompiler(&compiler, TYPE_SCRIPT);
+    initCompiler(&compiler, TYPE_SCRIPT, NULL);
 
     parser.hadError = false;
     parser.panicMode = false;
@@ -1214,6 +2235,40 @@ ObjFunction* compile(const char* source)
     return parser.hadError ? NULL : scriptFunction;
 }
 
+bool compileLazy(ObjFunction* function)
+{
+    LazySource* source = &function->lazy;
+    initScanner(source->chars, source->line);
+    parser.hadError = false;
+    parser.panicMode = false;
+
+    // methods compiled lazily belong to classes without a superclass
+    ClassCompiler classCompiler = { .enclosing = NULL, .hasSuperclass = false };
+    FunctionType type = TYPE_FUNCTION;
+    if (source->isMethod) {
+        currentClass = &classCompiler;
+        type = strcmp(function->name->chars, "init") == 0 ? TYPE_INITIALIZER : TYPE_METHOD;
+    }
+    Compiler compiler;
+    initCompiler(&compiler, type, function);
+    // counted again with the parameters
+    function->arity = 0;
+
+    advance();
+    functionBody();
+    endCompiler();
+    currentClass = NULL;
+
+    if (parser.hadError) {
+        // compiled again, when called again
+        freeChunk(&function->chunk);
+        return false;
+    }
+    FREE_ARRAY(char, source->chars, source->length + 1);
+    source->chars = NULL;
+    return true;
+}
+
 void markCompilerRoots()
 {
     Compiler* compiler = current;
@@ -1223,3 +2278,13 @@ void markCompilerRoots()
         compiler = compiler->enclosing;
     }
 }
+
+#ifdef DEBUG_CONSTANT_STATS
+void printConstantStats()
+{
+    fprintf(stderr, "== Constant stats ==\n");
+    fprintf(stderr, "constants:       %lu\n", (unsigned long)stats.constants);
+    fprintf(stderr, "shared:          %lu\n", (unsigned long)stats.shared);
+    fprintf(stderr, "long avoided:    %lu (at least)\n", (unsigned long)stats.longAvoided);
+}
+#endif
@@ -6,4 +6,11 @@
 
 void defineNative(const char* name, NativeFn function);
 ObjFunction* compile(const char* source);
+// Compiles a function whose body was only scanned so far. Reports the errors and returns false,
+// when it does not compile.
+bool compileLazy(ObjFunction* function);
 void markCompilerRoots();
+
+#ifdef DEBUG_CONSTANT_STATS
+void printConstantStats();
+#endif
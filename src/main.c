@@ -61,17 +61,25 @@ static void runFile(const char* path)
 
 int main(int argc, const char* argv[])
 {
-    (void)argc;
-    (void)argv;
-
     initVM();
 
-    if (argc == 1) {
+    int arg = 1;
+    for (; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-O") == 0) {
+            vm.optimize = true;
+        } else if (strcmp(argv[arg], "-L") == 0) {
+            vm.lazy = true;
+        } else {
+            break;
+        }
+    }
+
+    if (arg == argc) {
         repl();
-    } else if (argc == 2) {
-        runFile(argv[1]);
+    } else if (arg + 1 == argc) {
+        runFile(argv[arg]);
     } else {
-        fprintf(stderr, "Usage: pit [path]\n");
+        fprintf(stderr, "Usage: pit [-O] [-L] [path]\n");
         exit(64);
     }
 
@@ -1,9 +1,46 @@
+#include <string.h>
 #include <time.h>
 
 #include "natives.h"
 #include "values/value.h"
 #include "compiler.h"
 #include "util/memory.h"
+#include "natives/arraylib.h"
+#include "natives/framelib.h"
+#include "natives/iteratorlib.h"
+#include "natives/maplib.h"
+#include "natives/numberlib.h"
+#include "natives/stringlib.h"
+#include "natives/structlib.h"
+#include "vm.h"
+
+bool checkArity(const char* name, int argCount, int min, int max)
+{
+    if (argCount < min || argCount > max) {
+        if (min == max) {
+            nativeError("%s() expected %d arguments but got %d.", name, min, argCount);
+        } else {
+            nativeError(
+                "%s() expected %d to %d arguments but got %d.", name, min, max, argCount);
+        }
+        return false;
+    }
+    return true;
+}
+
+void defineNativeMethod(NativeMethods* methods, const char* name, NativeFn function)
+{
+    uint32_t selector = makeSelector(copyString(name, (int)strlen(name)));
+    if (selector >= methods->count) {
+        unsigned int oldCount = methods->count;
+        methods->functions = GROW_ARRAY(NativeFn, methods->functions, oldCount, selector + 1);
+        methods->count = selector + 1;
+        for (unsigned int i = oldCount; i < methods->count; i++) {
+            methods->functions[i] = NULL;
+        }
+    }
+    methods->functions[selector] = function;
+}
 
 static Value clockNative(int argCount, Value* args)
 {
@@ -26,4 +63,12 @@ void defineNatives()
 {
     defineNative("clock", clockNative);
     defineNative("collectGarbage", collectGarbageNative);
+
+    defineStringNatives();
+    defineNumberNatives();
+    defineMapNatives();
+    defineArrayMethods();
+    defineIteratorNatives();
+    defineFrameNatives();
+    defineStructNatives();
 }
\ No newline at end of file
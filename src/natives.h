@@ -1,3 +1,11 @@
 #pragma once
 
-void defineNatives();
\ No newline at end of file
+#include "common.h"
+#include "vm.h"
+
+void defineNatives();
+// Defines a builtin method. It is called like a native, with the receiver as argument 1.
+void defineNativeMethod(NativeMethods* methods, const char* name, NativeFn function);
+
+// Reports a native error and returns false, if argCount is not within min and max.
+bool checkArity(const char* name, int argCount, int min, int max);
\ No newline at end of file
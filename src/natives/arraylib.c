@@ -0,0 +1,251 @@
+#include "arraylib.h"
+#include "../natives.h"
+#include "../util/memory.h"
+#include "../util/sort.h"
+#include "../values/array.h"
+#include "../values/object.h"
+#include "../vm.h"
+
+// Methods get the array as argument 1, the dispatch in the vm already checked its type.
+
+static bool checkNumber(const char* name, Value* args, int index)
+{
+    if (!IS_NUMBER(args[index])) {
+        nativeError("%s() expects a number as argument %d.", name, index + 1);
+        return false;
+    }
+    return true;
+}
+
+static bool isTruthy(Value value)
+{
+    return !IS_NIL(value) && !(IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// Negative positions count from the end. The result is clamped to the array.
+static unsigned int clampPosition(double position, unsigned int count)
+{
+    if (position < 0) {
+        position += count;
+    }
+    if (!(position > 0)) {
+        return 0;
+    }
+    return position < count ? (unsigned int)position : count;
+}
+
+static Value pushMethod(int argCount, Value* args)
+{
+    if (!checkArity("push", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    ObjArray* array = AS_ARRAY(args[0]);
+    arrayPush(array, args[1]);
+    return NUMBER_VAL(array->count);
+}
+
+static Value popMethod(int argCount, Value* args)
+{
+    if (!checkArity("pop", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    ObjArray* array = AS_ARRAY(args[0]);
+    if (array->count == 0) {
+        return nativeError("pop() expects a non-empty array.");
+    }
+    array->count--;
+    return arrayGet(array, array->count);
+}
+
+// slice(start, end?, stride?) does not copy, it returns a view sharing the storage of the array.
+static Value sliceMethod(int argCount, Value* args)
+{
+    if (!checkArity("slice", argCount, 2, 4) || !checkNumber("slice", args, 1)
+        || (argCount >= 3 && !checkNumber("slice", args, 2))
+        || (argCount == 4 && !checkNumber("slice", args, 3))) {
+        return NIL_VAL;
+    }
+    ObjArray* array = AS_ARRAY(args[0]);
+    unsigned int start = clampPosition(AS_NUMBER(args[1]), array->count);
+    unsigned int end
+        = argCount >= 3 ? clampPosition(AS_NUMBER(args[2]), array->count) : array->count;
+    double stride = argCount == 4 ? AS_NUMBER(args[3]) : 1;
+    if (!(stride >= 1)) {
+        return nativeError("slice() expects a stride of at least 1.");
+    }
+
+    if (end <= start) {
+        return OBJ_VAL(newArray());
+    }
+    // larger strides than the array only ever take the first element
+    unsigned int step = stride < array->count ? (unsigned int)stride : array->count;
+    unsigned int count = (end - start + step - 1) / step;
+    return OBJ_VAL(newArrayView(array, start, count, step));
+}
+
+static Value indexOfMethod(int argCount, Value* args)
+{
+    if (!checkArity("indexOf", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    const ObjArray* array = AS_ARRAY(args[0]);
+    Value value = args[1];
+
+    if (array->kind == ARRAY_NUMBERS) {
+        if (IS_NUMBER(value)) {
+            double number = AS_NUMBER(value);
+            for (unsigned int i = 0; i < array->count; i++) {
+                if (array->as.numbers[i * array->stride] == number) {
+                    return NUMBER_VAL(i);
+                }
+            }
+        }
+        return NUMBER_VAL(-1);
+    }
+    for (unsigned int i = 0; i < array->count; i++) {
+        if (valuesEqual(array->as.values[i * array->stride], value)) {
+            return NUMBER_VAL(i);
+        }
+    }
+    return NUMBER_VAL(-1);
+}
+
+// Calls the function in args[1] for every element. The callback may change the array, so its
+// count is read again after every call.
+static Value transform(const char* name, int argCount, Value* args, bool filter)
+{
+    if (!checkArity(name, argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    ObjArray* array = AS_ARRAY(args[0]);
+
+    ObjArray* result = newArray();
+    push(OBJ_VAL(result));
+    for (unsigned int i = 0; i < array->count; i++) {
+        // the element stays on the stack, in case the callback removes it from the array
+        Value element = arrayGet(array, i);
+        push(element);
+        push(args[1]);
+        push(element);
+        if (!callFunction(1)) {
+            return NIL_VAL;
+        }
+
+        Value value = vm.stackTop[-1];
+        if (!filter) {
+            arrayPush(result, value);
+        } else if (isTruthy(value)) {
+            arrayPush(result, element);
+        }
+        pop();
+        pop();
+    }
+    pop();
+    return OBJ_VAL(result);
+}
+
+static Value mapMethod(int argCount, Value* args)
+{
+    return transform("map", argCount, args, false);
+}
+
+static Value filterMethod(int argCount, Value* args)
+{
+    return transform("filter", argCount, args, true);
+}
+
+typedef struct {
+    Value function;
+    bool failed;
+} Comparator;
+
+static bool callComparator(void* context, Value a, Value b)
+{
+    Comparator* comparator = (Comparator*)context;
+    if (comparator->failed) {
+        return false;
+    }
+    push(comparator->function);
+    push(a);
+    push(b);
+    if (!callFunction(2)) {
+        comparator->failed = true;
+        return false;
+    }
+    return isTruthy(pop());
+}
+
+// Sorts with a script function, that returns true when its first argument goes first. The
+// callback runs while the elements are being moved around, so they are sorted in a copy. A second
+// copy keeps every element alive, even when the callback empties the array.
+static bool sortWithComparator(ObjArray* array, Value function)
+{
+    ObjArray* elements = newArray();
+    push(OBJ_VAL(elements));
+    ObjArray* sorted = newArray();
+    push(OBJ_VAL(sorted));
+    for (unsigned int i = 0; i < array->count; i++) {
+        arrayPush(elements, arrayGet(array, i));
+        arrayPush(sorted, arrayGet(array, i));
+    }
+    if (sorted->kind == ARRAY_NUMBERS) {
+        arrayBoxNumbers(sorted);
+    }
+
+    Comparator comparator = { function, false };
+    sortValues(sorted->as.values, sorted->count, callComparator, &comparator);
+    if (comparator.failed) {
+        // the stack is gone already
+        return false;
+    }
+
+    array->count = array->count < sorted->count ? array->count : sorted->count;
+    for (unsigned int i = 0; i < sorted->count; i++) {
+        if (i < array->count) {
+            arraySet(array, i, sorted->as.values[i]);
+        } else {
+            arrayPush(array, sorted->as.values[i]);
+        }
+    }
+    pop();
+    pop();
+    return true;
+}
+
+static Value sortMethod(int argCount, Value* args)
+{
+    if (!checkArity("sort", argCount, 1, 2)) {
+        return NIL_VAL;
+    }
+    ObjArray* array = AS_ARRAY(args[0]);
+
+    if (argCount == 2) {
+        return sortWithComparator(array, args[1]) ? args[0] : NIL_VAL;
+    }
+    if (array->shared != NULL) {
+        arrayUnshare(array);
+    }
+    if (arrayPackNumbers(array)) {
+        sortNumbers(array->as.numbers, array->count);
+        return args[0];
+    }
+    for (unsigned int i = 0; i < array->count; i++) {
+        if (!IS_STRING(array->as.values[i])) {
+            return nativeError("sort() needs a comparator, unless all elements are numbers or all "
+                               "are strings.");
+        }
+    }
+    sortStrings(array->as.values, array->count);
+    return args[0];
+}
+
+void defineArrayMethods()
+{
+    defineNativeMethod(&vm.arrayMethods, "push", pushMethod);
+    defineNativeMethod(&vm.arrayMethods, "pop", popMethod);
+    defineNativeMethod(&vm.arrayMethods, "slice", sliceMethod);
+    defineNativeMethod(&vm.arrayMethods, "indexOf", indexOfMethod);
+    defineNativeMethod(&vm.arrayMethods, "map", mapMethod);
+    defineNativeMethod(&vm.arrayMethods, "filter", filterMethod);
+    defineNativeMethod(&vm.arrayMethods, "sort", sortMethod);
+}
@@ -0,0 +1,414 @@
+#include <string.h>
+
+#include "framelib.h"
+#include "../compiler.h"
+#include "../natives.h"
+#include "../util/memory.h"
+#include "../util/numberkernels.h"
+#include "../values/array.h"
+#include "../values/map.h"
+#include "../values/object.h"
+#include "../vm.h"
+
+// Methods get the frame as argument 1, the dispatch in the vm already checked its type.
+
+typedef enum {
+    AGGREGATE_COUNT,
+    AGGREGATE_SUM,
+    AGGREGATE_MEAN,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX,
+} Aggregate;
+
+static bool isString(Value value, const char* chars)
+{
+    return IS_STRING(value) && strcmp(AS_CSTRING(value), chars) == 0;
+}
+
+static ObjArray* findColumn(const char* name, const ObjFrame* frame, Value* args, int index)
+{
+    if (!IS_STRING(args[index])) {
+        nativeError("%s() expects a column name as argument %d.", name, index + 1);
+        return NULL;
+    }
+    Value column;
+    if (!mapGet(frame->columns, args[index], &column)) {
+        nativeError("%s() found no column '%s'.", name, AS_CSTRING(args[index]));
+        return NULL;
+    }
+    return AS_ARRAY(column);
+}
+
+// Columns are views of the arrays the frame was made from, so their numbers are contiguous.
+static ObjArray* findNumbers(const char* name, const ObjFrame* frame, Value* args, int index)
+{
+    ObjArray* column = findColumn(name, frame, args, index);
+    if (column != NULL && column->kind != ARRAY_NUMBERS) {
+        nativeError("%s() expects a column of numbers.", name);
+        return NULL;
+    }
+    return column;
+}
+
+// A new frame with the given rows of every column.
+static ObjFrame* gather(const ObjFrame* frame, const unsigned int* rows, unsigned int count)
+{
+    ObjMap* columns = newMap();
+    push(OBJ_VAL(columns));
+    mapReserve(columns, frame->columns->count);
+    for (int i = 0; i < frame->columns->entryCount; i++) {
+        const MapEntry* entry = &frame->columns->entries[i];
+        if (IS_NIL(entry->key)) {
+            continue;
+        }
+        const ObjArray* source = AS_ARRAY(entry->value);
+        ObjArray* column;
+        if (source->kind == ARRAY_NUMBERS) {
+            column = newNumberArray(count);
+            for (unsigned int row = 0; row < count; row++) {
+                column->as.numbers[row] = source->as.numbers[rows[row]];
+            }
+            push(OBJ_VAL(column));
+        } else {
+            column = newArray();
+            push(OBJ_VAL(column));
+            for (unsigned int row = 0; row < count; row++) {
+                arrayPush(column, arrayGet(source, rows[row]));
+            }
+        }
+        mapSet(columns, entry->key, OBJ_VAL(column));
+        pop();
+    }
+    ObjFrame* result = newFrame(columns, count);
+    pop();
+    return result;
+}
+
+// frame(columns) makes a frame from a map of column names to arrays of the same length. The
+// columns share the storage of the arrays, until those are changed.
+static Value frameNative(int argCount, Value* args)
+{
+    if (!checkArity("frame", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    if (!IS_MAP(args[0])) {
+        return nativeError("frame() expects a map of column names to arrays.");
+    }
+    const ObjMap* source = AS_MAP(args[0]);
+
+    ObjMap* columns = newMap();
+    push(OBJ_VAL(columns));
+    mapReserve(columns, source->count);
+    unsigned int rowCount = 0;
+    for (int i = 0; i < source->entryCount; i++) {
+        const MapEntry* entry = &source->entries[i];
+        if (IS_NIL(entry->key)) {
+            continue;
+        }
+        if (!IS_STRING(entry->key) || !IS_ARRAY(entry->value)) {
+            return nativeError("frame() expects a map of column names to arrays.");
+        }
+        ObjArray* array = AS_ARRAY(entry->value);
+        if (columns->count == 0) {
+            rowCount = array->count;
+        } else if (array->count != rowCount) {
+            return nativeError("frame() expects columns of the same length.");
+        }
+        arrayPackNumbers(array);
+        ObjArray* column = newArrayView(array, 0, array->count, 1);
+        push(OBJ_VAL(column));
+        if (column->stride != 1) {
+            arrayUnshare(column);
+        }
+        mapSet(columns, entry->key, OBJ_VAL(column));
+        pop();
+    }
+    ObjFrame* frame = newFrame(columns, rowCount);
+    pop();
+    return OBJ_VAL(frame);
+}
+
+static Value lengthMethod(int argCount, Value* args)
+{
+    if (!checkArity("length", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    return NUMBER_VAL(AS_FRAME(args[0])->rowCount);
+}
+
+static Value columnsMethod(int argCount, Value* args)
+{
+    if (!checkArity("columns", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    const ObjMap* columns = AS_FRAME(args[0])->columns;
+    ObjArray* names = newArray();
+    push(OBJ_VAL(names));
+    for (int i = 0; i < columns->entryCount; i++) {
+        if (!IS_NIL(columns->entries[i].key)) {
+            arrayPush(names, columns->entries[i].key);
+        }
+    }
+    pop();
+    return OBJ_VAL(names);
+}
+
+// A view of the column, writing to it does not change the frame.
+static Value columnMethod(int argCount, Value* args)
+{
+    if (!checkArity("column", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    ObjArray* column = findColumn("column", AS_FRAME(args[0]), args, 1);
+    if (column == NULL) {
+        return NIL_VAL;
+    }
+    return OBJ_VAL(newArrayView(column, 0, column->count, 1));
+}
+
+// A map of column names to the values in the row.
+static Value rowMethod(int argCount, Value* args)
+{
+    if (!checkArity("row", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    const ObjFrame* frame = AS_FRAME(args[0]);
+    if (!IS_NUMBER(args[1])) {
+        return nativeError("row() expects a number as argument 2.");
+    }
+    double index = AS_NUMBER(args[1]);
+    if (!(index >= 0 && index < frame->rowCount)) {
+        return nativeError("row() index out of bounds.");
+    }
+
+    ObjMap* row = newMap();
+    push(OBJ_VAL(row));
+    mapReserve(row, frame->columns->count);
+    for (int i = 0; i < frame->columns->entryCount; i++) {
+        const MapEntry* entry = &frame->columns->entries[i];
+        if (!IS_NIL(entry->key)) {
+            mapSet(row, entry->key, arrayGet(AS_ARRAY(entry->value), (unsigned int)index));
+        }
+    }
+    pop();
+    return OBJ_VAL(row);
+}
+
+static Value reduceColumn(const char* name, Aggregate aggregate, int argCount, Value* args)
+{
+    if (!checkArity(name, argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    const ObjArray* column = findNumbers(name, AS_FRAME(args[0]), args, 1);
+    if (column == NULL) {
+        return NIL_VAL;
+    }
+    if (column->count == 0) {
+        return aggregate == AGGREGATE_SUM ? NUMBER_VAL(0)
+                                          : nativeError("%s() expects a non-empty column.", name);
+    }
+    switch (aggregate) {
+    case AGGREGATE_MEAN:
+        return NUMBER_VAL(sumNumbers(column->as.numbers, column->count) / column->count);
+    case AGGREGATE_MIN:
+        return NUMBER_VAL(minNumbers(column->as.numbers, column->count));
+    case AGGREGATE_MAX:
+        return NUMBER_VAL(maxNumbers(column->as.numbers, column->count));
+    default:
+        return NUMBER_VAL(sumNumbers(column->as.numbers, column->count));
+    }
+}
+
+static Value sumMethod(int argCount, Value* args)
+{
+    return reduceColumn("sum", AGGREGATE_SUM, argCount, args);
+}
+
+static Value meanMethod(int argCount, Value* args)
+{
+    return reduceColumn("mean", AGGREGATE_MEAN, argCount, args);
+}
+
+static Value minMethod(int argCount, Value* args)
+{
+    return reduceColumn("min", AGGREGATE_MIN, argCount, args);
+}
+
+static Value maxMethod(int argCount, Value* args)
+{
+    return reduceColumn("max", AGGREGATE_MAX, argCount, args);
+}
+
+// where(column, op, value) keeps the rows, where the column compares to the value. Numbers are
+// compared with '<', '>', '==' or '!=', everything else only with '==' or '!='.
+static Value whereMethod(int argCount, Value* args)
+{
+    if (!checkArity("where", argCount, 4, 4)) {
+        return NIL_VAL;
+    }
+    const ObjFrame* frame = AS_FRAME(args[0]);
+    const ObjArray* column = findColumn("where", frame, args, 1);
+    if (column == NULL) {
+        return NIL_VAL;
+    }
+
+    NumberOp op;
+    bool negate = isString(args[2], "!=");
+    if (isString(args[2], "<")) {
+        op = NUMBER_LESS;
+    } else if (isString(args[2], ">")) {
+        op = NUMBER_GREATER;
+    } else if (negate || isString(args[2], "==")) {
+        op = NUMBER_EQUAL;
+    } else {
+        return nativeError("where() expects '<', '>', '==' or '!=' as argument 3.");
+    }
+    Value value = args[3];
+    bool numbers = column->kind == ARRAY_NUMBERS && IS_NUMBER(value);
+    if (!numbers && op != NUMBER_EQUAL) {
+        return nativeError("where() can only compare numbers with '<' or '>'.");
+    }
+
+    unsigned int* rows = ALLOCATE(unsigned int, frame->rowCount);
+    unsigned int count = 0;
+    if (numbers && frame->rowCount > 0) {
+        // the comparison runs as one vector loop, writing 1 where it holds
+        double* mask = ALLOCATE(double, frame->rowCount);
+        double operand = AS_NUMBER(value);
+        applyNumbers(op, mask, column->as.numbers, &operand, true, frame->rowCount);
+        for (unsigned int row = 0; row < frame->rowCount; row++) {
+            rows[count] = row;
+            count += (mask[row] != 0) != negate;
+        }
+        FREE_ARRAY(double, mask, frame->rowCount);
+    } else {
+        for (unsigned int row = 0; row < frame->rowCount; row++) {
+            rows[count] = row;
+            count += valuesEqual(arrayGet(column, row), value) != negate;
+        }
+    }
+
+    ObjFrame* result = gather(frame, rows, count);
+    FREE_ARRAY(unsigned int, rows, frame->rowCount);
+    return OBJ_VAL(result);
+}
+
+// groupBy(key, value, aggregate) makes a frame with one row per distinct key, in the order the keys
+// first appear. The value column of each group is reduced with 'count', 'sum', 'mean', 'min' or
+// 'max'.
+static Value groupByMethod(int argCount, Value* args)
+{
+    if (!checkArity("groupBy", argCount, 4, 4)) {
+        return NIL_VAL;
+    }
+    const ObjFrame* frame = AS_FRAME(args[0]);
+    const ObjArray* keyColumn = findColumn("groupBy", frame, args, 1);
+    if (keyColumn == NULL) {
+        return NIL_VAL;
+    }
+
+    Aggregate aggregate;
+    if (isString(args[3], "count")) {
+        aggregate = AGGREGATE_COUNT;
+    } else if (isString(args[3], "sum")) {
+        aggregate = AGGREGATE_SUM;
+    } else if (isString(args[3], "mean")) {
+        aggregate = AGGREGATE_MEAN;
+    } else if (isString(args[3], "min")) {
+        aggregate = AGGREGATE_MIN;
+    } else if (isString(args[3], "max")) {
+        aggregate = AGGREGATE_MAX;
+    } else {
+        return nativeError(
+            "groupBy() expects 'count', 'sum', 'mean', 'min' or 'max' as argument 4.");
+    }
+    const ObjArray* valueColumn = aggregate == AGGREGATE_COUNT
+        ? findColumn("groupBy", frame, args, 2)
+        : findNumbers("groupBy", frame, args, 2);
+    if (valueColumn == NULL) {
+        return NIL_VAL;
+    }
+    // the result has a column for each
+    if (valuesEqual(args[1], args[2])) {
+        return nativeError("groupBy() expects different key and value columns.");
+    }
+
+    for (unsigned int row = 0; row < frame->rowCount; row++) {
+        if (!isMapKey(arrayGet(keyColumn, row))) {
+            return nativeError("groupBy() expects keys other than nil and NaN.");
+        }
+    }
+
+    ObjMap* groups = newMap();
+    push(OBJ_VAL(groups));
+    ObjArray* keys = newArray();
+    push(OBJ_VAL(keys));
+    // there are at most as many groups as rows
+    double* results = ALLOCATE(double, frame->rowCount);
+    double* counts = ALLOCATE(double, frame->rowCount);
+    for (unsigned int row = 0; row < frame->rowCount; row++) {
+        Value key = arrayGet(keyColumn, row);
+        double number = aggregate == AGGREGATE_COUNT ? 0 : valueColumn->as.numbers[row];
+        Value group;
+        if (!mapGet(groups, key, &group)) {
+            group = NUMBER_VAL(keys->count);
+            mapSet(groups, key, group);
+            arrayPush(keys, key);
+            results[keys->count - 1] = number;
+            counts[keys->count - 1] = 1;
+            continue;
+        }
+
+        unsigned int index = (unsigned int)AS_NUMBER(group);
+        counts[index]++;
+        switch (aggregate) {
+        case AGGREGATE_MIN:
+            results[index] = number < results[index] || number != number ? number : results[index];
+            break;
+        case AGGREGATE_MAX:
+            results[index] = number > results[index] || number != number ? number : results[index];
+            break;
+        default:
+            results[index] += number;
+            break;
+        }
+    }
+
+    ObjArray* values = newNumberArray(keys->count);
+    for (unsigned int group = 0; group < keys->count; group++) {
+        if (aggregate == AGGREGATE_COUNT) {
+            values->as.numbers[group] = counts[group];
+        } else if (aggregate == AGGREGATE_MEAN) {
+            values->as.numbers[group] = results[group] / counts[group];
+        } else {
+            values->as.numbers[group] = results[group];
+        }
+    }
+    FREE_ARRAY(double, results, frame->rowCount);
+    FREE_ARRAY(double, counts, frame->rowCount);
+    push(OBJ_VAL(values));
+
+    ObjMap* columns = newMap();
+    push(OBJ_VAL(columns));
+    mapSet(columns, args[1], OBJ_VAL(keys));
+    mapSet(columns, args[2], OBJ_VAL(values));
+    ObjFrame* result = newFrame(columns, keys->count);
+    vm.stackTop -= 4;
+    return OBJ_VAL(result);
+}
+
+void defineFrameNatives()
+{
+    defineNative("frame", frameNative);
+
+    defineNativeMethod(&vm.frameMethods, "length", lengthMethod);
+    defineNativeMethod(&vm.frameMethods, "columns", columnsMethod);
+    defineNativeMethod(&vm.frameMethods, "column", columnMethod);
+    defineNativeMethod(&vm.frameMethods, "row", rowMethod);
+    defineNativeMethod(&vm.frameMethods, "sum", sumMethod);
+    defineNativeMethod(&vm.frameMethods, "mean", meanMethod);
+    defineNativeMethod(&vm.frameMethods, "min", minMethod);
+    defineNativeMethod(&vm.frameMethods, "max", maxMethod);
+    defineNativeMethod(&vm.frameMethods, "where", whereMethod);
+    defineNativeMethod(&vm.frameMethods, "groupBy", groupByMethod);
+}
@@ -0,0 +1,296 @@
+#include <string.h>
+
+#include "iteratorlib.h"
+#include "../compiler.h"
+#include "../natives.h"
+#include "../values/array.h"
+#include "../values/object.h"
+#include "../vm.h"
+
+// Elements are passed on the vm stack. next() pushes the element it produces, so it stays
+// reachable while the stages after it call back into the vm. It returns false, when the iterator
+// is used up or a callback failed. After a failure vm.hasNativeError is set and the stack is
+// already gone, so nothing may be popped.
+
+// next() recurses once per stage and zip keeps an element on the stack while it reads the other
+// side, so pipelines are limited well below the stack size.
+#define PIPELINE_DEPTH_MAX 256
+
+static bool isTruthy(Value value)
+{
+    return !IS_NIL(value) && !(IS_BOOL(value) && !AS_BOOL(value));
+}
+
+// Calls the function with the argCount values on top of the stack, which are replaced by the
+// result.
+static bool callOnStack(Value function, int argCount)
+{
+    Value* args = vm.stackTop - argCount;
+    push(NIL_VAL);
+    memmove(args + 1, args, argCount * sizeof(Value));
+    args[0] = function;
+    return callFunction(argCount);
+}
+
+static bool next(ObjIterator* iterator)
+{
+    switch (iterator->kind) {
+    case ITERATOR_RANGE:
+        if (iterator->step > 0 ? iterator->position >= iterator->end
+                               : iterator->position <= iterator->end) {
+            return false;
+        }
+        push(NUMBER_VAL(iterator->position));
+        iterator->position += iterator->step;
+        return true;
+    case ITERATOR_ARRAY: {
+        // the array may change in a callback, so its count is read every time
+        const ObjArray* array = AS_ARRAY(iterator->source);
+        if (iterator->position >= array->count) {
+            return false;
+        }
+        push(arrayGet(array, (unsigned int)iterator->position++));
+        return true;
+    }
+    case ITERATOR_STRING: {
+        const ObjString* string = AS_STRING(iterator->source);
+        if (iterator->position >= string->length) {
+            return false;
+        }
+        push(OBJ_VAL(copyString(string->chars + (int)iterator->position++, 1)));
+        return true;
+    }
+    case ITERATOR_KEYS: {
+        const ObjMap* map = AS_MAP(iterator->source);
+        while (iterator->position < map->entryCount) {
+            Value key = map->entries[(int)iterator->position++].key;
+            if (!IS_NIL(key)) {
+                push(key);
+                return true;
+            }
+        }
+        return false;
+    }
+    case ITERATOR_MAP:
+        return next(iterator->upstream) && callOnStack(iterator->source, 1);
+    case ITERATOR_FILTER:
+        while (next(iterator->upstream)) {
+            push(vm.stackTop[-1]);
+            if (!callOnStack(iterator->source, 1)) {
+                return false;
+            }
+            if (isTruthy(pop())) {
+                return true;
+            }
+            pop();
+        }
+        return false;
+    case ITERATOR_TAKE:
+        if (iterator->position >= iterator->end) {
+            return false;
+        }
+        iterator->position++;
+        return next(iterator->upstream);
+    case ITERATOR_ZIP: {
+        if (!next(iterator->upstream)) {
+            return false;
+        }
+        if (!next(iterator->other)) {
+            if (!vm.hasNativeError) {
+                pop();
+            }
+            return false;
+        }
+        if (!IS_NIL(iterator->source)) {
+            return callOnStack(iterator->source, 2);
+        }
+        ObjArray* pair = newArray();
+        push(OBJ_VAL(pair));
+        arrayPush(pair, vm.stackTop[-3]);
+        arrayPush(pair, vm.stackTop[-2]);
+        vm.stackTop -= 3;
+        push(OBJ_VAL(pair));
+        return true;
+    }
+    }
+    return false;
+}
+
+// An iterator over the elements of an array or a string, the keys of a map, or the iterator
+// itself. NULL, if the value can not be iterated.
+static ObjIterator* iterate(Value value)
+{
+    if (IS_ITERATOR(value)) {
+        return AS_ITERATOR(value);
+    }
+    if (IS_ARRAY(value)) {
+        return newIterator(ITERATOR_ARRAY, value);
+    }
+    if (IS_STRING(value)) {
+        return newIterator(ITERATOR_STRING, value);
+    }
+    if (IS_MAP(value)) {
+        return newIterator(ITERATOR_KEYS, value);
+    }
+    return NULL;
+}
+
+static Value iterNative(int argCount, Value* args)
+{
+    if (!checkArity("iter", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    ObjIterator* iterator = iterate(args[0]);
+    if (iterator == NULL) {
+        return nativeError("iter() expects an array, a string, a map or an iterator.");
+    }
+    return OBJ_VAL(iterator);
+}
+
+// range(end), range(start, end) or range(start, end, step)
+static Value rangeNative(int argCount, Value* args)
+{
+    if (!checkArity("range", argCount, 1, 3)) {
+        return NIL_VAL;
+    }
+    for (int i = 0; i < argCount; i++) {
+        if (!IS_NUMBER(args[i])) {
+            return nativeError("range() expects a number as argument %d.", i + 1);
+        }
+    }
+    double step = argCount == 3 ? AS_NUMBER(args[2]) : 1;
+    if (step == 0 || step != step) {
+        return nativeError("range() expects a step other than 0.");
+    }
+    double start = argCount == 1 ? 0 : AS_NUMBER(args[0]);
+    double end = AS_NUMBER(args[argCount == 1 ? 0 : 1]);
+    if (start != start || end != end) {
+        // nothing compares past NaN, the range would never end
+        return nativeError("range() expects a start and an end other than NaN.");
+    }
+
+    ObjIterator* range = newIterator(ITERATOR_RANGE, NIL_VAL);
+    range->position = start;
+    range->end = end;
+    range->step = step;
+    return OBJ_VAL(range);
+}
+
+// A stage reading from the iterator in args[0] and other, if it is not NULL
+static Value addStage(IteratorKind kind, Value function, Value* args, ObjIterator* other)
+{
+    ObjIterator* upstream = AS_ITERATOR(args[0]);
+    int depth = upstream->depth;
+    if (other != NULL && other->depth > depth) {
+        depth = other->depth;
+    }
+    if (depth >= PIPELINE_DEPTH_MAX) {
+        return nativeError("Iterator pipeline nested too deeply.");
+    }
+    ObjIterator* stage = newIterator(kind, function);
+    stage->upstream = upstream;
+    stage->other = other;
+    stage->depth = depth + 1;
+    return OBJ_VAL(stage);
+}
+
+static Value mapMethod(int argCount, Value* args)
+{
+    if (!checkArity("map", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    return addStage(ITERATOR_MAP, args[1], args, NULL);
+}
+
+static Value filterMethod(int argCount, Value* args)
+{
+    if (!checkArity("filter", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    return addStage(ITERATOR_FILTER, args[1], args, NULL);
+}
+
+static Value takeMethod(int argCount, Value* args)
+{
+    if (!checkArity("take", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    if (!IS_NUMBER(args[1])) {
+        return nativeError("take() expects a number as argument 2.");
+    }
+    Value take = addStage(ITERATOR_TAKE, NIL_VAL, args, NULL);
+    if (vm.hasNativeError) {
+        return take;
+    }
+    AS_ITERATOR(take)->end = AS_NUMBER(args[1]);
+    return take;
+}
+
+// zip(other, combine?) pairs the elements up in two element arrays, or passes both to combine.
+static Value zipMethod(int argCount, Value* args)
+{
+    if (!checkArity("zip", argCount, 2, 3)) {
+        return NIL_VAL;
+    }
+    ObjIterator* other = iterate(args[1]);
+    if (other == NULL) {
+        return nativeError("zip() expects an array, a string, a map or an iterator as argument 2.");
+    }
+    push(OBJ_VAL(other));
+    Value zip = addStage(ITERATOR_ZIP, argCount == 3 ? args[2] : NIL_VAL, args, other);
+    pop();
+    return zip;
+}
+
+// reduce(function, initial) runs the whole pipeline, folding its elements into one value.
+static Value reduceMethod(int argCount, Value* args)
+{
+    if (!checkArity("reduce", argCount, 3, 3)) {
+        return NIL_VAL;
+    }
+    ObjIterator* iterator = AS_ITERATOR(args[0]);
+    push(args[2]);
+    while (next(iterator)) {
+        if (!callOnStack(args[1], 2)) {
+            return NIL_VAL;
+        }
+    }
+    if (vm.hasNativeError) {
+        return NIL_VAL;
+    }
+    return pop();
+}
+
+static Value toArrayMethod(int argCount, Value* args)
+{
+    if (!checkArity("toArray", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    ObjIterator* iterator = AS_ITERATOR(args[0]);
+    ObjArray* array = newArray();
+    push(OBJ_VAL(array));
+    while (next(iterator)) {
+        arrayPush(array, vm.stackTop[-1]);
+        pop();
+    }
+    if (vm.hasNativeError) {
+        return NIL_VAL;
+    }
+    pop();
+    return OBJ_VAL(array);
+}
+
+void defineIteratorNatives()
+{
+    defineNative("iter", iterNative);
+    defineNative("range", rangeNative);
+    defineNativeMethod(&vm.arrayMethods, "iter", iterNative);
+    defineNativeMethod(&vm.stringMethods, "iter", iterNative);
+
+    defineNativeMethod(&vm.iteratorMethods, "map", mapMethod);
+    defineNativeMethod(&vm.iteratorMethods, "filter", filterMethod);
+    defineNativeMethod(&vm.iteratorMethods, "take", takeMethod);
+    defineNativeMethod(&vm.iteratorMethods, "zip", zipMethod);
+    defineNativeMethod(&vm.iteratorMethods, "reduce", reduceMethod);
+    defineNativeMethod(&vm.iteratorMethods, "toArray", toArrayMethod);
+}
@@ -0,0 +1,76 @@
+#include "maplib.h"
+#include "../compiler.h"
+#include "../natives.h"
+#include "../values/array.h"
+#include "../values/map.h"
+#include "../values/object.h"
+#include "../vm.h"
+
+static ObjMap* checkMap(const char* name, int argCount, Value* args, int count)
+{
+    if (!checkArity(name, argCount, count, count)) {
+        return NULL;
+    }
+    if (!IS_MAP(args[0])) {
+        nativeError("%s() expects a map as argument 1.", name);
+        return NULL;
+    }
+    return AS_MAP(args[0]);
+}
+
+static Value hasNative(int argCount, Value* args)
+{
+    ObjMap* map = checkMap("has", argCount, args, 2);
+    if (map == NULL) {
+        return NIL_VAL;
+    }
+    Value value;
+    return BOOL_VAL(mapGet(map, args[1], &value));
+}
+
+static Value removeNative(int argCount, Value* args)
+{
+    ObjMap* map = checkMap("remove", argCount, args, 2);
+    if (map == NULL) {
+        return NIL_VAL;
+    }
+    return BOOL_VAL(mapDelete(map, args[1]));
+}
+
+// The keys or the values of a map, in insertion order.
+static Value collect(const char* name, int argCount, Value* args, bool keys)
+{
+    ObjMap* map = checkMap(name, argCount, args, 1);
+    if (map == NULL) {
+        return NIL_VAL;
+    }
+
+    ObjArray* array = newArray();
+    push(OBJ_VAL(array));
+    for (int i = 0; i < map->entryCount; i++) {
+        MapEntry* entry = &map->entries[i];
+        if (!IS_NIL(entry->key)) {
+            arrayPush(array, keys ? entry->key : entry->value);
+        }
+    }
+    pop();
+    return OBJ_VAL(array);
+}
+
+static Value keysNative(int argCount, Value* args)
+{
+    return collect("keys", argCount, args, true);
+}
+
+static Value valuesNative(int argCount, Value* args)
+{
+    return collect("values", argCount, args, false);
+}
+
+void defineMapNatives()
+{
+    defineNative("has", hasNative);
+    defineNative("remove", removeNative);
+    defineNative("keys", keysNative);
+    defineNative("values", valuesNative);
+}
@@ -0,0 +1,207 @@
+#include "numberlib.h"
+#include "../compiler.h"
+#include "../natives.h"
+#include "../util/numberkernels.h"
+#include "../values/array.h"
+#include "../values/object.h"
+#include "../vm.h"
+
+// The numbers of an array argument, as a contiguous block. Arrays holding anything else are
+// rejected.
+static ObjArray* checkNumbers(const char* name, Value* args, int index)
+{
+    if (!IS_ARRAY(args[index]) || !arrayPackNumbers(AS_ARRAY(args[index]))) {
+        nativeError("%s() expects an array of numbers as argument %d.", name, index + 1);
+        return NULL;
+    }
+    ObjArray* array = AS_ARRAY(args[index]);
+    if (array->stride != 1) {
+        arrayUnshare(array);
+    }
+    return array;
+}
+
+static ObjArray* checkNonEmpty(const char* name, int argCount, Value* args)
+{
+    if (!checkArity(name, argCount, 1, 1)) {
+        return NULL;
+    }
+    ObjArray* array = checkNumbers(name, args, 0);
+    if (array != NULL && array->count == 0) {
+        nativeError("%s() expects a non-empty array.", name);
+        return NULL;
+    }
+    return array;
+}
+
+static bool checkSameLength(const char* name, const ObjArray* a, const ObjArray* b)
+{
+    if (a->count != b->count) {
+        nativeError("%s() expects arrays of the same length.", name);
+        return false;
+    }
+    return true;
+}
+
+static Value sumNative(int argCount, Value* args)
+{
+    if (!checkArity("sum", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    ObjArray* array = checkNumbers("sum", args, 0);
+    if (array == NULL) {
+        return NIL_VAL;
+    }
+    return NUMBER_VAL(array->count == 0 ? 0 : sumNumbers(array->as.numbers, array->count));
+}
+
+static Value meanNative(int argCount, Value* args)
+{
+    ObjArray* array = checkNonEmpty("mean", argCount, args);
+    if (array == NULL) {
+        return NIL_VAL;
+    }
+    return NUMBER_VAL(sumNumbers(array->as.numbers, array->count) / array->count);
+}
+
+static Value minNative(int argCount, Value* args)
+{
+    ObjArray* array = checkNonEmpty("min", argCount, args);
+    if (array == NULL) {
+        return NIL_VAL;
+    }
+    return NUMBER_VAL(minNumbers(array->as.numbers, array->count));
+}
+
+static Value maxNative(int argCount, Value* args)
+{
+    ObjArray* array = checkNonEmpty("max", argCount, args);
+    if (array == NULL) {
+        return NIL_VAL;
+    }
+    return NUMBER_VAL(maxNumbers(array->as.numbers, array->count));
+}
+
+static Value dotNative(int argCount, Value* args)
+{
+    if (!checkArity("dot", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    ObjArray* a = checkNumbers("dot", args, 0);
+    ObjArray* b = a == NULL ? NULL : checkNumbers("dot", args, 1);
+    if (b == NULL || !checkSameLength("dot", a, b)) {
+        return NIL_VAL;
+    }
+    return NUMBER_VAL(a->count == 0 ? 0 : dotNumbers(a->as.numbers, b->as.numbers, a->count));
+}
+
+static Value axpyNative(int argCount, Value* args)
+{
+    if (!checkArity("axpy", argCount, 3, 3)) {
+        return NIL_VAL;
+    }
+    if (!IS_NUMBER(args[0])) {
+        return nativeError("axpy() expects a number as argument 1.");
+    }
+    ObjArray* x = checkNumbers("axpy", args, 1);
+    ObjArray* y = x == NULL ? NULL : checkNumbers("axpy", args, 2);
+    if (y == NULL || !checkSameLength("axpy", x, y)) {
+        return NIL_VAL;
+    }
+
+    ObjArray* result = newNumberArray(x->count);
+    if (x->count > 0) {
+        axpyNumbers(result->as.numbers, AS_NUMBER(args[0]), x->as.numbers, y->as.numbers, x->count);
+    }
+    return OBJ_VAL(result);
+}
+
+// The second operand is either an array of the same length or a single number.
+static Value apply(const char* name, NumberOp op, int argCount, Value* args)
+{
+    if (!checkArity(name, argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    ObjArray* a = checkNumbers(name, args, 0);
+    if (a == NULL) {
+        return NIL_VAL;
+    }
+
+    double scalar = 0;
+    const double* b = &scalar;
+    bool broadcast = IS_NUMBER(args[1]);
+    if (broadcast) {
+        scalar = AS_NUMBER(args[1]);
+    } else {
+        ObjArray* other = checkNumbers(name, args, 1);
+        if (other == NULL || !checkSameLength(name, a, other)) {
+            return NIL_VAL;
+        }
+        b = other->as.numbers;
+    }
+
+    ObjArray* result = newNumberArray(a->count);
+    if (a->count > 0) {
+        applyNumbers(op, result->as.numbers, a->as.numbers, b, broadcast, a->count);
+    }
+    return OBJ_VAL(result);
+}
+
+static Value addNative(int argCount, Value* args)
+{
+    return apply("add", NUMBER_ADD, argCount, args);
+}
+
+static Value subtractNative(int argCount, Value* args)
+{
+    return apply("subtract", NUMBER_SUBTRACT, argCount, args);
+}
+
+static Value multiplyNative(int argCount, Value* args)
+{
+    return apply("multiply", NUMBER_MULTIPLY, argCount, args);
+}
+
+static Value divideNative(int argCount, Value* args)
+{
+    return apply("divide", NUMBER_DIVIDE, argCount, args);
+}
+
+static Value lessNative(int argCount, Value* args)
+{
+    return apply("less", NUMBER_LESS, argCount, args);
+}
+
+static Value greaterNative(int argCount, Value* args)
+{
+    return apply("greater", NUMBER_GREATER, argCount, args);
+}
+
+static Value equalNative(int argCount, Value* args)
+{
+    return apply("equal", NUMBER_EQUAL, argCount, args);
+}
+
+void defineNumberNatives()
+{
+    initNumberKernels();
+
+    defineNative("sum", sumNative);
+    defineNative("mean", meanNative);
+    defineNative("min", minNative);
+    defineNative("max", maxNative);
+    defineNative("dot", dotNative);
+    defineNative("axpy", axpyNative);
+    defineNative("add", addNative);
+    defineNative("subtract", subtractNative);
+    defineNative("multiply", multiplyNative);
+    defineNative("divide", divideNative);
+    defineNative("less", lessNative);
+    defineNative("greater", greaterNative);
+    defineNative("equal", equalNative);
+
+    defineNativeMethod(&vm.arrayMethods, "sum", sumNative);
+    defineNativeMethod(&vm.arrayMethods, "mean", meanNative);
+    defineNativeMethod(&vm.arrayMethods, "min", minNative);
+    defineNativeMethod(&vm.arrayMethods, "max", maxNative);
+}
@@ -0,0 +1,304 @@
+#include <string.h>
+
+#include "stringlib.h"
+#include "../compiler.h"
+#include "../natives.h"
+#include "../util/memory.h"
+#include "../util/stringkernels.h"
+#include "../values/array.h"
+#include "../values/object.h"
+#include "../vm.h"
+
+static bool checkString(const char* name, Value* args, int index)
+{
+    if (!IS_STRING(args[index])) {
+        nativeError("%s() expects a string as argument %d.", name, index + 1);
+        return false;
+    }
+    return true;
+}
+
+static bool checkStrings(const char* name, int argCount, Value* args, int count)
+{
+    if (!checkArity(name, argCount, count, count)) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!checkString(name, args, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static Value lengthNative(int argCount, Value* args)
+{
+    if (!checkArity("length", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    if (IS_STRING(args[0])) {
+        return NUMBER_VAL(AS_STRING(args[0])->length);
+    }
+    if (IS_ARRAY(args[0])) {
+        return NUMBER_VAL(AS_ARRAY(args[0])->count);
+    }
+    if (IS_MAP(args[0])) {
+        return NUMBER_VAL(AS_MAP(args[0])->count);
+    }
+    if (IS_STRUCT_ARRAY(args[0])) {
+        return NUMBER_VAL(AS_STRUCT_ARRAY(args[0])->count);
+    }
+    return nativeError("length() expects a string, an array or a map.");
+}
+
+static Value indexOfNative(int argCount, Value* args)
+{
+    if (!checkArity("indexOf", argCount, 2, 3) || !checkString("indexOf", args, 0)
+        || !checkString("indexOf", args, 1)) {
+        return NIL_VAL;
+    }
+    ObjString* string = AS_STRING(args[0]);
+    ObjString* needle = AS_STRING(args[1]);
+
+    int from = 0;
+    if (argCount == 3) {
+        if (!IS_NUMBER(args[2])) {
+            return nativeError("indexOf() expects a number as argument 3.");
+        }
+        double start = AS_NUMBER(args[2]);
+        if (start > string->length) {
+            return NUMBER_VAL(-1);
+        }
+        // a negative or NaN start searches from the beginning
+        from = start > 0 ? (int)start : 0;
+    }
+
+    int found = findSubstring(
+        string->chars + from, string->length - from, needle->chars, needle->length);
+    return NUMBER_VAL(found == -1 ? -1 : found + from);
+}
+
+static Value countNative(int argCount, Value* args)
+{
+    if (!checkStrings("count", argCount, args, 2)) {
+        return NIL_VAL;
+    }
+    ObjString* string = AS_STRING(args[0]);
+    ObjString* needle = AS_STRING(args[1]);
+    if (needle->length == 0) {
+        return nativeError("count() can not count empty strings.");
+    }
+
+    return NUMBER_VAL(countSubstring(string->chars, string->length, needle->chars, needle->length));
+}
+
+static Value startsWithNative(int argCount, Value* args)
+{
+    if (!checkStrings("startsWith", argCount, args, 2)) {
+        return NIL_VAL;
+    }
+    ObjString* string = AS_STRING(args[0]);
+    ObjString* prefix = AS_STRING(args[1]);
+
+    return BOOL_VAL(prefix->length <= string->length
+        && memcmp(string->chars, prefix->chars, prefix->length) == 0);
+}
+
+static Value trimNative(int argCount, Value* args)
+{
+    if (!checkStrings("trim", argCount, args, 1)) {
+        return NIL_VAL;
+    }
+    ObjString* string = AS_STRING(args[0]);
+
+    int start = 0;
+    int end = string->length;
+    while (start < end && strchr(" \t\r\n", string->chars[start]) != NULL) {
+        start++;
+    }
+    while (end > start && strchr(" \t\r\n", string->chars[end - 1]) != NULL) {
+        end--;
+    }
+
+    if (start == 0 && end == string->length) {
+        return args[0];
+    }
+    return OBJ_VAL(copyString(string->chars + start, end - start));
+}
+
+static Value changeCase(Value* args, void (*kernel)(char*, const char*, int))
+{
+    ObjString* string = AS_STRING(args[0]);
+
+    char* chars = ALLOCATE(char, string->length + 1);
+    kernel(chars, string->chars, string->length);
+    chars[string->length] = '\0';
+
+    return OBJ_VAL(takeString(chars, string->length));
+}
+
+static Value toUpperNative(int argCount, Value* args)
+{
+    if (!checkStrings("toUpper", argCount, args, 1)) {
+        return NIL_VAL;
+    }
+    return changeCase(args, asciiToUpper);
+}
+
+static Value toLowerNative(int argCount, Value* args)
+{
+    if (!checkStrings("toLower", argCount, args, 1)) {
+        return NIL_VAL;
+    }
+    return changeCase(args, asciiToLower);
+}
+
+static Value splitNative(int argCount, Value* args)
+{
+    if (!checkStrings("split", argCount, args, 2)) {
+        return NIL_VAL;
+    }
+    ObjString* string = AS_STRING(args[0]);
+    ObjString* separator = AS_STRING(args[1]);
+
+    ObjArray* array = newArray();
+    push(OBJ_VAL(array));
+
+    if (separator->length == 0) {
+        for (int i = 0; i < string->length; i++) {
+            ObjString* piece = copyString(string->chars + i, 1);
+            push(OBJ_VAL(piece));
+            arrayPush(array, OBJ_VAL(piece));
+            pop();
+        }
+        pop();
+        return OBJ_VAL(array);
+    }
+
+    int offset = 0;
+    for (;;) {
+        int found = findSubstring(string->chars + offset, string->length - offset,
+            separator->chars, separator->length);
+        int pieceLength = found == -1 ? string->length - offset : found;
+
+        ObjString* piece = copyString(string->chars + offset, pieceLength);
+        push(OBJ_VAL(piece));
+        arrayPush(array, OBJ_VAL(piece));
+        pop();
+
+        if (found == -1) {
+            break;
+        }
+        offset += found + separator->length;
+    }
+
+    pop();
+    return OBJ_VAL(array);
+}
+
+static Value replaceNative(int argCount, Value* args)
+{
+    if (!checkStrings("replace", argCount, args, 3)) {
+        return NIL_VAL;
+    }
+    ObjString* string = AS_STRING(args[0]);
+    ObjString* search = AS_STRING(args[1]);
+    ObjString* replacement = AS_STRING(args[2]);
+    if (search->length == 0) {
+        return nativeError("replace() can not replace empty strings.");
+    }
+
+    int matches = countSubstring(string->chars, string->length, search->chars, search->length);
+    if (matches == 0) {
+        return args[0];
+    }
+
+    int length = string->length + matches * (replacement->length - search->length);
+    char* chars = ALLOCATE(char, length + 1);
+
+    char* dest = chars;
+    int offset = 0;
+    for (int i = 0; i < matches; i++) {
+        int found = findSubstring(
+            string->chars + offset, string->length - offset, search->chars, search->length);
+        memcpy(dest, string->chars + offset, found);
+        dest += found;
+        memcpy(dest, replacement->chars, replacement->length);
+        dest += replacement->length;
+        offset += found + search->length;
+    }
+    memcpy(dest, string->chars + offset, string->length - offset);
+    chars[length] = '\0';
+
+    return OBJ_VAL(takeString(chars, length));
+}
+
+static Value joinNative(int argCount, Value* args)
+{
+    if (!checkArity("join", argCount, 2, 2)) {
+        return NIL_VAL;
+    }
+    if (!IS_ARRAY(args[0])) {
+        return nativeError("join() expects an array as argument 1.");
+    }
+    if (!checkString("join", args, 1)) {
+        return NIL_VAL;
+    }
+    const ObjArray* parts = AS_ARRAY(args[0]);
+    ObjString* separator = AS_STRING(args[1]);
+
+    int length = 0;
+    for (unsigned int i = 0; i < parts->count; i++) {
+        if (!IS_STRING(arrayGet(parts, i))) {
+            return nativeError("join() expects an array of strings.");
+        }
+        length += AS_STRING(arrayGet(parts, i))->length;
+    }
+    if (parts->count > 1) {
+        length += (parts->count - 1) * separator->length;
+    }
+
+    char* chars = ALLOCATE(char, length + 1);
+
+    char* dest = chars;
+    for (unsigned int i = 0; i < parts->count; i++) {
+        if (i > 0) {
+            memcpy(dest, separator->chars, separator->length);
+            dest += separator->length;
+        }
+        const ObjString* part = AS_STRING(arrayGet(parts, i));
+        memcpy(dest, part->chars, part->length);
+        dest += part->length;
+    }
+    chars[length] = '\0';
+
+    return OBJ_VAL(takeString(chars, length));
+}
+
+void defineStringNatives()
+{
+    initStringKernels();
+
+    defineNative("length", lengthNative);
+    defineNative("indexOf", indexOfNative);
+    defineNative("count", countNative);
+    defineNative("startsWith", startsWithNative);
+    defineNative("trim", trimNative);
+    defineNative("toUpper", toUpperNative);
+    defineNative("toLower", toLowerNative);
+    defineNative("split", splitNative);
+    defineNative("replace", replaceNative);
+    defineNative("join", joinNative);
+
+    defineNativeMethod(&vm.stringMethods, "length", lengthNative);
+    defineNativeMethod(&vm.stringMethods, "indexOf", indexOfNative);
+    defineNativeMethod(&vm.stringMethods, "count", countNative);
+    defineNativeMethod(&vm.stringMethods, "startsWith", startsWithNative);
+    defineNativeMethod(&vm.stringMethods, "trim", trimNative);
+    defineNativeMethod(&vm.stringMethods, "toUpper", toUpperNative);
+    defineNativeMethod(&vm.stringMethods, "toLower", toLowerNative);
+    defineNativeMethod(&vm.stringMethods, "split", splitNative);
+    defineNativeMethod(&vm.stringMethods, "replace", replaceNative);
+    defineNativeMethod(&vm.arrayMethods, "length", lengthNative);
+    defineNativeMethod(&vm.arrayMethods, "join", joinNative);
+}
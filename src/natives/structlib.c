@@ -0,0 +1,22 @@
+#include "structlib.h"
+#include "../compiler.h"
+#include "../natives.h"
+#include "../values/object.h"
+#include "../vm.h"
+
+// arrayOf(type) makes an empty array, that stores structs of the type inline.
+static Value arrayOfNative(int argCount, Value* args)
+{
+    if (!checkArity("arrayOf", argCount, 1, 1)) {
+        return NIL_VAL;
+    }
+    if (!IS_STRUCT_TYPE(args[0])) {
+        return nativeError("arrayOf() expects a struct type as argument 1.");
+    }
+    return OBJ_VAL(newStructArray(AS_STRUCT_TYPE(args[0])));
+}
+
+void defineStructNatives()
+{
+    defineNative("arrayOf", arrayOfNative);
+}
@@ -0,0 +1,1643 @@
+#include <string.h>
+
+#include "optimizer.h"
+#include "vm.h"
+#include "chunk/chunk.h"
+#include "util/memory.h"
+
+#define NO_TEMP -1
+#define UNKNOWN_DEPTH -1
+// the cleanup passes enable each other, but only a few rounds ever find something new
+#define CLEANUP_ROUNDS_MAX 8
+// functions with more instructions are not inlined
+#define INLINE_INSTRUCTIONS_MAX 12
+
+typedef struct {
+    uint8_t op;
+    // constant, slot, selector or global address, argument count of calls and literals, or the
+    // index of the instruction a jump goes to
+    uint32_t operand;
+    uint8_t argCount; // of invokes and inline checks
+    uint32_t constant; // the function an inline check expects, or an inlined instruction is from
+    uint32_t selector; // of OP_CHECK_INVOKE
+    uint8_t forLoop[4]; // the counter, step and operators of OP_FOR_LOOP
+    BytecodeIndex offset; // in the original code, closures copy their upvalues from there
+    Linenumber line;
+    Linenumber callLine; // of the call an inlined instruction replaces
+    bool isInlined;
+    bool removed;
+    bool isTemp; // the operand of a local access is a temp, not a slot
+    int storeTemp; // the result is also stored in this temp
+} Instruction;
+
+// Loads moved in front of the loop starting at header, run again on every entry of the loop.
+typedef struct {
+    int header;
+    int end; // the last instruction of the loop
+    Instruction load[2]; // a global, or a local and one of its properties
+    int loadCount;
+    int temp;
+} Hoist;
+
+typedef struct {
+    int start;
+    int end;
+} Region;
+
+typedef struct {
+    ObjFunction* function;
+    Instruction* code;
+    int count;
+    int capacity;
+    bool* isTarget;
+    int* depth; // stack height before each instruction, counted from the frame's first slot
+
+    Hoist* hoists;
+    int hoistCount;
+    int hoistCapacity;
+
+    int tempBase; // the temps are the slots right after the parameters
+    int tempCount;
+    int tempMax;
+} Program;
+
+typedef enum {
+    FORMAT_SIMPLE,
+    FORMAT_BYTE,
+    FORMAT_LONG,
+    FORMAT_JUMP,
+    FORMAT_INVOKE,
+    FORMAT_INVOKE_LONG,
+    FORMAT_CLOSURE,
+    FORMAT_CHECK_CALL,
+    FORMAT_CHECK_INVOKE,
+    FORMAT_FOR_LOOP,
+    FORMAT_UNKNOWN,
+} Format;
+
+static Format formatOf(uint8_t op)
+{
+    switch (op) {
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_POP:
+    case OP_GET_INDEX:
+    case OP_SET_INDEX:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_GREATER:
+    case OP_GREATER_EQUAL:
+    case OP_LESS:
+    case OP_LESS_EQUAL:
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_NOT:
+    case OP_NEGATE:
+    case OP_PRINT:
+    case OP_CLOSE_UPVALUE:
+    case OP_RETURN:
+    case OP_INHERIT:
+    case OP_ARRAY_ADD:
+    case OP_ADD_NUMBER:
+    case OP_SUBTRACT_NUMBER:
+    case OP_MULTIPLY_NUMBER:
+    case OP_DIVIDE_NUMBER:
+    case OP_NEGATE_NUMBER:
+    case OP_GREATER_NUMBER:
+    case OP_GREATER_EQUAL_NUMBER:
+    case OP_LESS_NUMBER:
+    case OP_LESS_EQUAL_NUMBER:
+        return FORMAT_SIMPLE;
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_GET_OUTER_LOCAL:
+    case OP_SET_OUTER_LOCAL:
+    case OP_GET_OUTER_UPVALUE:
+    case OP_SET_OUTER_UPVALUE:
+    case OP_GET_CAPTURED:
+    case OP_GET_OUTER_CAPTURED:
+    case OP_GET_PROPERTY:
+    case OP_GET_INDEX_PROPERTY:
+    case OP_SET_PROPERTY:
+    case OP_GET_SUPER:
+    case OP_CALL:
+    case OP_CLASS:
+    case OP_METHOD:
+    case OP_ARRAY_INIT:
+    case OP_MAP_INIT:
+    case OP_CONCAT_N:
+    case OP_ADD_STRINGS:
+    case OP_INLINE_RETURN:
+        return FORMAT_BYTE;
+    case OP_CONSTANT_LONG:
+    case OP_GET_LOCAL_LONG:
+    case OP_SET_LOCAL_LONG:
+    case OP_GET_GLOBAL_LONG:
+    case OP_DEFINE_GLOBAL_LONG:
+    case OP_SET_GLOBAL_LONG:
+    case OP_GET_PROPERTY_LONG:
+    case OP_SET_PROPERTY_LONG:
+    case OP_GET_SUPER_LONG:
+    case OP_CLASS_LONG:
+    case OP_METHOD_LONG:
+        return FORMAT_LONG;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+        return FORMAT_JUMP;
+    case OP_INVOKE:
+    case OP_SUPER_INVOKE:
+        return FORMAT_INVOKE;
+    case OP_INVOKE_LONG:
+    case OP_SUPER_INVOKE_LONG:
+        return FORMAT_INVOKE_LONG;
+    case OP_CLOSURE:
+        return FORMAT_CLOSURE;
+    case OP_CHECK_CALL:
+        return FORMAT_CHECK_CALL;
+    case OP_CHECK_INVOKE:
+        return FORMAT_CHECK_INVOKE;
+    case OP_FOR_LOOP:
+        return FORMAT_FOR_LOOP;
+    default:
+        // OP_CLOSURE_LONG, functions with that many constants are left as they are
+        return FORMAT_UNKNOWN;
+    }
+}
+
+static bool isJump(uint8_t op)
+{
+    return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_LOOP || op == OP_CHECK_CALL
+        || op == OP_CHECK_INVOKE || op == OP_FOR_LOOP;
+}
+
+// Instructions after which the next one is not run.
+static bool endsFlow(uint8_t op)
+{
+    return op == OP_JUMP || op == OP_LOOP || op == OP_RETURN;
+}
+
+// Instructions that may run script code, which can change any global or field.
+static bool mayCall(uint8_t op)
+{
+    return op == OP_CALL || op == OP_INVOKE || op == OP_INVOKE_LONG || op == OP_SUPER_INVOKE
+        || op == OP_SUPER_INVOKE_LONG;
+}
+
+static bool isLocalAccess(uint8_t op)
+{
+    return op == OP_GET_LOCAL || op == OP_GET_LOCAL_LONG || op == OP_SET_LOCAL
+        || op == OP_SET_LOCAL_LONG;
+}
+
+// The number of variables a closure captures, each takes two bytes after OP_CLOSURE.
+static int captureCount(const Program* program, uint32_t constant)
+{
+    const ObjFunction* function
+        = AS_FUNCTION(program->function->chunk.constants.values[constant]);
+    return function->upvalueCount + function->capturedCount;
+}
+
+// How many values the instruction pops and pushes. False for instructions without a fixed effect.
+static bool stackEffect(const Instruction* instruction, int* pops, int* pushes)
+{
+    *pops = 0;
+    *pushes = 1;
+    switch (instruction->op) {
+    case OP_CONSTANT:
+    case OP_CONSTANT_LONG:
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_GET_LOCAL:
+    case OP_GET_LOCAL_LONG:
+    case OP_GET_GLOBAL:
+    case OP_GET_GLOBAL_LONG:
+    case OP_GET_UPVALUE:
+    case OP_GET_OUTER_LOCAL:
+    case OP_GET_OUTER_UPVALUE:
+    case OP_GET_CAPTURED:
+    case OP_GET_OUTER_CAPTURED:
+    case OP_CLOSURE:
+    case OP_CLASS:
+    case OP_CLASS_LONG:
+        return true;
+    case OP_POP:
+    case OP_DEFINE_GLOBAL:
+    case OP_DEFINE_GLOBAL_LONG:
+    case OP_PRINT:
+    case OP_CLOSE_UPVALUE:
+    case OP_RETURN:
+    case OP_METHOD:
+    case OP_METHOD_LONG:
+        *pops = 1;
+        *pushes = 0;
+        return true;
+    case OP_SET_LOCAL:
+    case OP_SET_LOCAL_LONG:
+    case OP_SET_GLOBAL:
+    case OP_SET_GLOBAL_LONG:
+    case OP_SET_UPVALUE:
+    case OP_SET_OUTER_LOCAL:
+    case OP_SET_OUTER_UPVALUE:
+    case OP_GET_PROPERTY:
+    case OP_GET_PROPERTY_LONG:
+    case OP_NOT:
+    case OP_NEGATE:
+    case OP_NEGATE_NUMBER:
+    case OP_JUMP_IF_FALSE:
+        *pops = 1;
+        return true;
+    case OP_FOR_LOOP:
+        *pops = 1;
+        *pushes = 0;
+        return true;
+    case OP_GET_INDEX:
+    case OP_GET_INDEX_PROPERTY:
+    case OP_SET_PROPERTY:
+    case OP_SET_PROPERTY_LONG:
+    case OP_GET_SUPER:
+    case OP_GET_SUPER_LONG:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_GREATER:
+    case OP_GREATER_EQUAL:
+    case OP_LESS:
+    case OP_LESS_EQUAL:
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_ADD_NUMBER:
+    case OP_SUBTRACT_NUMBER:
+    case OP_MULTIPLY_NUMBER:
+    case OP_DIVIDE_NUMBER:
+    case OP_GREATER_NUMBER:
+    case OP_GREATER_EQUAL_NUMBER:
+    case OP_LESS_NUMBER:
+    case OP_LESS_EQUAL_NUMBER:
+    case OP_INHERIT:
+    case OP_ARRAY_ADD:
+        *pops = 2;
+        return true;
+    case OP_SET_INDEX:
+        *pops = 3;
+        return true;
+    case OP_JUMP:
+    case OP_LOOP:
+    case OP_CHECK_CALL:
+    case OP_CHECK_INVOKE:
+        *pushes = 0;
+        return true;
+    case OP_INLINE_RETURN:
+        *pops = (int)instruction->operand + 1;
+        return true;
+    case OP_CALL:
+        *pops = (int)instruction->operand + 1;
+        return true;
+    case OP_INVOKE:
+    case OP_INVOKE_LONG:
+        *pops = instruction->argCount + 1;
+        return true;
+    case OP_SUPER_INVOKE:
+    case OP_SUPER_INVOKE_LONG:
+        *pops = instruction->argCount + 2;
+        return true;
+    case OP_ARRAY_INIT:
+    case OP_CONCAT_N:
+    case OP_ADD_STRINGS:
+        *pops = (int)instruction->operand;
+        return true;
+    case OP_MAP_INIT:
+        *pops = 2 * (int)instruction->operand;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool decode(Program* program)
+{
+    const Chunk* chunk = &program->function->chunk;
+    const uint8_t* code = chunk->code;
+    const SourceInfo* info = &chunk->sourceinfo;
+
+    // at most one instruction per byte
+    program->capacity = chunk->count;
+    program->code = ALLOCATE(Instruction, program->capacity);
+    int* indexAt = ALLOCATE(int, chunk->count + 1);
+    for (BytecodeIndex i = 0; i <= chunk->count; i++) {
+        indexAt[i] = -1;
+    }
+
+    uint32_t run = 0;
+    BytecodeIndex runEnd = info->count > 0 ? info->linenumberCounter[0] : 0;
+    bool valid = true;
+    BytecodeIndex offset = 0;
+    while (offset < chunk->count) {
+        while (offset >= runEnd && run + 1 < info->count) {
+            run++;
+            runEnd += info->linenumberCounter[run];
+        }
+        Instruction* instruction = &program->code[program->count];
+        *instruction = (Instruction) {
+            .op = code[offset],
+            .offset = offset,
+            .line = info->count > 0 ? info->linenumbers[run] : 0,
+            .storeTemp = NO_TEMP,
+        };
+        indexAt[offset] = program->count++;
+
+        BytecodeIndex size = 1;
+        switch (formatOf(instruction->op)) {
+        case FORMAT_SIMPLE:
+            break;
+        case FORMAT_BYTE:
+            instruction->operand = code[offset + 1];
+            size = 2;
+            break;
+        case FORMAT_LONG:
+            instruction->operand
+                = (code[offset + 1] << 16) | (code[offset + 2] << 8) | code[offset + 3];
+            size = 4;
+            break;
+        case FORMAT_JUMP: {
+            // the byte offset of the target for now
+            uint16_t jump = (uint16_t)((code[offset + 1] << 8) | code[offset + 2]);
+            instruction->operand
+                = instruction->op == OP_LOOP ? offset + 3 - jump : offset + 3 + jump;
+            size = 3;
+            break;
+        }
+        case FORMAT_INVOKE:
+            instruction->operand = code[offset + 1];
+            instruction->argCount = code[offset + 2];
+            size = 3;
+            break;
+        case FORMAT_INVOKE_LONG:
+            instruction->operand
+                = (code[offset + 1] << 16) | (code[offset + 2] << 8) | code[offset + 3];
+            instruction->argCount = code[offset + 4];
+            size = 5;
+            break;
+        case FORMAT_CLOSURE:
+            instruction->operand = code[offset + 1];
+            size = 2 + 2 * captureCount(program, instruction->operand);
+            break;
+        case FORMAT_CHECK_CALL:
+        case FORMAT_CHECK_INVOKE: {
+            size = formatOf(instruction->op) == FORMAT_CHECK_CALL ? 5 : 6;
+            const uint8_t* operands = &code[offset + size - 4];
+            instruction->selector = code[offset + 1];
+            instruction->argCount = operands[0];
+            instruction->constant = operands[1];
+            instruction->operand = offset + size + (uint16_t)((operands[2] << 8) | operands[3]);
+            break;
+        }
+        case FORMAT_FOR_LOOP:
+            memcpy(instruction->forLoop, &code[offset + 1], 4);
+            instruction->operand
+                = offset + 7 - (uint16_t)((code[offset + 5] << 8) | code[offset + 6]);
+            size = 7;
+            break;
+        case FORMAT_UNKNOWN:
+            valid = false;
+            break;
+        }
+        if (!valid) {
+            break;
+        }
+        offset += size;
+    }
+
+    for (int i = 0; valid && i < program->count; i++) {
+        Instruction* instruction = &program->code[i];
+        if (isJump(instruction->op)) {
+            if (instruction->operand >= chunk->count || indexAt[instruction->operand] < 0) {
+                valid = false;
+            } else {
+                instruction->operand = indexAt[instruction->operand];
+            }
+        }
+    }
+    FREE_ARRAY(int, indexAt, chunk->count + 1);
+    return valid;
+}
+
+static void findTargets(Program* program)
+{
+    memset(program->isTarget, 0, program->count * sizeof(bool));
+    for (int i = 0; i < program->count; i++) {
+        const Instruction* instruction = &program->code[i];
+        if (!instruction->removed && isJump(instruction->op)) {
+            program->isTarget[instruction->operand] = true;
+        }
+    }
+}
+
+// Drops the removed instructions. Jumps to them go to the next instruction left instead.
+static void compact(Program* program)
+{
+    int* newIndex = ALLOCATE(int, program->count + 1);
+    int live = 0;
+    for (int i = 0; i < program->count; i++) {
+        newIndex[i] = live;
+        if (!program->code[i].removed) {
+            live++;
+        }
+    }
+    newIndex[program->count] = live;
+
+    for (int i = 0; i < program->count; i++) {
+        Instruction instruction = program->code[i];
+        if (instruction.removed) {
+            continue;
+        }
+        if (isJump(instruction.op)) {
+            instruction.operand = newIndex[instruction.operand];
+        }
+        program->code[newIndex[i]] = instruction;
+    }
+    for (int i = 0; i < program->hoistCount; i++) {
+        program->hoists[i].header = newIndex[program->hoists[i].header];
+        program->hoists[i].end = newIndex[program->hoists[i].end];
+    }
+    FREE_ARRAY(int, newIndex, program->count + 1);
+    program->count = live;
+}
+
+static int nextLive(const Program* program, int index)
+{
+    do {
+        index++;
+    } while (index < program->count && program->code[index].removed);
+    return index;
+}
+
+// Jumps to an OP_JUMP go to its target right away, jumps to the next instruction are dropped.
+static bool threadJumps(Program* program)
+{
+    bool changed = false;
+    for (int i = 0; i < program->count; i++) {
+        Instruction* instruction = &program->code[i];
+        if (instruction->op != OP_JUMP && instruction->op != OP_JUMP_IF_FALSE) {
+            continue;
+        }
+        uint32_t target = instruction->operand;
+        for (int hops = 0; program->code[target].op == OP_JUMP && (int)target != i
+             && hops < program->count;
+             hops++) {
+            target = program->code[target].operand;
+        }
+        if (target != instruction->operand) {
+            instruction->operand = target;
+            changed = true;
+        }
+        // OP_JUMP_IF_FALSE leaves the condition on the stack, so it can go as well
+        if ((int)instruction->operand == nextLive(program, i)) {
+            instruction->removed = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool removeUnreachable(Program* program)
+{
+    bool* reached = ALLOCATE(bool, program->count);
+    int* pending = ALLOCATE(int, program->count);
+    memset(reached, 0, program->count * sizeof(bool));
+    int pendingCount = 0;
+    pending[pendingCount++] = 0;
+    reached[0] = true;
+
+    while (pendingCount > 0) {
+        int i = pending[--pendingCount];
+        const Instruction* instruction = &program->code[i];
+        int successors[2];
+        int successorCount = 0;
+        if (isJump(instruction->op)) {
+            successors[successorCount++] = (int)instruction->operand;
+        }
+        if (!endsFlow(instruction->op) && i + 1 < program->count) {
+            successors[successorCount++] = i + 1;
+        }
+        for (int j = 0; j < successorCount; j++) {
+            if (!reached[successors[j]]) {
+                reached[successors[j]] = true;
+                pending[pendingCount++] = successors[j];
+            }
+        }
+    }
+
+    bool changed = false;
+    for (int i = 0; i < program->count; i++) {
+        if (!reached[i]) {
+            program->code[i].removed = true;
+            changed = true;
+        }
+    }
+    FREE_ARRAY(bool, reached, program->count);
+    FREE_ARRAY(int, pending, program->count);
+    return changed;
+}
+
+static bool isPurePush(uint8_t op)
+{
+    switch (op) {
+    case OP_CONSTANT:
+    case OP_CONSTANT_LONG:
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_GET_LOCAL:
+    case OP_GET_LOCAL_LONG:
+    case OP_GET_UPVALUE:
+    case OP_GET_OUTER_LOCAL:
+    case OP_GET_OUTER_UPVALUE:
+    case OP_GET_CAPTURED:
+    case OP_GET_OUTER_CAPTURED:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The load reading back what the store wrote, OP_UNDEFINED for other instructions.
+static uint8_t reloadOf(uint8_t op)
+{
+    switch (op) {
+    case OP_SET_LOCAL:
+        return OP_GET_LOCAL;
+    case OP_SET_LOCAL_LONG:
+        return OP_GET_LOCAL_LONG;
+    case OP_SET_GLOBAL:
+        return OP_GET_GLOBAL;
+    case OP_SET_GLOBAL_LONG:
+        return OP_GET_GLOBAL_LONG;
+    case OP_SET_UPVALUE:
+        return OP_GET_UPVALUE;
+    case OP_SET_OUTER_LOCAL:
+        return OP_GET_OUTER_LOCAL;
+    case OP_SET_OUTER_UPVALUE:
+        return OP_GET_OUTER_UPVALUE;
+    default:
+        return OP_UNDEFINED;
+    }
+}
+
+// Drops values that are popped right after being pushed, and the pop and reload in a store
+// followed by a load of the same variable, as the store leaves the value on the stack anyway.
+static bool removeDeadPushes(Program* program)
+{
+    findTargets(program);
+    bool changed = false;
+    Instruction* code = program->code;
+    for (int i = 0; i + 1 < program->count; i++) {
+        if (code[i + 1].op != OP_POP || program->isTarget[i + 1]) {
+            continue;
+        }
+        if (isPurePush(code[i].op)) {
+            code[i].removed = true;
+            code[i + 1].removed = true;
+            changed = true;
+            i++;
+        } else if (i + 2 < program->count && reloadOf(code[i].op) != OP_UNDEFINED
+            && code[i + 2].op == reloadOf(code[i].op) && code[i + 2].operand == code[i].operand
+            && !program->isTarget[i + 2]) {
+            code[i + 1].removed = true;
+            code[i + 2].removed = true;
+            changed = true;
+            i += 2;
+        }
+    }
+    return changed;
+}
+
+static void cleanup(Program* program)
+{
+    for (int round = 0; round < CLEANUP_ROUNDS_MAX; round++) {
+        bool changed = threadJumps(program);
+        compact(program);
+        changed |= removeUnreachable(program);
+        compact(program);
+        changed |= removeDeadPushes(program);
+        compact(program);
+        if (!changed) {
+            return;
+        }
+    }
+}
+
+// Follows every path through the function. False, if two paths meet with different stack
+// heights, which the compiler never emits.
+static bool findDepths(Program* program)
+{
+    int* depth = program->depth;
+    for (int i = 0; i < program->count; i++) {
+        depth[i] = UNKNOWN_DEPTH;
+    }
+    int* pending = ALLOCATE(int, program->count);
+    int pendingCount = 0;
+    depth[0] = program->tempBase;
+    pending[pendingCount++] = 0;
+
+    bool valid = true;
+    while (valid && pendingCount > 0) {
+        int i = pending[--pendingCount];
+        const Instruction* instruction = &program->code[i];
+        int pops, pushes;
+        if (!stackEffect(instruction, &pops, &pushes) || depth[i] < pops) {
+            valid = false;
+            break;
+        }
+        int after = depth[i] - pops + pushes;
+
+        int successors[2];
+        int successorCount = 0;
+        if (isJump(instruction->op)) {
+            successors[successorCount++] = (int)instruction->operand;
+        }
+        if (!endsFlow(instruction->op) && i + 1 < program->count) {
+            successors[successorCount++] = i + 1;
+        }
+        for (int j = 0; j < successorCount; j++) {
+            int successor = successors[j];
+            if (depth[successor] == UNKNOWN_DEPTH) {
+                depth[successor] = after;
+                pending[pendingCount++] = successor;
+            } else if (depth[successor] != after) {
+                valid = false;
+            }
+        }
+    }
+    FREE_ARRAY(int, pending, program->count);
+    return valid;
+}
+
+// The instruction using the value that the instruction at index pushes, -1 if it is used outside
+// of the block.
+static int findUse(const Program* program, int index)
+{
+    int above = 0;
+    for (int i = index + 1; i < program->count; i++) {
+        const Instruction* instruction = &program->code[i];
+        if (instruction->removed) {
+            continue;
+        }
+        int pops, pushes;
+        if (program->isTarget[i] || !stackEffect(instruction, &pops, &pushes)) {
+            return -1;
+        }
+        if (pops > above) {
+            return i;
+        }
+        above += pushes - pops;
+        if (isJump(instruction->op) || instruction->op == OP_RETURN) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// Reading a method creates a new bound method every time, whose identity can be seen by
+// comparing or storing it. These uses can't tell a shared result from a fresh one.
+static bool ignoresIdentity(uint8_t op)
+{
+    switch (op) {
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_GREATER:
+    case OP_GREATER_EQUAL:
+    case OP_LESS:
+    case OP_LESS_EQUAL:
+    case OP_NEGATE:
+    case OP_NOT:
+    case OP_PRINT:
+    case OP_FOR_LOOP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool isPropertyLoad(const Program* program, int index)
+{
+    const Instruction* local = &program->code[index];
+    if (index + 1 >= program->count || local->removed || local->isTemp
+        || (local->op != OP_GET_LOCAL && local->op != OP_GET_LOCAL_LONG)) {
+        return false;
+    }
+    const Instruction* property = &program->code[index + 1];
+    if (property->removed || program->isTarget[index + 1]
+        || (property->op != OP_GET_PROPERTY && property->op != OP_GET_PROPERTY_LONG)) {
+        return false;
+    }
+    int use = findUse(program, index + 1);
+    return use >= 0 && ignoresIdentity(program->code[use].op);
+}
+
+static bool sameInstruction(const Instruction* a, const Instruction* b)
+{
+    return a->op == b->op && a->operand == b->operand && a->isTemp == b->isTemp;
+}
+
+static int allocateTemp(Program* program)
+{
+    if (program->tempCount >= program->tempMax) {
+        return NO_TEMP;
+    }
+    return program->tempCount++;
+}
+
+static void makeTempLoad(Instruction* instruction, int temp)
+{
+    instruction->op = OP_GET_LOCAL;
+    instruction->operand = (uint32_t)temp;
+    instruction->isTemp = true;
+}
+
+static bool writesGlobal(const Instruction* instruction, const Instruction* load)
+{
+    bool isLong = load->op == OP_GET_GLOBAL_LONG;
+    uint8_t op = instruction->op;
+    return instruction->operand == load->operand
+        && (op == (isLong ? OP_SET_GLOBAL_LONG : OP_SET_GLOBAL)
+            || op == (isLong ? OP_DEFINE_GLOBAL_LONG : OP_DEFINE_GLOBAL));
+}
+
+static bool writesLocal(const Instruction* instruction, const Instruction* load)
+{
+    uint8_t op = instruction->op;
+    if (op == OP_FOR_LOOP) {
+        return instruction->forLoop[0] == load->operand;
+    }
+    return !instruction->isTemp && instruction->operand == load->operand
+        && (op == (load->op == OP_GET_LOCAL_LONG ? OP_SET_LOCAL_LONG : OP_SET_LOCAL));
+}
+
+static bool writesProperty(const Instruction* instruction, const Instruction* load)
+{
+    uint8_t op = instruction->op;
+    return op == OP_SET_INDEX
+        || (instruction->operand == load->operand
+            && op == (load->op == OP_GET_PROPERTY_LONG ? OP_SET_PROPERTY_LONG : OP_SET_PROPERTY));
+}
+
+// Whether no instruction in the region can change what the loads read. The loads are a global, or
+// a local and one of its properties.
+static bool isInvariant(const Program* program, Region region, const Instruction* load,
+    int loadCount)
+{
+    for (int i = region.start; i <= region.end; i++) {
+        const Instruction* instruction = &program->code[i];
+        if (instruction->removed) {
+            continue;
+        }
+        if (loadCount == 1 && writesGlobal(instruction, &load[0])) {
+            return false;
+        }
+        if (loadCount == 2) {
+            // the local has to be the same variable all through the loop
+            if (writesLocal(instruction, &load[0]) || writesProperty(instruction, &load[1])
+                || program->depth[i] <= (int)load[0].operand) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void addHoist(Program* program, Region region, const Instruction* load, int loadCount,
+    int temp)
+{
+    if (program->hoistCount + 1 > program->hoistCapacity) {
+        int oldCapacity = program->hoistCapacity;
+        program->hoistCapacity = GROW_CAPACITY(oldCapacity);
+        program->hoists
+            = GROW_ARRAY(Hoist, program->hoists, oldCapacity, program->hoistCapacity);
+    }
+    Hoist* hoist = &program->hoists[program->hoistCount++];
+    hoist->header = region.start;
+    hoist->end = region.end;
+    hoist->loadCount = loadCount;
+    hoist->temp = temp;
+    for (int i = 0; i < loadCount; i++) {
+        hoist->load[i] = load[i];
+        hoist->load[i].storeTemp = NO_TEMP;
+    }
+}
+
+// Moves the loads in front of the loop and reads the temp instead, wherever the loop loads the
+// same value.
+static void hoist(Program* program, Region region, int index, int loadCount)
+{
+    int temp = allocateTemp(program);
+    if (temp == NO_TEMP) {
+        return;
+    }
+    Instruction load[2];
+    memcpy(load, &program->code[index], loadCount * sizeof(Instruction));
+    addHoist(program, region, load, loadCount, temp);
+
+    for (int i = region.start; i <= region.end; i++) {
+        Instruction* instruction = &program->code[i];
+        if (instruction->removed || !sameInstruction(instruction, &load[0])) {
+            continue;
+        }
+        if (loadCount == 1) {
+            makeTempLoad(instruction, temp);
+        } else if (isPropertyLoad(program, i)
+            && sameInstruction(&program->code[i + 1], &load[1])) {
+            instruction->removed = true;
+            makeTempLoad(&program->code[i + 1], temp);
+        }
+    }
+}
+
+// A loop can only be entered through its first instruction and may not run any script code.
+static bool isSimpleLoop(const Program* program, Region region)
+{
+    for (int i = 0; i < program->count; i++) {
+        const Instruction* instruction = &program->code[i];
+        bool inside = i >= region.start && i <= region.end;
+        if (inside && mayCall(instruction->op)) {
+            return false;
+        }
+        if (!inside && isJump(instruction->op) && (int)instruction->operand > region.start
+            && (int)instruction->operand <= region.end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Only the loads at the start of the loop are hoisted, before anything that could fail or has an
+// effect. They run on every entry of the loop, so moving them in front of it neither adds nor
+// reorders errors.
+static void hoistLoop(Program* program, Region region)
+{
+    if (!isSimpleLoop(program, region)) {
+        return;
+    }
+    for (int i = region.start; i <= region.end; i++) {
+        Instruction* instruction = &program->code[i];
+        if (instruction->removed) {
+            continue;
+        }
+        if (i > region.start && program->isTarget[i]) {
+            return;
+        }
+        if (isPropertyLoad(program, i) && isInvariant(program, region, instruction, 2)) {
+            hoist(program, region, i, 2);
+            i++;
+        } else if ((instruction->op == OP_GET_GLOBAL || instruction->op == OP_GET_GLOBAL_LONG)
+            && isInvariant(program, region, instruction, 1)) {
+            hoist(program, region, i, 1);
+        } else if (!isPurePush(instruction->op)) {
+            return;
+        }
+    }
+}
+
+static void hoistLoops(Program* program)
+{
+    Region* regions = ALLOCATE(Region, program->count);
+    int regionCount = 0;
+    for (int i = 0; i < program->count; i++) {
+        if (program->code[i].op == OP_LOOP || program->code[i].op == OP_FOR_LOOP) {
+            regions[regionCount++] = (Region) { (int)program->code[i].operand, i };
+        }
+    }
+
+    // loops sharing instructions, like the condition and the increment of a for loop, are one
+    for (bool merged = true; merged;) {
+        merged = false;
+        for (int a = 0; a < regionCount && !merged; a++) {
+            for (int b = 0; b < regionCount && !merged; b++) {
+                Region* first = &regions[a];
+                const Region* second = &regions[b];
+                if (a != b && first->start <= second->start && second->start <= first->end
+                    && (first->end < second->end || first->start == second->start)) {
+                    first->end = first->end > second->end ? first->end : second->end;
+                    regions[b] = regions[--regionCount];
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    // outer loops first, they take the loads of the loops inside with them
+    for (int i = 1; i < regionCount; i++) {
+        Region region = regions[i];
+        int j = i;
+        for (; j > 0 && regions[j - 1].start > region.start; j--) {
+            regions[j] = regions[j - 1];
+        }
+        regions[j] = region;
+    }
+    for (int i = 0; i < regionCount; i++) {
+        hoistLoop(program, regions[i]);
+    }
+    FREE_ARRAY(Region, regions, program->count);
+}
+
+typedef struct {
+    int index; // of the local load
+    int temp;
+} Available;
+
+// Shares property loads within a block, as long as nothing in between can change them.
+static void shareLoads(Program* program)
+{
+    Available* available = ALLOCATE(Available, program->count);
+    int availableCount = 0;
+
+    for (int i = 0; i < program->count; i++) {
+        Instruction* instruction = &program->code[i];
+        if (instruction->removed) {
+            continue;
+        }
+        if (program->isTarget[i]) {
+            availableCount = 0;
+        }
+
+        if (isPropertyLoad(program, i)) {
+            Instruction* property = &program->code[i + 1];
+            int found = -1;
+            for (int j = 0; j < availableCount; j++) {
+                const Instruction* other = &program->code[available[j].index];
+                if (sameInstruction(other, instruction) && sameInstruction(other + 1, property)) {
+                    found = j;
+                    break;
+                }
+            }
+            if (found < 0) {
+                available[availableCount++] = (Available) { i, NO_TEMP };
+            } else {
+                Available* load = &available[found];
+                if (load->temp == NO_TEMP) {
+                    load->temp = allocateTemp(program);
+                    program->code[load->index + 1].storeTemp = load->temp;
+                }
+                if (load->temp != NO_TEMP) {
+                    instruction->removed = true;
+                    makeTempLoad(property, load->temp);
+                }
+            }
+            i++;
+            continue;
+        }
+
+        int pops, pushes;
+        stackEffect(instruction, &pops, &pushes);
+        int depth = program->depth[i] - pops;
+        for (int j = 0; j < availableCount; j++) {
+            const Instruction* local = &program->code[available[j].index];
+            if (mayCall(instruction->op) || writesLocal(instruction, local)
+                || writesProperty(instruction, local + 1) || (int)local->operand >= depth) {
+                available[j--] = available[--availableCount];
+            }
+        }
+        if (endsFlow(instruction->op) || instruction->op == OP_JUMP_IF_FALSE
+            || instruction->op == OP_FOR_LOOP) {
+            availableCount = 0;
+        }
+    }
+    FREE_ARRAY(Available, available, program->count);
+}
+
+static uint32_t shiftSlot(const Program* program, uint32_t slot)
+{
+    return slot >= (uint32_t)program->tempBase ? slot + program->tempCount : slot;
+}
+
+static uint32_t localOperand(const Program* program, const Instruction* instruction)
+{
+    if (instruction->isTemp) {
+        return program->tempBase + instruction->operand;
+    }
+    return shiftSlot(program, instruction->operand);
+}
+
+// The largest slot accessed with a one byte operand, temps have to fit below 256 with them.
+static int largestShortSlot(const Program* program)
+{
+    int largest = program->tempBase - 1;
+    const uint8_t* code = program->function->chunk.code;
+    for (int i = 0; i < program->count; i++) {
+        const Instruction* instruction = &program->code[i];
+        if (instruction->op == OP_GET_LOCAL || instruction->op == OP_SET_LOCAL) {
+            largest = (int)instruction->operand > largest ? (int)instruction->operand : largest;
+        } else if (instruction->op == OP_FOR_LOOP) {
+            largest = instruction->forLoop[0] > largest ? instruction->forLoop[0] : largest;
+        } else if (instruction->op == OP_CLOSURE) {
+            int captures = captureCount(program, instruction->operand);
+            for (int j = 0; j < captures; j++) {
+                const uint8_t* capture = &code[instruction->offset + 2 + 2 * j];
+                if (capture[0] && capture[1] > largest) {
+                    largest = capture[1];
+                }
+            }
+        }
+    }
+    return largest;
+}
+
+static int encodedSize(const Program* program, const Instruction* instruction)
+{
+    int size = 1;
+    switch (formatOf(instruction->op)) {
+    case FORMAT_SIMPLE:
+    case FORMAT_UNKNOWN:
+        break;
+    case FORMAT_BYTE:
+        size = 2;
+        break;
+    case FORMAT_LONG:
+        size = 4;
+        break;
+    case FORMAT_JUMP:
+    case FORMAT_INVOKE:
+        size = 3;
+        break;
+    case FORMAT_INVOKE_LONG:
+        size = 5;
+        break;
+    case FORMAT_CLOSURE:
+        size = 2 + 2 * captureCount(program, instruction->operand);
+        break;
+    case FORMAT_CHECK_CALL:
+        size = 5;
+        break;
+    case FORMAT_CHECK_INVOKE:
+        size = 6;
+        break;
+    case FORMAT_FOR_LOOP:
+        size = 7;
+        break;
+    }
+    return instruction->storeTemp != NO_TEMP ? size + 2 : size;
+}
+
+static int hoistSize(const Program* program, const Hoist* hoist)
+{
+    int size = 3; // OP_SET_LOCAL and OP_POP
+    for (int i = 0; i < hoist->loadCount; i++) {
+        size += encodedSize(program, &hoist->load[i]);
+    }
+    return size;
+}
+
+typedef struct {
+    uint8_t* code;
+    int count;
+    SourceInfo sourceinfo;
+} Output;
+
+static void writeByte(Output* output, uint8_t byte, Linenumber line)
+{
+    output->code[output->count++] = byte;
+    addLinenumer(&output->sourceinfo, line);
+}
+
+static void writeOperand(Output* output, const Instruction* instruction, uint32_t operand)
+{
+    if (formatOf(instruction->op) == FORMAT_LONG
+        || formatOf(instruction->op) == FORMAT_INVOKE_LONG) {
+        writeByte(output, (operand >> 16) & 0xFF, instruction->line);
+        writeByte(output, (operand >> 8) & 0xFF, instruction->line);
+    }
+    writeByte(output, operand & 0xFF, instruction->line);
+}
+
+// Writes everything but jumps, whose offsets are only known later.
+static void writeInstruction(const Program* program, Output* output,
+    const Instruction* instruction)
+{
+    Linenumber line = instruction->line;
+    writeByte(output, instruction->op, line);
+    switch (formatOf(instruction->op)) {
+    case FORMAT_SIMPLE:
+    case FORMAT_UNKNOWN:
+        break;
+    case FORMAT_BYTE:
+    case FORMAT_LONG:
+        writeOperand(output, instruction,
+            isLocalAccess(instruction->op) ? localOperand(program, instruction)
+                                           : instruction->operand);
+        break;
+    case FORMAT_JUMP:
+        writeByte(output, 0xFF, line);
+        writeByte(output, 0xFF, line);
+        break;
+    case FORMAT_INVOKE:
+    case FORMAT_INVOKE_LONG:
+        writeOperand(output, instruction, instruction->operand);
+        writeByte(output, instruction->argCount, line);
+        break;
+    case FORMAT_CLOSURE: {
+        writeByte(output, (uint8_t)instruction->operand, line);
+        const uint8_t* capture = &program->function->chunk.code[instruction->offset + 2];
+        int captures = captureCount(program, instruction->operand);
+        for (int i = 0; i < captures; i++, capture += 2) {
+            writeByte(output, capture[0], line);
+            writeByte(output, capture[0] ? (uint8_t)shiftSlot(program, capture[1]) : capture[1],
+                line);
+        }
+        break;
+    }
+    case FORMAT_CHECK_INVOKE:
+        writeByte(output, (uint8_t)instruction->selector, line);
+        // fall through
+    case FORMAT_CHECK_CALL:
+        writeByte(output, instruction->argCount, line);
+        writeByte(output, (uint8_t)instruction->constant, line);
+        writeByte(output, 0xFF, line);
+        writeByte(output, 0xFF, line);
+        break;
+    case FORMAT_FOR_LOOP:
+        writeByte(output, (uint8_t)shiftSlot(program, instruction->forLoop[0]), line);
+        for (int i = 1; i < 4; i++) {
+            writeByte(output, instruction->forLoop[i], line);
+        }
+        writeByte(output, 0xFF, line);
+        writeByte(output, 0xFF, line);
+        break;
+    }
+    if (instruction->storeTemp != NO_TEMP) {
+        writeByte(output, OP_SET_LOCAL, line);
+        writeByte(output, (uint8_t)(program->tempBase + instruction->storeTemp), line);
+    }
+}
+
+static bool hasHoists(const Program* program, int header)
+{
+    for (int i = 0; i < program->hoistCount; i++) {
+        if (program->hoists[i].header == header) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Encodes the instructions into the chunk again. False, if a jump got too long.
+static bool encode(Program* program)
+{
+    // where each instruction, and the hoisted loads in front of it, start
+    int* offsets = ALLOCATE(int, program->count + 1);
+    int* hoistOffsets = ALLOCATE(int, program->count + 1);
+    int size = program->tempCount;
+    for (int i = 0; i <= program->count; i++) {
+        hoistOffsets[i] = size;
+        for (int j = 0; j < program->hoistCount; j++) {
+            if (program->hoists[j].header == i) {
+                size += hoistSize(program, &program->hoists[j]);
+            }
+        }
+        offsets[i] = size;
+        if (i < program->count) {
+            size += encodedSize(program, &program->code[i]);
+        }
+    }
+
+    Output output = { ALLOCATE(uint8_t, size), 0, { 0 } };
+    initSourceInfo(&output.sourceinfo);
+    for (int i = 0; i < program->tempCount; i++) {
+        writeByte(&output, OP_NIL, program->code[0].line);
+    }
+
+    bool valid = true;
+    for (int i = 0; i < program->count; i++) {
+        for (int j = 0; j < program->hoistCount; j++) {
+            const Hoist* hoist = &program->hoists[j];
+            if (hoist->header != i) {
+                continue;
+            }
+            for (int k = 0; k < hoist->loadCount; k++) {
+                writeInstruction(program, &output, &hoist->load[k]);
+            }
+            Linenumber line = hoist->load[hoist->loadCount - 1].line;
+            writeByte(&output, OP_SET_LOCAL, line);
+            writeByte(&output, (uint8_t)(program->tempBase + hoist->temp), line);
+            writeByte(&output, OP_POP, line);
+        }
+
+        const Instruction* instruction = &program->code[i];
+        writeInstruction(program, &output, instruction);
+        if (instruction->isInlined) {
+            addInlinedCode(&output.sourceinfo, offsets[i], output.count, instruction->constant,
+                instruction->callLine);
+        }
+        if (!isJump(instruction->op)) {
+            continue;
+        }
+
+        // jumps from outside of a loop enter it through the hoisted loads
+        int target = (int)instruction->operand;
+        int destination = offsets[target];
+        bool isBackward = instruction->op == OP_LOOP || instruction->op == OP_FOR_LOOP;
+        if (hasHoists(program, target) && !isBackward) {
+            for (int j = 0; j < program->hoistCount; j++) {
+                const Hoist* hoist = &program->hoists[j];
+                if (hoist->header == target && (i < hoist->header || i > hoist->end)) {
+                    destination = hoistOffsets[target];
+                }
+            }
+        }
+        int end = offsets[i] + encodedSize(program, instruction);
+        int jump = isBackward ? end - destination : destination - end;
+        if (jump < 0 || jump > UINT16_MAX) {
+            valid = false;
+            break;
+        }
+        output.code[output.count - 2] = (jump >> 8) & 0xFF;
+        output.code[output.count - 1] = jump & 0xFF;
+    }
+
+    Chunk* chunk = &program->function->chunk;
+    if (valid) {
+        FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+        freeSourceInfo(&chunk->sourceinfo);
+        chunk->code = output.code;
+        chunk->count = output.count;
+        chunk->capacity = size;
+        chunk->sourceinfo = output.sourceinfo;
+    } else {
+        FREE_ARRAY(uint8_t, output.code, size);
+        freeSourceInfo(&output.sourceinfo);
+    }
+    FREE_ARRAY(int, offsets, program->count + 1);
+    FREE_ARRAY(int, hoistOffsets, program->count + 1);
+    return valid;
+}
+
+static bool loadProgram(Program* program, ObjFunction* function)
+{
+    *program = (Program) {
+        .function = function,
+        .tempBase = function->arity + 1,
+    };
+    bool valid = function->chunk.count > 0 && decode(program);
+    program->isTarget = ALLOCATE(bool, program->capacity);
+    program->depth = ALLOCATE(int, program->capacity);
+    return valid;
+}
+
+static void freeProgram(Program* program)
+{
+    FREE_ARRAY(Instruction, program->code, program->capacity);
+    FREE_ARRAY(bool, program->isTarget, program->capacity);
+    FREE_ARRAY(int, program->depth, program->capacity);
+    FREE_ARRAY(Hoist, program->hoists, program->hoistCapacity);
+}
+
+// Instructions an inlined body may contain. Calls are left out, which also keeps recursive
+// functions from being inlined into themselves, and so is everything that needs a frame of its
+// own, like upvalues.
+static bool canInline(uint8_t op)
+{
+    switch (op) {
+    case OP_CALL:
+    case OP_INVOKE:
+    case OP_INVOKE_LONG:
+    case OP_SUPER_INVOKE:
+    case OP_SUPER_INVOKE_LONG:
+    case OP_CLOSURE:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_GET_OUTER_LOCAL:
+    case OP_SET_OUTER_LOCAL:
+    case OP_GET_OUTER_UPVALUE:
+    case OP_SET_OUTER_UPVALUE:
+    case OP_GET_CAPTURED:
+    case OP_GET_OUTER_CAPTURED:
+    case OP_CLOSE_UPVALUE:
+    case OP_CLASS:
+    case OP_CLASS_LONG:
+    case OP_METHOD:
+    case OP_METHOD_LONG:
+    case OP_INHERIT:
+    case OP_DEFINE_GLOBAL:
+    case OP_DEFINE_GLOBAL_LONG:
+    case OP_GET_SUPER:
+    case OP_GET_SUPER_LONG:
+    case OP_LOOP:
+    case OP_FOR_LOOP:
+    case OP_CHECK_CALL:
+    case OP_CHECK_INVOKE:
+    case OP_INLINE_RETURN:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Decodes a function to be inlined. False, if it is too large or does something inlined code
+// can't do.
+static bool loadInlinee(Program* program, ObjFunction* function)
+{
+    if (!loadProgram(program, function) || function->upvalueCount > 0
+        || function->capturedCount > 0 || program->count > INLINE_INSTRUCTIONS_MAX) {
+        return false;
+    }
+    for (int i = 0; i < program->count; i++) {
+        if (!canInline(program->code[i].op)) {
+            return false;
+        }
+    }
+    findTargets(program);
+    return findDepths(program);
+}
+
+static bool isInlinable(ObjFunction* function)
+{
+    Program program;
+    bool inlinable = loadInlinee(&program, function);
+    freeProgram(&program);
+    return inlinable;
+}
+
+static void setCandidate(ValueArray* candidates, uint32_t index, Value candidate)
+{
+    while (candidates->count <= index) {
+        writeValueArray(candidates, NIL_VAL);
+    }
+    candidates->values[index] = candidate;
+}
+
+void offerInlineFunction(uint32_t global, ObjFunction* function)
+{
+    setCandidate(&vm.inlineFunctions, global, isInlinable(function) ? OBJ_VAL(function) : NIL_VAL);
+}
+
+void offerInlineMethod(uint32_t selector, ObjFunction* function)
+{
+    // when classes share a method name, a call site can't tell which of them it will run
+    bool isFirst
+        = selector >= vm.inlineMethods.count || IS_NIL(vm.inlineMethods.values[selector]);
+    bool inlinable = isFirst && isInlinable(function);
+    setCandidate(&vm.inlineMethods, selector, inlinable ? OBJ_VAL(function) : BOOL_VAL(false));
+}
+
+// The function an inlined call would run, NULL if the call is not inlined.
+static ObjFunction* findInlinee(const Program* program, int index)
+{
+    const Instruction* call = &program->code[index];
+    const ValueArray* candidates = &vm.inlineMethods;
+    uint32_t key = call->operand;
+    int argCount = call->argCount;
+
+    if (call->op == OP_CALL) {
+        // the callee has to be a global, loaded in the same block
+        argCount = (int)call->operand;
+        int calleeDepth = program->depth[index] - argCount - 1;
+        int producer = index - 1;
+        while (producer >= 0 && !program->isTarget[producer + 1]
+            && program->depth[producer] != calleeDepth) {
+            producer--;
+        }
+        if (producer < 0 || program->isTarget[producer + 1]
+            || (program->code[producer].op != OP_GET_GLOBAL
+                && program->code[producer].op != OP_GET_GLOBAL_LONG)
+            || findUse(program, producer) != index) {
+            return NULL;
+        }
+        candidates = &vm.inlineFunctions;
+        key = program->code[producer].operand;
+    } else if (call->op != OP_INVOKE) {
+        return NULL;
+    }
+
+    if (key >= candidates->count || !IS_FUNCTION(candidates->values[key])) {
+        return NULL;
+    }
+    ObjFunction* function = AS_FUNCTION(candidates->values[key]);
+    return function->arity == argCount && function != program->function ? function : NULL;
+}
+
+// Numbers are compared by their bits, so 0 and -0 stay apart.
+static bool sameConstant(Value a, Value b)
+{
+    if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        double x = AS_NUMBER(a);
+        double y = AS_NUMBER(b);
+        return memcmp(&x, &y, sizeof(double)) == 0;
+    }
+    return valuesEqual(a, b);
+}
+
+// The address of the value in the constant pool, UINT32_MAX if it does not fit below max.
+static uint32_t poolAddress(Program* program, Value value, uint32_t max)
+{
+    ValueArray* constants = &program->function->chunk.constants;
+    for (uint32_t i = 0; i < constants->count; i++) {
+        if (sameConstant(constants->values[i], value)) {
+            return i;
+        }
+    }
+    if ((uint32_t)constants->count > max) {
+        return UINT32_MAX;
+    }
+    return addConstant(&program->function->chunk, value);
+}
+
+typedef struct {
+    Instruction* code;
+    int count;
+    int capacity;
+    bool* isResolved; // jumps whose target already is an index into the new code
+} Builder;
+
+static int append(Builder* builder, Instruction instruction, bool isResolved)
+{
+    if (builder->count + 1 > builder->capacity) {
+        int oldCapacity = builder->capacity;
+        builder->capacity = GROW_CAPACITY(oldCapacity);
+        builder->code = GROW_ARRAY(Instruction, builder->code, oldCapacity, builder->capacity);
+        builder->isResolved
+            = GROW_ARRAY(bool, builder->isResolved, oldCapacity, builder->capacity);
+    }
+    builder->code[builder->count] = instruction;
+    builder->isResolved[builder->count] = isResolved;
+    return builder->count++;
+}
+
+static void setLocalOperand(Instruction* instruction, uint32_t slot)
+{
+    bool isGet = instruction->op == OP_GET_LOCAL || instruction->op == OP_GET_LOCAL_LONG;
+    if (slot > UINT8_MAX) {
+        instruction->op = isGet ? OP_GET_LOCAL_LONG : OP_SET_LOCAL_LONG;
+    } else {
+        instruction->op = isGet ? OP_GET_LOCAL : OP_SET_LOCAL;
+    }
+    instruction->operand = slot;
+}
+
+// Copies the body of the function in front of the call, behind a check that the call really runs
+// it. The call stays as the way back when the check fails. The body finds its parameters and
+// locals where the call would have put its frame.
+static bool inlineCall(Program* program, Builder* builder, int index, ObjFunction* function)
+{
+    const Instruction* call = &program->code[index];
+    uint32_t constant = poolAddress(program, OBJ_VAL(function), UINT8_MAX);
+    if (constant == UINT32_MAX || (call->op == OP_INVOKE && call->operand > UINT8_MAX)) {
+        return false;
+    }
+    Program inlinee;
+    if (!loadInlinee(&inlinee, function)) {
+        freeProgram(&inlinee);
+        return false;
+    }
+
+    int argCount = call->op == OP_CALL ? (int)call->operand : call->argCount;
+    uint32_t base = (uint32_t)(program->depth[index] - argCount - 1);
+    Instruction check = {
+        .op = call->op == OP_CALL ? OP_CHECK_CALL : OP_CHECK_INVOKE,
+        .argCount = (uint8_t)argCount,
+        .constant = constant,
+        .selector = call->operand,
+        .line = call->line,
+        .storeTemp = NO_TEMP,
+    };
+    int checkIndex = append(builder, check, true);
+
+    // returns take two instructions
+    int* newIndex = ALLOCATE(int, inlinee.count);
+    int next = builder->count;
+    for (int i = 0; i < inlinee.count; i++) {
+        newIndex[i] = next;
+        next += inlinee.code[i].op == OP_RETURN ? 2 : 1;
+    }
+
+    int returnCount = 0;
+    int* returnJumps = ALLOCATE(int, inlinee.count);
+    const ValueArray* constants = &function->chunk.constants;
+    for (int i = 0; i < inlinee.count; i++) {
+        Instruction instruction = inlinee.code[i];
+        instruction.isInlined = true;
+        instruction.constant = constant;
+        instruction.callLine = call->line;
+        if (isLocalAccess(instruction.op)) {
+            setLocalOperand(&instruction, base + instruction.operand);
+        } else if (instruction.op == OP_CONSTANT || instruction.op == OP_CONSTANT_LONG) {
+            instruction.operand
+                = poolAddress(program, constants->values[instruction.operand], UINT32_MAX);
+            instruction.op = instruction.operand > UINT8_MAX ? OP_CONSTANT_LONG : OP_CONSTANT;
+        } else if (isJump(instruction.op)) {
+            instruction.operand = newIndex[instruction.operand];
+        } else if (instruction.op == OP_RETURN) {
+            instruction.op = OP_INLINE_RETURN;
+            instruction.operand = inlinee.depth[i] - 1;
+            append(builder, instruction, false);
+            instruction.op = OP_JUMP;
+            returnJumps[returnCount++] = builder->count;
+        }
+        append(builder, instruction, true);
+    }
+
+    int slowPath = append(builder, *call, false);
+    builder->code[checkIndex].operand = slowPath;
+    for (int i = 0; i < returnCount; i++) {
+        builder->code[returnJumps[i]].operand = slowPath + 1;
+    }
+    FREE_ARRAY(int, newIndex, inlinee.count);
+    FREE_ARRAY(int, returnJumps, inlinee.count);
+    freeProgram(&inlinee);
+    return true;
+}
+
+// Inlines the calls to small functions and methods. False, when there were none.
+static bool inlineCalls(Program* program)
+{
+    Builder builder = { NULL, 0, 0, NULL };
+    int* newIndex = ALLOCATE(int, program->count);
+    bool changed = false;
+    for (int i = 0; i < program->count; i++) {
+        newIndex[i] = builder.count;
+        ObjFunction* function = findInlinee(program, i);
+        if (function != NULL && inlineCall(program, &builder, i, function)) {
+            changed = true;
+        } else {
+            append(&builder, program->code[i], false);
+        }
+    }
+
+    if (changed) {
+        for (int i = 0; i < builder.count; i++) {
+            if (isJump(builder.code[i].op) && !builder.isResolved[i]) {
+                builder.code[i].operand = newIndex[builder.code[i].operand];
+            }
+        }
+        FREE_ARRAY(Instruction, program->code, program->capacity);
+        FREE_ARRAY(bool, program->isTarget, program->capacity);
+        FREE_ARRAY(int, program->depth, program->capacity);
+        program->code = builder.code;
+        program->count = builder.count;
+        program->capacity = builder.capacity;
+        program->isTarget = ALLOCATE(bool, program->capacity);
+        program->depth = ALLOCATE(int, program->capacity);
+    } else {
+        FREE_ARRAY(Instruction, builder.code, builder.capacity);
+    }
+    FREE_ARRAY(bool, builder.isResolved, builder.capacity);
+    FREE_ARRAY(int, newIndex, program->count);
+    return changed;
+}
+
+// Direct functions read the slots of the function declaring them, so temps can't move these.
+// Their closures are the only ones in a constant pool.
+static bool hasDirectFunctions(const ObjFunction* function)
+{
+    const ValueArray* constants = &function->chunk.constants;
+    for (unsigned int i = 0; i < constants->count; i++) {
+        if (IS_CLOSURE(constants->values[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void optimizeFunction(ObjFunction* function)
+{
+    Program program;
+    if (!loadProgram(&program, function)) {
+        freeProgram(&program);
+        return;
+    }
+
+    cleanup(&program);
+    findTargets(&program);
+    bool valid = findDepths(&program);
+    if (valid && inlineCalls(&program)) {
+        cleanup(&program);
+        findTargets(&program);
+        valid = findDepths(&program);
+    }
+    if (valid) {
+        int largest = largestShortSlot(&program);
+        int belowLargest = UINT8_MAX - largest;
+        int belowBase = UINT8_COUNT - program.tempBase;
+        program.tempMax = belowLargest < belowBase ? belowLargest : belowBase;
+        if (hasDirectFunctions(function)) {
+            program.tempMax = 0;
+        }
+
+        hoistLoops(&program);
+        shareLoads(&program);
+        compact(&program);
+    }
+    encode(&program);
+    freeProgram(&program);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "values/object.h"
+
+// Rewrites the bytecode of a freshly compiled function, when pit runs with -O. The code is
+// decoded into a list of instructions, optimized there and encoded again.
+//
+// - jumps to jumps are threaded, jumps to the next instruction dropped
+// - unreachable code, and values that are pushed only to be popped again, are dropped
+// - a store followed by a reload of the same variable keeps the value on the stack instead
+// - calls of small functions and methods, whose callee is known from earlier declarations, are
+//   inlined behind a check that falls back to the real call
+// - global and property loads in a loop condition are hoisted out of the loop, when nothing in
+//   the loop can change them, and property loads repeated within a block are shared
+//
+// Hoisted and shared values live in extra local slots right after the parameters.
+void optimizeFunction(ObjFunction* function);
+
+// Offer a function declared at the top level, and a method, to be inlined into the functions
+// compiled after them.
+void offerInlineFunction(uint32_t global, ObjFunction* function);
+void offerInlineMethod(uint32_t selector, ObjFunction* function);
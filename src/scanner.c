@@ -4,27 +4,22 @@
 #include "common.h"
 #include "scanner.h"
 
-typedef struct {
-    const char* start;
-    const char* current;
-    int line;
-} Scanner;
-
 Scanner scanner;
 
-void initScanner(const char* source)
+void initScanner(const char* source, int line)
 {
     scanner.start = source;
     scanner.current = source;
-    scanner.line = 1;
+    scanner.line = line;
+    scanner.interpolations = 0;
 
 #ifdef DEBUG_PRINT_TOKENS
-    int line = -1;
+    int tokenLine = -1;
     for (;;) {
         Token token = scanToken();
-        if (token.line != line) {
+        if (token.line != tokenLine) {
             printf("%4d ", token.line);
-            line = token.line;
+            tokenLine = token.line;
         } else {
             printf("   | ");
         }
@@ -36,7 +31,8 @@ void initScanner(const char* source)
 
     scanner.start = source;
     scanner.current = source;
-    scanner.line = 1;
+    scanner.line = line;
+    scanner.interpolations = 0;
 #endif
 }
 
@@ -183,7 +179,15 @@ static TokenType identifierType()
     case 'r':
         return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
     case 's':
-        return checkKeyword(1, 4, "uper", TOKEN_SUPER);
+        if (scanner.current - scanner.start > 1) {
+            switch (scanner.start[1]) {
+            case 't':
+                return checkKeyword(2, 4, "ruct", TOKEN_STRUCT);
+            case 'u':
+                return checkKeyword(2, 3, "per", TOKEN_SUPER);
+            }
+        }
+        break;
     case 't':
         if (scanner.current - scanner.start > 1) {
             switch (scanner.start[1]) {
@@ -225,12 +229,22 @@ static Token number()
     return makeToken(TOKEN_NUMBER);
 }
 
+// Scans the text of a string up to its closing quote, or up to the next interpolation.
 static Token string()
 {
     while (peek() != '"' && !isAtEnd()) {
         if (peek() == '\n') {
             scanner.line++;
         }
+        if (peek() == '$' && peekNext() == '{') {
+            if (scanner.interpolations == MAX_INTERPOLATION_DEPTH) {
+                return errorToken("Interpolation nested too deeply.");
+            }
+            advance();
+            advance();
+            scanner.braces[scanner.interpolations++] = 0;
+            return makeToken(TOKEN_INTERPOLATION);
+        }
         advance();
     }
 
@@ -242,6 +256,16 @@ static Token string()
     return makeToken(TOKEN_STRING);
 }
 
+Scanner saveScanner()
+{
+    return scanner;
+}
+
+void restoreScanner(Scanner saved)
+{
+    scanner = saved;
+}
+
 Token scanToken()
 {
     skipWhitespaces();
@@ -263,8 +287,20 @@ Token scanToken()
     case ')':
         return makeToken(TOKEN_RIGHT_PAREN);
     case '{':
+        if (scanner.interpolations > 0) {
+            scanner.braces[scanner.interpolations - 1]++;
+        }
         return makeToken(TOKEN_LEFT_BRACE);
     case '}':
+        if (scanner.interpolations > 0) {
+            unsigned char* braces = &scanner.braces[scanner.interpolations - 1];
+            if (*braces == 0) {
+                // the end of the interpolation, the string goes on
+                scanner.interpolations--;
+                return string();
+            }
+            (*braces)--;
+        }
         return makeToken(TOKEN_RIGHT_BRACE);
     case '[':
         return makeToken(TOKEN_LEFT_BRACKET);
@@ -274,6 +310,8 @@ Token scanToken()
         return makeToken(TOKEN_SEMICOLON);
     case ',':
         return makeToken(TOKEN_COMMA);
+    case ':':
+        return makeToken(TOKEN_COLON);
     case '.':
         return makeToken(TOKEN_DOT);
     case '-':
@@ -292,7 +330,7 @@ Token scanToken()
         return makeToken(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
     case '>':
         return makeToken(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
-    case '"': // TODO: support single quote strings / template strings
+    case '"': // TODO: support single quote strings
         return string();
     }
 
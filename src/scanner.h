@@ -11,6 +11,7 @@ typedef enum {
     TOKEN_LEFT_BRACKET,
     TOKEN_RIGHT_BRACKET,
     TOKEN_COMMA,
+    TOKEN_COLON,
     TOKEN_DOT,
     TOKEN_MINUS,
     TOKEN_PLUS,
@@ -29,6 +30,8 @@ typedef enum {
     // Literals.
     TOKEN_IDENTIFIER,
     TOKEN_STRING,
+    // the text of a template string up to a ${, or between a } and the next ${
+    TOKEN_INTERPOLATION,
     TOKEN_NUMBER,
     // Keywords.
     TOKEN_AND,
@@ -42,6 +45,7 @@ typedef enum {
     TOKEN_OR,
     TOKEN_PRINT,
     TOKEN_RETURN,
+    TOKEN_STRUCT,
     TOKEN_SUPER,
     TOKEN_THIS,
     TOKEN_TRUE,
@@ -61,7 +65,22 @@ typedef struct {
     int line;
 } Token;
 
-void initScanner(const char* source);
+#define MAX_INTERPOLATION_DEPTH 8
+
+typedef struct {
+    const char* start;
+    const char* current;
+    int line;
+    // the braces open within each interpolation being scanned, the innermost last
+    unsigned char braces[MAX_INTERPOLATION_DEPTH];
+    int interpolations;
+} Scanner;
+
+// Starts scanning source, which begins on the given line.
+void initScanner(const char* source, int line);
 Token scanToken();
+// Where the scanner is, to look at the tokens ahead and come back.
+Scanner saveScanner();
+void restoreScanner(Scanner saved);
 
 #endif
\ No newline at end of file
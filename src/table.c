@@ -8,56 +8,142 @@
 #include "values/value.h"
 #include "vm.h"
 
-#define TABLE_MAX_LOAD 0.75
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The table is probed a whole group of slots at a time. Every slot has a control byte, that is
+// either empty, deleted or holds the lower 7 bits of the hash of its key. Only slots with a
+// matching control byte have to be compared against the key.
+#define TABLE_MAX_LOAD 0.875
+#define TABLE_MIN_LOAD 0.0625
+// Smaller tables are cheap to keep around and would only be grown again soon.
+#define TABLE_MIN_SHRINK 1024
+#define GROUP_WIDTH 16
+
+#define CONTROL_EMPTY ((uint8_t)0x80)
+#define CONTROL_DELETED ((uint8_t)0xFE)
+#define CONTROL_HASH(hash) ((uint8_t)((hash) & 0x7F))
+#define GROUP_HASH(hash) ((hash) >> 7)
+
+#define GROW_TABLE_CAPACITY(capacity) ((capacity) < GROUP_WIDTH ? GROUP_WIDTH : (capacity) * 2)
+
+typedef uint32_t GroupMask;
+
+#ifdef DEBUG_TABLE_STATS
+static struct {
+    uint64_t lookups;
+    uint64_t groups;
+    uint64_t compares;
+} stats;
+
+#define COUNT_STAT(stat) (stats.stat++)
+#else
+#define COUNT_STAT(stat)
+#endif
+
+static inline GroupMask matchControl(const uint8_t* group, uint8_t control)
+{
+#ifdef __SSE2__
+    __m128i bytes = _mm_loadu_si128((const __m128i*)group);
+    return (GroupMask)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)control)));
+#else
+    GroupMask mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (GroupMask)(group[i] == control) << i;
+    }
+    return mask;
+#endif
+}
+
+// Empty and deleted slots are the only ones with the high bit set.
+static inline GroupMask matchFree(const uint8_t* group)
+{
+#ifdef __SSE2__
+    return (GroupMask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+    GroupMask mask = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (GroupMask)(group[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+static inline int lowestSlot(GroupMask mask)
+{
+    return __builtin_ctz(mask);
+}
 
 void initTable(Table* table)
 {
     table->count = 0;
+    table->tombstones = 0;
     table->capacity = 0;
     table->entries = NULL;
+    table->control = NULL;
 }
 
 void freeTable(Table* table)
 {
     FREE_ARRAY(Entry, table->entries, table->capacity);
+    FREE_ARRAY(uint8_t, table->control, table->capacity);
     initTable(table);
 }
 
-static Entry* findEntry(Entry* entries, int capacity, ObjString* key)
+static Entry* findEntry(Table* table, ObjString* key)
 {
-    uint32_t index = key->hash & (capacity - 1);
-    Entry* tombstone = NULL;
-
-    for (;;) {
-        Entry* entry = &entries[index];
-
-        if (entry->key == NULL) {
-            if (IS_NIL(entry->as.value)) {
-                // Empty entry
-                return tombstone != NULL ? tombstone : entry;
-            } else {
-                // Tombstone
-                if (tombstone == NULL) {
-                    tombstone = entry;
-                }
+    uint32_t groupMask = table->capacity / GROUP_WIDTH - 1;
+    uint32_t group = GROUP_HASH(key->hash) & groupMask;
+    uint8_t control = CONTROL_HASH(key->hash);
+    COUNT_STAT(lookups);
+
+    for (uint32_t step = 1;; step++) {
+        const uint8_t* groupControl = &table->control[group * GROUP_WIDTH];
+        COUNT_STAT(groups);
+
+        GroupMask candidates = matchControl(groupControl, control);
+        while (candidates != 0) {
+            Entry* entry = &table->entries[group * GROUP_WIDTH + lowestSlot(candidates)];
+            COUNT_STAT(compares);
+            if (entry->key == key) {
+                return entry;
             }
-        } else if (entry->key == key) {
-            return entry;
+            candidates &= candidates - 1;
         }
 
-        index = (index + 1) & (capacity - 1);
+        if (matchControl(groupControl, CONTROL_EMPTY) != 0) {
+            return NULL;
+        }
+        // triangular probing visits every group, as long as the group count is a power of two
+        group = (group + step) & groupMask;
+    }
+}
+
+static uint32_t findFreeSlot(const uint8_t* control, int capacity, uint32_t hash)
+{
+    uint32_t groupMask = capacity / GROUP_WIDTH - 1;
+    uint32_t group = GROUP_HASH(hash) & groupMask;
+
+    for (uint32_t step = 1;; step++) {
+        GroupMask free = matchFree(&control[group * GROUP_WIDTH]);
+        if (free != 0) {
+            return group * GROUP_WIDTH + lowestSlot(free);
+        }
+        group = (group + step) & groupMask;
     }
 }
 
 static void adjustCapacity(Table* table, int capacity)
 {
     Entry* entries = ALLOCATE(Entry, capacity);
+    uint8_t* control = ALLOCATE(uint8_t, capacity);
+    memset(control, CONTROL_EMPTY, capacity);
     for (int i = 0; i < capacity; i++) {
         entries[i].key = NULL;
         entries[i].as.value = NIL_VAL;
     }
 
-    table->count = 0;
     for (int i = 0; i < table->capacity; i++) {
         Entry* entry = &table->entries[i];
 
@@ -65,16 +151,124 @@ static void adjustCapacity(Table* table, int capacity)
             continue;
         }
 
-        Entry* dest = findEntry(entries, capacity, entry->key);
-        dest->key = entry->key;
-        dest->as.value = entry->as.value;
-        table->count++;
+        uint32_t slot = findFreeSlot(control, capacity, entry->key->hash);
+        control[slot] = CONTROL_HASH(entry->key->hash);
+        entries[slot] = *entry;
     }
 
     FREE_ARRAY(Entry, table->entries, table->capacity);
+    FREE_ARRAY(uint8_t, table->control, table->capacity);
 
     table->entries = entries;
+    table->control = control;
     table->capacity = capacity;
+    table->tombstones = 0;
+}
+
+// Gets rid of all tombstones without allocating. Live entries are temporarily marked as deleted,
+// then each of them is moved to the first free slot of its probe sequence. A marked entry that is
+// in the way gets swapped out and placed next.
+static void rehashInPlace(Table* table)
+{
+    uint8_t* control = table->control;
+    for (int i = 0; i < table->capacity; i++) {
+        control[i] = table->entries[i].key == NULL ? CONTROL_EMPTY : CONTROL_DELETED;
+    }
+
+    for (int i = 0; i < table->capacity; i++) {
+        if (control[i] != CONTROL_DELETED) {
+            continue;
+        }
+
+        Entry* entry = &table->entries[i];
+        uint32_t hash = entry->key->hash;
+        uint32_t slot = findFreeSlot(control, table->capacity, hash);
+        if (slot / GROUP_WIDTH == (uint32_t)i / GROUP_WIDTH) {
+            // already in the first group with room
+            control[i] = CONTROL_HASH(hash);
+            continue;
+        }
+
+        Entry* target = &table->entries[slot];
+        if (control[slot] == CONTROL_EMPTY) {
+            *target = *entry;
+            entry->key = NULL;
+            entry->as.value = NIL_VAL;
+            control[slot] = CONTROL_HASH(hash);
+            control[i] = CONTROL_EMPTY;
+        } else {
+            // the target still waits to be placed, continue with it from this slot
+            Entry displaced = *target;
+            *target = *entry;
+            *entry = displaced;
+            control[slot] = CONTROL_HASH(hash);
+            i--;
+        }
+    }
+
+    table->tombstones = 0;
+}
+
+// Makes room for one more entry. Large tables that were emptied by mass deletion shrink, tables
+// that are mostly tombstones are cleaned up in place and all other ones grow. Shrinking only ever
+// happens here and not on deletion, so that the collector never has to allocate.
+static void ensureCapacity(Table* table)
+{
+    if (table->capacity > TABLE_MIN_SHRINK && table->count < table->capacity * TABLE_MIN_LOAD) {
+        int capacity = table->capacity;
+        while (capacity > TABLE_MIN_SHRINK && table->count < capacity * TABLE_MIN_LOAD) {
+            capacity /= 2;
+        }
+        adjustCapacity(table, capacity);
+        return;
+    }
+
+    if (table->count + table->tombstones + 1 <= table->capacity * TABLE_MAX_LOAD) {
+        return;
+    }
+    if (table->count + 1 <= table->capacity * TABLE_MAX_LOAD / 2) {
+        rehashInPlace(table);
+    } else {
+        adjustCapacity(table, GROW_TABLE_CAPACITY(table->capacity));
+    }
+}
+
+static Entry* insertEntry(Table* table, ObjString* key, bool* isNewKey)
+{
+    Entry* entry = table->count == 0 ? NULL : findEntry(table, key);
+    *isNewKey = entry == NULL;
+    if (entry != NULL) {
+        return entry;
+    }
+
+    ensureCapacity(table);
+    uint32_t slot = findFreeSlot(table->control, table->capacity, key->hash);
+    if (table->control[slot] == CONTROL_DELETED) {
+        table->tombstones--;
+    }
+    table->control[slot] = CONTROL_HASH(key->hash);
+    table->count++;
+
+    entry = &table->entries[slot];
+    entry->key = key;
+    return entry;
+}
+
+// Empties the slot of an entry. A group that still has an empty slot never made a lookup probe
+// any further, so the slot can become empty again instead of a tombstone.
+static void removeEntry(Table* table, Entry* entry)
+{
+    uint32_t slot = (uint32_t)(entry - table->entries);
+    const uint8_t* group = &table->control[slot / GROUP_WIDTH * GROUP_WIDTH];
+    if (matchControl(group, CONTROL_EMPTY) != 0) {
+        table->control[slot] = CONTROL_EMPTY;
+    } else {
+        table->control[slot] = CONTROL_DELETED;
+        table->tombstones++;
+    }
+    entry->key = NULL;
+    entry->as.value = NIL_VAL;
+    table->count--;
 }
 
 bool tableGet(Table* table, ObjString* key, Value* value)
@@ -83,8 +277,8 @@ bool tableGet(Table* table, ObjString* key, Value* value)
         return false;
     }
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL) {
+    Entry* entry = findEntry(table, key);
+    if (entry == NULL) {
         return false;
     }
 
@@ -94,18 +288,8 @@ bool tableGet(Table* table, ObjString* key, Value* value)
 
 bool tableSet(Table* table, ObjString* key, Value value)
 {
-    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-        int capacity = GROW_CAPACITY(table->capacity);
-        adjustCapacity(table, capacity);
-    }
-
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
-    if (isNewKey && IS_NIL(entry->as.value)) {
-        table->count++;
-    }
-
-    entry->key = key;
+    bool isNewKey;
+    Entry* entry = insertEntry(table, key, &isNewKey);
     entry->as.value = value;
 
     return isNewKey;
@@ -113,34 +297,23 @@ bool tableSet(Table* table, ObjString* key, Value value)
 
 bool tableGetUint32(Table* table, ObjString* key, uint32_t* value)
 {
-
-
     if (table->count == 0) {
         return false;
     }
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL) {
+    Entry* entry = findEntry(table, key);
+    if (entry == NULL) {
         return false;
     }
 
     *value = entry->as.uint32;
     return true;
 }
+
 bool tableSetUint32(Table* table, ObjString* key, uint32_t value)
 {
-    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
-        int capacity = GROW_CAPACITY(table->capacity);
-        adjustCapacity(table, capacity);
-    }
-
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
-    if (isNewKey && IS_NIL(entry->as.value)) {
-        table->count++;
-    }
-
-    entry->key = key;
+    bool isNewKey;
+    Entry* entry = insertEntry(table, key, &isNewKey);
     entry->as.uint32 = value;
 
     return isNewKey;
@@ -153,15 +326,12 @@ bool tableDelete(Table* table, ObjString* key)
         return false;
     }
 
-    Entry* entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL) {
+    Entry* entry = findEntry(table, key);
+    if (entry == NULL) {
         return false;
     }
 
-    // PLace a tombstone in the entry
-    entry->key = NULL;
-    entry->as.value = BOOL_VAL(true);
-
+    removeEntry(table, entry);
     return true;
 }
 
@@ -181,20 +351,31 @@ ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t
         return NULL;
     }
 
-    uint32_t index = hash & (table->capacity - 1);
-    for (;;) {
-        Entry* entry = &table->entries[index];
-        if (entry->key == NULL) {
-            if (IS_NIL(entry->as.value)) {
-                // no matching entry even after probing
-                return NULL;
+    uint32_t groupMask = table->capacity / GROUP_WIDTH - 1;
+    uint32_t group = GROUP_HASH(hash) & groupMask;
+    uint8_t control = CONTROL_HASH(hash);
+    COUNT_STAT(lookups);
+
+    for (uint32_t step = 1;; step++) {
+        const uint8_t* groupControl = &table->control[group * GROUP_WIDTH];
+        COUNT_STAT(groups);
+
+        GroupMask candidates = matchControl(groupControl, control);
+        while (candidates != 0) {
+            ObjString* key = table->entries[group * GROUP_WIDTH + lowestSlot(candidates)].key;
+            COUNT_STAT(compares);
+            if (key->length == length && key->hash == hash
+                && memcmp(key->chars, chars, length) == 0) {
+                return key;
             }
-        } else if (entry->key->length == length && entry->key->hash == hash
-            && memcmp(entry->key->chars, chars, length) == 0) {
-            return entry->key;
+            candidates &= candidates - 1;
         }
 
-        index = (index + 1) & (table->capacity - 1);
+        if (matchControl(groupControl, CONTROL_EMPTY) != 0) {
+            // no matching entry even after probing
+            return NULL;
+        }
+        group = (group + step) & groupMask;
     }
 }
 
@@ -203,7 +384,7 @@ void tableRemoveWhite(Table* table)
     for (int i = 0; i < table->capacity; i++) {
         Entry* entry = &table->entries[i];
         if (entry->key != NULL && !entry->key->obj.isMarked) {
-            tableDelete(table, entry->key);
+            removeEntry(table, entry);
         }
     }
 }
@@ -216,3 +397,15 @@ void markTable(Table* table)
         markValue(entry->as.value);
     }
 }
+
+#ifdef DEBUG_TABLE_STATS
+void printTableStats()
+{
+    fprintf(stderr, "== Table stats ==\n");
+    fprintf(stderr, "lookups:         %lu\n", (unsigned long)stats.lookups);
+    fprintf(stderr, "groups probed:   %lu (%.3f per lookup)\n", (unsigned long)stats.groups,
+        stats.lookups == 0 ? 0.0 : (double)stats.groups / stats.lookups);
+    fprintf(stderr, "keys compared:   %lu (%.3f per lookup)\n", (unsigned long)stats.compares,
+        stats.lookups == 0 ? 0.0 : (double)stats.compares / stats.lookups);
+}
+#endif
@@ -12,9 +12,11 @@ typedef struct {
 } Entry;
 
 typedef struct {
-    int count;
+    int count; // live entries
+    int tombstones;
     int capacity;
     Entry* entries;
+    uint8_t* control;
 } Table;
 
 void initTable(Table* table);
@@ -32,3 +34,7 @@ ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t
 
 void tableRemoveWhite(Table* table);
 void markTable(Table* table);
+
+#ifdef DEBUG_TABLE_STATS
+void printTableStats();
+#endif
@@ -1,15 +1,34 @@
 #pragma once
 
 #include "../common.h"
+#include "../scanner.h"
 #include "../values/object.h"
 
 
+// What the compiler knows about the values a variable holds.
+typedef enum {
+    VAR_TYPE_UNKNOWN,
+    VAR_TYPE_NUMBER,
+} VarType;
+
+// A set of local slots.
+typedef struct {
+    uint64_t bits[UINT8_COUNT / 64];
+} SlotSet;
+
 typedef struct {
     int depth;
     ObjString* identifier;
     bool readonly;
     int shadowAddr;
     bool isCaptured;
+    VarType type;
+    // the locals whose values were assigned to a number local, its type relies on theirs
+    SlotSet sources;
+    // where the scope of a local starts, to look ahead for assignments to it
+    Scanner scope;
+    bool isScanned;
+    bool isReassigned;
 } Var;
 
 typedef struct {
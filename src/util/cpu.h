@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../common.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_X86
+#endif
+
+// SSE2 is part of the x86-64 baseline, AVX2 has to be detected at runtime.
+static inline bool cpuHasAvx2()
+{
+#ifdef CPU_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
@@ -3,6 +3,7 @@
 #include "debug.h"
 #include "../values/value.h"
 #include "../values/object.h"
+#include "../vm.h"
 
 void disassembleChunk(Chunk* chunk, const char* name)
 {
@@ -37,6 +38,19 @@ static int constantLongInstruction(const char* name, Chunk* chunk, int offset)
     return offset + 4;
 }
 
+static int selectorInstruction(const char* name, bool isLong, Chunk* chunk, int offset)
+{
+    uint32_t selector = chunk->code[offset + 1];
+    if (isLong) {
+        selector = (chunk->code[offset + 1] << 16) | (chunk->code[offset + 2] << 8)
+            | chunk->code[offset + 3];
+    }
+    printf("%-16s %4d '%s'\n", name, selector,
+        addresstableGetName(&vm.selectorTable, selector)->chars);
+
+    return offset + (isLong ? 4 : 2);
+}
+
 static int simpleInstruction(const char* name, int offset)
 {
     printf("%s\n", name);
@@ -71,6 +85,50 @@ static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
     return offset + 3;
 }
 
+static int checkInstruction(const char* name, bool hasSelector, Chunk* chunk, int offset)
+{
+    int size = hasSelector ? 6 : 5;
+    printf("%-16s ", name);
+    if (hasSelector) {
+        printf("'%s' ", addresstableGetName(&vm.selectorTable, chunk->code[offset + 1])->chars);
+    }
+    const uint8_t* operands = &chunk->code[offset + size - 4];
+    printf("(%d args) ", operands[0]);
+    printValue(chunk->constants.values[operands[1]]);
+    uint16_t jump = (uint16_t)((operands[2] << 8) | operands[3]);
+    printf(" else -> %d\n", offset + size + jump);
+    return offset + size;
+}
+
+static const char* operatorName(uint8_t op)
+{
+    switch (op) {
+    case OP_ADD:
+        return "+";
+    case OP_SUBTRACT:
+        return "-";
+    case OP_LESS:
+        return "<";
+    case OP_LESS_EQUAL:
+        return "<=";
+    case OP_GREATER:
+        return ">";
+    default:
+        return ">=";
+    }
+}
+
+static int forLoopInstruction(const char* name, Chunk* chunk, int offset)
+{
+    const uint8_t* operands = &chunk->code[offset + 1];
+    printf("%-16s %4d ", name, operands[0]);
+    printValue(chunk->constants.values[operands[1]]);
+    uint16_t jump = (uint16_t)((operands[4] << 8) | operands[5]);
+    printf(" (%s %s) -> %d\n", operatorName(operands[2]), operatorName(operands[3]),
+        offset + 7 - jump);
+    return offset + 7;
+}
+
 static int closureInstruction(const char* name, uint32_t constantIndex, Chunk* chunk, int offset)
 {
     printf("%-16s %4d ", name, constantIndex);
@@ -84,6 +142,12 @@ static int closureInstruction(const char* name, uint32_t constantIndex, Chunk* c
         printf("%04d      |                     %s %d\n", offset - 2, isLocal ? "local" : "upvalue",
             index);
     }
+    for (int j = 0; j < function->capturedCount; j++) {
+        int isLocal = chunk->code[offset++];
+        int index = chunk->code[offset++];
+        printf("%04d      |                     copy %s %d\n", offset - 2,
+            isLocal ? "local" : "captured", index);
+    }
     return offset;
 }
 
@@ -103,9 +167,8 @@ static int invokeInstruction(const char* name, bool isLong, Chunk* chunk, int of
     } else {
         offset = offset + 3;
     }
-    printf("%-16s (%d args) %4d '", name, argCount, addr);
-    printValue(chunk->constants.values[addr]);
-    printf("'\n");
+    printf("%-16s (%d args) %4d '%s'\n", name, argCount, addr,
+        addresstableGetName(&vm.selectorTable, addr)->chars);
 
     return offset;
 }
@@ -180,13 +243,57 @@ int disassembleInstruction(Chunk* chunk, int offset)
     case OP_INHERIT:
         return simpleInstruction("OP_INHERIT", offset);
     case OP_METHOD:
-        return constantInstruction("OP_METHOD", chunk, offset);
+        return selectorInstruction("OP_METHOD", false, chunk, offset);
     case OP_METHOD_LONG:
-        return constantLongInstruction("OP_METHOD_LONG", chunk, offset);
+        return selectorInstruction("OP_METHOD_LONG", true, chunk, offset);
     case OP_ARRAY_INIT:
-        return simpleInstruction("OP_ARRAY_INIT", offset);
+        return byteInstruction("OP_ARRAY_INIT", chunk, offset);
     case OP_ARRAY_ADD:
         return simpleInstruction("OP_ARRAY_ADD", offset);
+    case OP_MAP_INIT:
+        return byteInstruction("OP_MAP_INIT", chunk, offset);
+    case OP_CONCAT_N:
+        return byteInstruction("OP_CONCAT_N", chunk, offset);
+    case OP_ADD_STRINGS:
+        return byteInstruction("OP_ADD_STRINGS", chunk, offset);
+    case OP_ADD_NUMBER:
+        return simpleInstruction("OP_ADD_NUMBER", offset);
+    case OP_SUBTRACT_NUMBER:
+        return simpleInstruction("OP_SUBTRACT_NUMBER", offset);
+    case OP_MULTIPLY_NUMBER:
+        return simpleInstruction("OP_MULTIPLY_NUMBER", offset);
+    case OP_DIVIDE_NUMBER:
+        return simpleInstruction("OP_DIVIDE_NUMBER", offset);
+    case OP_NEGATE_NUMBER:
+        return simpleInstruction("OP_NEGATE_NUMBER", offset);
+    case OP_GREATER_NUMBER:
+        return simpleInstruction("OP_GREATER_NUMBER", offset);
+    case OP_GREATER_EQUAL_NUMBER:
+        return simpleInstruction("OP_GREATER_EQUAL_NUMBER", offset);
+    case OP_LESS_NUMBER:
+        return simpleInstruction("OP_LESS_NUMBER", offset);
+    case OP_LESS_EQUAL_NUMBER:
+        return simpleInstruction("OP_LESS_EQUAL_NUMBER", offset);
+    case OP_CHECK_CALL:
+        return checkInstruction("OP_CHECK_CALL", false, chunk, offset);
+    case OP_CHECK_INVOKE:
+        return checkInstruction("OP_CHECK_INVOKE", true, chunk, offset);
+    case OP_INLINE_RETURN:
+        return byteInstruction("OP_INLINE_RETURN", chunk, offset);
+    case OP_FOR_LOOP:
+        return forLoopInstruction("OP_FOR_LOOP", chunk, offset);
+    case OP_GET_OUTER_LOCAL:
+        return byteInstruction("OP_GET_OUTER_LOCAL", chunk, offset);
+    case OP_SET_OUTER_LOCAL:
+        return byteInstruction("OP_SET_OUTER_LOCAL", chunk, offset);
+    case OP_GET_OUTER_UPVALUE:
+        return byteInstruction("OP_GET_OUTER_UPVALUE", chunk, offset);
+    case OP_SET_OUTER_UPVALUE:
+        return byteInstruction("OP_SET_OUTER_UPVALUE", chunk, offset);
+    case OP_GET_CAPTURED:
+        return byteInstruction("OP_GET_CAPTURED", chunk, offset);
+    case OP_GET_OUTER_CAPTURED:
+        return byteInstruction("OP_GET_OUTER_CAPTURED", chunk, offset);
     case OP_CONSTANT:
         return constantInstruction("OP_CONSTANT", chunk, offset);
     case OP_CONSTANT_LONG:
@@ -224,21 +331,23 @@ int disassembleInstruction(Chunk* chunk, int offset)
     case OP_SET_UPVALUE:
         return byteInstruction("OP_SET_UPVALUE", chunk, offset);
     case OP_GET_PROPERTY:
-        return constantInstruction("OP_GET_PROPERTY", chunk, offset);
+        return selectorInstruction("OP_GET_PROPERTY", false, chunk, offset);
     case OP_GET_PROPERTY_LONG:
-        return constantLongInstruction("OP_GET_PROPERTY_LONG", chunk, offset);
-    case OP_GET_PROPERTY_STACK:
-        return simpleInstruction("OP_GET_PROPERTY_STACK", offset);
+        return selectorInstruction("OP_GET_PROPERTY_LONG", true, chunk, offset);
+    case OP_GET_INDEX:
+        return simpleInstruction("OP_GET_INDEX", offset);
+    case OP_GET_INDEX_PROPERTY:
+        return selectorInstruction("OP_GET_INDEX_PROPERTY", false, chunk, offset);
     case OP_SET_PROPERTY:
-        return constantInstruction("OP_SET_PROPERTY", chunk, offset);
+        return selectorInstruction("OP_SET_PROPERTY", false, chunk, offset);
     case OP_SET_PROPERTY_LONG:
-        return constantLongInstruction("OP_SET_PROPERTY_LONG", chunk, offset);
-    case OP_SET_PROPERTY_STACK:
-        return simpleInstruction("OP_SET_PROPERTY_STACK", offset);
+        return selectorInstruction("OP_SET_PROPERTY_LONG", true, chunk, offset);
+    case OP_SET_INDEX:
+        return simpleInstruction("OP_SET_INDEX", offset);
     case OP_GET_SUPER:
-        return constantInstruction("OP_GET_SUPER", chunk, offset);
+        return selectorInstruction("OP_GET_SUPER", false, chunk, offset);
     case OP_GET_SUPER_LONG:
-        return constantLongInstruction("OP_GET_SUPER_LONG", chunk, offset);
+        return selectorInstruction("OP_GET_SUPER_LONG", true, chunk, offset);
     case OP_EQUAL:
         return simpleInstruction("OP_EQUAL", offset);
     case OP_NOT_EQUAL:
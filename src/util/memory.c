@@ -4,6 +4,9 @@
 #include "memory.h"
 #include "../vm.h"
 #include "../compiler.h"
+#include "../values/array.h"
+#include "../values/map.h"
+#include "../values/struct.h"
 #include "../values/value.h"
 
 #if defined(DEBUG_LOG_GC_MARK) || defined(DEBUG_LOG_GC_BLACKEN) || defined(DEBUG_LOG_GC_SWEEP)     \
@@ -48,7 +51,7 @@ static void freeObject(Obj* object)
     switch (object->type) {
     case OBJ_ARRAY: {
         ObjArray* array = (ObjArray*)object;
-        freeValueArray(&array->valueArray);
+        freeArrayStorage(array);
         FREE(ObjArray, object);
         break;
     }
@@ -67,21 +70,38 @@ static void freeObject(Obj* object)
         FREE(ObjInstance, object);
         break;
     }
+    case OBJ_ITERATOR:
+        FREE(ObjIterator, object);
+        break;
+    case OBJ_MAP: {
+        freeMapStorage((ObjMap*)object);
+        FREE(ObjMap, object);
+        break;
+    }
     case OBJ_CLASS: {
         ObjClass* klass = (ObjClass*)object;
-        freeTable(&klass->methods);
+        if (klass->methodsOwner == klass) {
+            freeValueArray(&klass->methods);
+        }
         FREE(ObjClass, object);
         break;
     }
     case OBJ_CLOSURE: {
         ObjClosure* closure = (ObjClosure*)object;
         FREE_ARRAY(ObjClosure*, closure->upvalues, closure->upvalueCount);
+        FREE_ARRAY(Value, closure->captured, closure->capturedCount);
         FREE(ObjClosure, object);
         break;
     }
+    case OBJ_FRAME:
+        FREE(ObjFrame, object);
+        break;
     case OBJ_FUNCTION: {
         ObjFunction* function = (ObjFunction*)object;
         freeChunk(&function->chunk);
+        if (function->lazy.chars != NULL) {
+            FREE_ARRAY(char, function->lazy.chars, function->lazy.length + 1);
+        }
         FREE(ObjFunction, object);
         break;
     }
@@ -89,6 +109,21 @@ static void freeObject(Obj* object)
         FREE(ObjNative, object);
         break;
     }
+    case OBJ_STRUCT: {
+        ObjStruct* element = (ObjStruct*)object;
+        reallocate(object, sizeof(ObjStruct) + element->fieldCount * sizeof(Value), 0);
+        break;
+    }
+    case OBJ_STRUCT_ARRAY:
+        freeStructArrayStorage((ObjStructArray*)object);
+        FREE(ObjStructArray, object);
+        break;
+    case OBJ_STRUCT_TYPE: {
+        ObjStructType* type = (ObjStructType*)object;
+        FREE_ARRAY(int, type->slots, type->slotCount);
+        FREE(ObjStructType, object);
+        break;
+    }
     case OBJ_UPVALUE: {
         FREE(ObjUpvalue, object);
         break;
@@ -129,6 +164,12 @@ void markObject(Obj* object)
 
     object->isMarked = true;
 
+    // packed number arrays hold no references, they can go straight to black
+    if (object->type == OBJ_ARRAY && ((ObjArray*)object)->kind == ARRAY_NUMBERS
+        && ((ObjArray*)object)->shared == NULL) {
+        return;
+    }
+
     if (vm.grayCapacity < vm.grayCount + 1) {
         vm.grayCapacity = GROW_CAPACITY(vm.grayCapacity);
         vm.grayStack = (Obj**)realloc(vm.grayStack, sizeof(Obj*) * vm.grayCapacity);
@@ -153,11 +194,9 @@ static void blackenObject(Obj* object)
     printf("\n");
 #endif
     switch (object->type) {
-    case OBJ_ARRAY: {
-        ObjArray* array = (ObjArray*)object;
-        markValueArray(&array->valueArray);
+    case OBJ_ARRAY:
+        markArray((ObjArray*)object);
         break;
-    }
     case OBJ_BOUND_METHOD: {
         ObjBoundMethod* bound = (ObjBoundMethod*)object;
         markValue(bound->receiver);
@@ -170,10 +209,24 @@ static void blackenObject(Obj* object)
         markTable(&instance->fields);
         break;
     }
+    case OBJ_ITERATOR: {
+        ObjIterator* iterator = (ObjIterator*)object;
+        markValue(iterator->source);
+        markObject((Obj*)iterator->upstream);
+        markObject((Obj*)iterator->other);
+        break;
+    }
+    case OBJ_MAP:
+        markMap((ObjMap*)object);
+        break;
     case OBJ_CLASS: {
         ObjClass* klass = (ObjClass*)object;
         markObject((Obj*)klass->name);
-        markTable(&klass->methods);
+        if (klass->methodsOwner == klass) {
+            markValueArray(&klass->methods);
+        } else {
+            markObject((Obj*)klass->methodsOwner);
+        }
         break;
     }
     case OBJ_CLOSURE: {
@@ -182,14 +235,34 @@ static void blackenObject(Obj* object)
         for (int i = 0; i < closure->upvalueCount; i++) {
             markObject((Obj*)closure->upvalues[i]);
         }
+        for (int i = 0; i < closure->capturedCount; i++) {
+            markValue(closure->captured[i]);
+        }
         break;
     }
+    case OBJ_FRAME:
+        markObject((Obj*)((ObjFrame*)object)->columns);
+        break;
     case OBJ_FUNCTION: {
         ObjFunction* function = (ObjFunction*)object;
         markObject((Obj*)function->name);
         markValueArray(&function->chunk.constants);
         break;
     }
+    case OBJ_STRUCT: {
+        ObjStruct* element = (ObjStruct*)object;
+        markObject((Obj*)element->type);
+        for (int i = 0; i < element->fieldCount; i++) {
+            markValue(element->fields[i]);
+        }
+        break;
+    }
+    case OBJ_STRUCT_ARRAY:
+        markStructArray((ObjStructArray*)object);
+        break;
+    case OBJ_STRUCT_TYPE:
+        markObject((Obj*)((ObjStructType*)object)->name);
+        break;
     case OBJ_UPVALUE:
         markValue(((ObjUpvalue*)object)->closed);
         break;
@@ -223,10 +296,12 @@ static void markRoots()
 
     // compiler
     markTable(&vm.gloablsTable.addresses);
+    markTable(&vm.selectorTable.addresses);
+    markValueArray(&vm.inlineFunctions);
+    markValueArray(&vm.inlineMethods);
     // markVarArray(&vm.globalProps);
 
     markCompilerRoots();
-    markObject((Obj*)vm.initString);
 }
 
 static void traceReferences()
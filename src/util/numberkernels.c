@@ -0,0 +1,423 @@
+#include <math.h>
+
+#include "numberkernels.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+typedef double (*ReduceFn)(const double* a, const double* b, int length);
+typedef void (*AxpyFn)(double* dest, double alpha, const double* x, const double* y, int length);
+typedef void (*ApplyFn)(double* dest, const double* a, const double* b, bool broadcast, int length);
+
+// Scalar kernels, also used for the tails of the vector kernels.
+
+static double sumScalar(const double* a, const double* b, int length)
+{
+    (void)b;
+    double sum = 0;
+    for (int i = 0; i < length; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+static double dotScalar(const double* a, const double* b, int length)
+{
+    double sum = 0;
+    for (int i = 0; i < length; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+// Like Math.min() and Math.max(), any NaN makes the result NaN, wherever it is.
+static inline double smaller(double x, double min)
+{
+    return x < min || x != x ? x : min;
+}
+
+static inline double larger(double x, double max)
+{
+    return x > max || x != x ? x : max;
+}
+
+static double minScalar(const double* a, const double* b, int length)
+{
+    (void)b;
+    double min = a[0];
+    for (int i = 1; i < length; i++) {
+        min = smaller(a[i], min);
+    }
+    return min;
+}
+
+static double maxScalar(const double* a, const double* b, int length)
+{
+    (void)b;
+    double max = a[0];
+    for (int i = 1; i < length; i++) {
+        max = larger(a[i], max);
+    }
+    return max;
+}
+
+static void axpyScalar(double* dest, double alpha, const double* x, const double* y, int length)
+{
+    for (int i = 0; i < length; i++) {
+        dest[i] = alpha * x[i] + y[i];
+    }
+}
+
+#define DEFINE_APPLY_SCALAR(name, expression)                                                      \
+    static void name##Scalar(                                                                      \
+        double* dest, const double* a, const double* b, bool broadcast, int length)                \
+    {                                                                                              \
+        for (int i = 0; i < length; i++) {                                                         \
+            double x = a[i];                                                                       \
+            double y = broadcast ? b[0] : b[i];                                                    \
+            dest[i] = (expression);                                                                \
+        }                                                                                          \
+    }
+
+DEFINE_APPLY_SCALAR(add, x + y)
+DEFINE_APPLY_SCALAR(subtract, x - y)
+DEFINE_APPLY_SCALAR(multiply, x * y)
+DEFINE_APPLY_SCALAR(divide, x / y)
+DEFINE_APPLY_SCALAR(less, x < y ? 1.0 : 0.0)
+DEFINE_APPLY_SCALAR(greater, x > y ? 1.0 : 0.0)
+DEFINE_APPLY_SCALAR(equal, x == y ? 1.0 : 0.0)
+
+// The vector kernels keep two accumulators, so that consecutive additions don't wait on each
+// other. Their sums can differ from the scalar ones in the last bits.
+#ifdef __SSE2__
+static double horizontalSumSse2(__m128d vector)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(vector, _mm_unpackhi_pd(vector, vector)));
+}
+
+static double sumSse2(const double* a, const double* b, int length)
+{
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        sum0 = _mm_add_pd(sum0, _mm_loadu_pd(a + i));
+        sum1 = _mm_add_pd(sum1, _mm_loadu_pd(a + i + 2));
+    }
+    return horizontalSumSse2(_mm_add_pd(sum0, sum1)) + sumScalar(a + i, b, length - i);
+}
+
+static double dotSse2(const double* a, const double* b, int length)
+{
+    __m128d sum0 = _mm_setzero_pd();
+    __m128d sum1 = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    return horizontalSumSse2(_mm_add_pd(sum0, sum1)) + dotScalar(a + i, b + i, length - i);
+}
+
+static double minSse2(const double* a, const double* b, int length)
+{
+    if (length < 2) {
+        return minScalar(a, b, length);
+    }
+    // _mm_min_pd() drops a NaN in its first operand, so NaNs are tracked separately
+    __m128d min = _mm_loadu_pd(a);
+    __m128d nan = _mm_cmpunord_pd(min, min);
+    int i = 2;
+    for (; i + 2 <= length; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        min = _mm_min_pd(min, x);
+        nan = _mm_or_pd(nan, _mm_cmpunord_pd(x, x));
+    }
+    if (_mm_movemask_pd(nan) != 0) {
+        return NAN;
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, min);
+    double result = smaller(lanes[0], lanes[1]);
+    return i < length ? smaller(a[i], result) : result;
+}
+
+static double maxSse2(const double* a, const double* b, int length)
+{
+    if (length < 2) {
+        return maxScalar(a, b, length);
+    }
+    // _mm_max_pd() drops a NaN in its first operand, so NaNs are tracked separately
+    __m128d max = _mm_loadu_pd(a);
+    __m128d nan = _mm_cmpunord_pd(max, max);
+    int i = 2;
+    for (; i + 2 <= length; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        max = _mm_max_pd(max, x);
+        nan = _mm_or_pd(nan, _mm_cmpunord_pd(x, x));
+    }
+    if (_mm_movemask_pd(nan) != 0) {
+        return NAN;
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, max);
+    double result = larger(lanes[0], lanes[1]);
+    return i < length ? larger(a[i], result) : result;
+}
+
+static void axpySse2(double* dest, double alpha, const double* x, const double* y, int length)
+{
+    const __m128d factor = _mm_set1_pd(alpha);
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128d product = _mm_mul_pd(factor, _mm_loadu_pd(x + i));
+        _mm_storeu_pd(dest + i, _mm_add_pd(product, _mm_loadu_pd(y + i)));
+    }
+    axpyScalar(dest + i, alpha, x + i, y + i, length - i);
+}
+
+static inline __m128d lessSse2Op(__m128d x, __m128d y)
+{
+    return _mm_and_pd(_mm_cmplt_pd(x, y), _mm_set1_pd(1.0));
+}
+
+static inline __m128d greaterSse2Op(__m128d x, __m128d y)
+{
+    return _mm_and_pd(_mm_cmpgt_pd(x, y), _mm_set1_pd(1.0));
+}
+
+static inline __m128d equalSse2Op(__m128d x, __m128d y)
+{
+    return _mm_and_pd(_mm_cmpeq_pd(x, y), _mm_set1_pd(1.0));
+}
+
+#define DEFINE_APPLY_SSE2(name, operation)                                                         \
+    static void name##Sse2(double* dest, const double* a, const double* b, bool broadcast,         \
+        int length)                                                                                \
+    {                                                                                              \
+        const __m128d scalar = broadcast ? _mm_set1_pd(b[0]) : _mm_setzero_pd();                   \
+        int i = 0;                                                                                 \
+        for (; i + 2 <= length; i += 2) {                                                          \
+            __m128d y = broadcast ? scalar : _mm_loadu_pd(b + i);                                  \
+            _mm_storeu_pd(dest + i, operation(_mm_loadu_pd(a + i), y));                            \
+        }                                                                                          \
+        name##Scalar(dest + i, a + i, broadcast ? b : b + i, broadcast, length - i);               \
+    }
+
+DEFINE_APPLY_SSE2(add, _mm_add_pd)
+DEFINE_APPLY_SSE2(subtract, _mm_sub_pd)
+DEFINE_APPLY_SSE2(multiply, _mm_mul_pd)
+DEFINE_APPLY_SSE2(divide, _mm_div_pd)
+DEFINE_APPLY_SSE2(less, lessSse2Op)
+DEFINE_APPLY_SSE2(greater, greaterSse2Op)
+DEFINE_APPLY_SSE2(equal, equalSse2Op)
+#endif
+
+#ifdef CPU_X86
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline double horizontalSumAvx2(__m256d vector)
+{
+    __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(vector), _mm256_extractf128_pd(vector, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+AVX2 static double sumAvx2(const double* a, const double* b, int length)
+{
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        sum0 = _mm256_add_pd(sum0, _mm256_loadu_pd(a + i));
+        sum1 = _mm256_add_pd(sum1, _mm256_loadu_pd(a + i + 4));
+    }
+    return horizontalSumAvx2(_mm256_add_pd(sum0, sum1)) + sumScalar(a + i, b, length - i);
+}
+
+AVX2 static double dotAvx2(const double* a, const double* b, int length)
+{
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        sum1 = _mm256_add_pd(
+            sum1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    return horizontalSumAvx2(_mm256_add_pd(sum0, sum1)) + dotScalar(a + i, b + i, length - i);
+}
+
+AVX2 static double minAvx2(const double* a, const double* b, int length)
+{
+    if (length < 4) {
+        return minScalar(a, b, length);
+    }
+    __m256d min = _mm256_loadu_pd(a);
+    __m256d nan = _mm256_cmp_pd(min, min, _CMP_UNORD_Q);
+    int i = 4;
+    for (; i + 4 <= length; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        min = _mm256_min_pd(min, x);
+        nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+    }
+    if (_mm256_movemask_pd(nan) != 0) {
+        return NAN;
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, min);
+    double result = minScalar(lanes, NULL, 4);
+    return i < length ? smaller(minScalar(a + i, NULL, length - i), result) : result;
+}
+
+AVX2 static double maxAvx2(const double* a, const double* b, int length)
+{
+    if (length < 4) {
+        return maxScalar(a, b, length);
+    }
+    __m256d max = _mm256_loadu_pd(a);
+    __m256d nan = _mm256_cmp_pd(max, max, _CMP_UNORD_Q);
+    int i = 4;
+    for (; i + 4 <= length; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        max = _mm256_max_pd(max, x);
+        nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+    }
+    if (_mm256_movemask_pd(nan) != 0) {
+        return NAN;
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, max);
+    double result = maxScalar(lanes, NULL, 4);
+    return i < length ? larger(maxScalar(a + i, NULL, length - i), result) : result;
+}
+
+AVX2 static void axpyAvx2(double* dest, double alpha, const double* x, const double* y, int length)
+{
+    const __m256d factor = _mm256_set1_pd(alpha);
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256d product = _mm256_mul_pd(factor, _mm256_loadu_pd(x + i));
+        _mm256_storeu_pd(dest + i, _mm256_add_pd(product, _mm256_loadu_pd(y + i)));
+    }
+    axpyScalar(dest + i, alpha, x + i, y + i, length - i);
+}
+
+AVX2 static inline __m256d lessAvx2Op(__m256d x, __m256d y)
+{
+    return _mm256_and_pd(_mm256_cmp_pd(x, y, _CMP_LT_OQ), _mm256_set1_pd(1.0));
+}
+
+AVX2 static inline __m256d greaterAvx2Op(__m256d x, __m256d y)
+{
+    return _mm256_and_pd(_mm256_cmp_pd(x, y, _CMP_GT_OQ), _mm256_set1_pd(1.0));
+}
+
+AVX2 static inline __m256d equalAvx2Op(__m256d x, __m256d y)
+{
+    return _mm256_and_pd(_mm256_cmp_pd(x, y, _CMP_EQ_OQ), _mm256_set1_pd(1.0));
+}
+
+#define DEFINE_APPLY_AVX2(name, operation)                                                         \
+    AVX2 static void name##Avx2(double* dest, const double* a, const double* b, bool broadcast,    \
+        int length)                                                                                \
+    {                                                                                              \
+        const __m256d scalar = broadcast ? _mm256_set1_pd(b[0]) : _mm256_setzero_pd();             \
+        int i = 0;                                                                                 \
+        for (; i + 4 <= length; i += 4) {                                                          \
+            __m256d y = broadcast ? scalar : _mm256_loadu_pd(b + i);                               \
+            _mm256_storeu_pd(dest + i, operation(_mm256_loadu_pd(a + i), y));                      \
+        }                                                                                          \
+        name##Scalar(dest + i, a + i, broadcast ? b : b + i, broadcast, length - i);               \
+    }
+
+DEFINE_APPLY_AVX2(add, _mm256_add_pd)
+DEFINE_APPLY_AVX2(subtract, _mm256_sub_pd)
+DEFINE_APPLY_AVX2(multiply, _mm256_mul_pd)
+DEFINE_APPLY_AVX2(divide, _mm256_div_pd)
+DEFINE_APPLY_AVX2(less, lessAvx2Op)
+DEFINE_APPLY_AVX2(greater, greaterAvx2Op)
+DEFINE_APPLY_AVX2(equal, equalAvx2Op)
+#endif
+
+static ReduceFn sumKernel = sumScalar;
+static ReduceFn dotKernel = dotScalar;
+static ReduceFn minKernel = minScalar;
+static ReduceFn maxKernel = maxScalar;
+static AxpyFn axpyKernel = axpyScalar;
+// indexed by NumberOp
+static ApplyFn applyKernels[] = {
+    addScalar,
+    subtractScalar,
+    multiplyScalar,
+    divideScalar,
+    lessScalar,
+    greaterScalar,
+    equalScalar,
+};
+
+void initNumberKernels()
+{
+#ifdef __SSE2__
+    sumKernel = sumSse2;
+    dotKernel = dotSse2;
+    minKernel = minSse2;
+    maxKernel = maxSse2;
+    axpyKernel = axpySse2;
+    applyKernels[NUMBER_ADD] = addSse2;
+    applyKernels[NUMBER_SUBTRACT] = subtractSse2;
+    applyKernels[NUMBER_MULTIPLY] = multiplySse2;
+    applyKernels[NUMBER_DIVIDE] = divideSse2;
+    applyKernels[NUMBER_LESS] = lessSse2;
+    applyKernels[NUMBER_GREATER] = greaterSse2;
+    applyKernels[NUMBER_EQUAL] = equalSse2;
+#endif
+#ifdef CPU_X86
+    if (cpuHasAvx2()) {
+        sumKernel = sumAvx2;
+        dotKernel = dotAvx2;
+        minKernel = minAvx2;
+        maxKernel = maxAvx2;
+        axpyKernel = axpyAvx2;
+        applyKernels[NUMBER_ADD] = addAvx2;
+        applyKernels[NUMBER_SUBTRACT] = subtractAvx2;
+        applyKernels[NUMBER_MULTIPLY] = multiplyAvx2;
+        applyKernels[NUMBER_DIVIDE] = divideAvx2;
+        applyKernels[NUMBER_LESS] = lessAvx2;
+        applyKernels[NUMBER_GREATER] = greaterAvx2;
+        applyKernels[NUMBER_EQUAL] = equalAvx2;
+    }
+#endif
+}
+
+double sumNumbers(const double* numbers, int length)
+{
+    return sumKernel(numbers, NULL, length);
+}
+
+double dotNumbers(const double* a, const double* b, int length)
+{
+    return dotKernel(a, b, length);
+}
+
+double minNumbers(const double* numbers, int length)
+{
+    return minKernel(numbers, NULL, length);
+}
+
+double maxNumbers(const double* numbers, int length)
+{
+    return maxKernel(numbers, NULL, length);
+}
+
+void axpyNumbers(double* dest, double alpha, const double* x, const double* y, int length)
+{
+    axpyKernel(dest, alpha, x, y, length);
+}
+
+void applyNumbers(
+    NumberOp op, double* dest, const double* a, const double* b, bool broadcast, int length)
+{
+    applyKernels[op](dest, a, b, broadcast, length);
+}
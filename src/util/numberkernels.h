@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../common.h"
+
+typedef enum {
+    NUMBER_ADD,
+    NUMBER_SUBTRACT,
+    NUMBER_MULTIPLY,
+    NUMBER_DIVIDE,
+    // comparisons write 1 where they hold and 0 where not
+    NUMBER_LESS,
+    NUMBER_GREATER,
+    NUMBER_EQUAL,
+} NumberOp;
+
+// Selects the fastest kernels the cpu supports. Falls back to the scalar
+// implementations, when never called.
+void initNumberKernels();
+
+double sumNumbers(const double* numbers, int length);
+double dotNumbers(const double* a, const double* b, int length);
+// Smallest and largest number of a non-empty array.
+double minNumbers(const double* numbers, int length);
+double maxNumbers(const double* numbers, int length);
+
+// dest = alpha * x + y
+void axpyNumbers(double* dest, double alpha, const double* x, const double* y, int length);
+// Applies op elementwise. With broadcast set, b points to a single number used for every element.
+void applyNumbers(NumberOp op, double* dest, const double* a, const double* b, bool broadcast,
+    int length);
@@ -0,0 +1,74 @@
+#include <string.h>
+
+#include "sort.h"
+#include "../values/object.h"
+
+#define SORT_NAME(name) numbers##name
+#define SORT_TYPE double
+#define SORT_LESS(context, a, b) ((void)(context), (a) < (b))
+#define SORT_BRANCHLESS 1
+#include "pdqsort.inc"
+#undef SORT_NAME
+#undef SORT_TYPE
+#undef SORT_LESS
+#undef SORT_BRANCHLESS
+
+static inline bool stringLess(const ObjString* a, const ObjString* b)
+{
+    int length = a->length < b->length ? a->length : b->length;
+    int compared = memcmp(a->chars, b->chars, length);
+    return compared < 0 || (compared == 0 && a->length < b->length);
+}
+
+#define SORT_NAME(name) strings##name
+#define SORT_TYPE Value
+#define SORT_LESS(context, a, b) ((void)(context), stringLess(AS_STRING(a), AS_STRING(b)))
+#define SORT_BRANCHLESS 0
+#include "pdqsort.inc"
+#undef SORT_NAME
+#undef SORT_TYPE
+#undef SORT_LESS
+#undef SORT_BRANCHLESS
+
+typedef struct {
+    ValueLess less;
+    void* context;
+} ValueComparator;
+
+#define SORT_NAME(name) values##name
+#define SORT_TYPE Value
+#define SORT_LESS(comparator, a, b)                                                                \
+    ((ValueComparator*)(comparator))->less(((ValueComparator*)(comparator))->context, a, b)
+#define SORT_BRANCHLESS 0
+#include "pdqsort.inc"
+#undef SORT_NAME
+#undef SORT_TYPE
+#undef SORT_LESS
+#undef SORT_BRANCHLESS
+
+void sortNumbers(double* numbers, unsigned int count)
+{
+    // NaNs compare false with everything, move them out of the way first
+    unsigned int end = count;
+    for (unsigned int i = 0; i < end;) {
+        if (numbers[i] != numbers[i]) {
+            double nan = numbers[i];
+            numbers[i] = numbers[--end];
+            numbers[end] = nan;
+        } else {
+            i++;
+        }
+    }
+    numbersSort(NULL, numbers, numbers + end);
+}
+
+void sortStrings(Value* strings, unsigned int count)
+{
+    stringsSort(NULL, strings, strings + count);
+}
+
+void sortValues(Value* values, unsigned int count, ValueLess less, void* context)
+{
+    ValueComparator comparator = { less, context };
+    valuesSort(&comparator, values, values + count);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "../common.h"
+#include "../values/value.h"
+
+// Returns true, if a sorts before b. Callbacks that fail can keep returning false, the sort still
+// terminates.
+typedef bool (*ValueLess)(void* context, Value a, Value b);
+
+// Ascending, with NaNs last.
+void sortNumbers(double* numbers, unsigned int count);
+// Byte-wise ascending. All values have to be strings.
+void sortStrings(Value* strings, unsigned int count);
+void sortValues(Value* values, unsigned int count, ValueLess less, void* context);
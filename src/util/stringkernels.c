@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "stringkernels.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+typedef int (*FindFn)(const char* haystack, int length, const char* needle, int needleLength);
+typedef void (*FlipCaseFn)(char* dest, const char* src, int length, char low, char high);
+
+static int findScalar(
+    const char* haystack, int length, const char* needle, int needleLength, int from)
+{
+    const char* end = haystack + length - needleLength + 1;
+    const char* cursor = haystack + from;
+
+    while (cursor < end) {
+        cursor = memchr(cursor, needle[0], end - cursor);
+        if (cursor == NULL) {
+            return -1;
+        }
+        if (memcmp(cursor + 1, needle + 1, needleLength - 1) == 0) {
+            return (int)(cursor - haystack);
+        }
+        cursor++;
+    }
+    return -1;
+}
+
+static int findGeneric(const char* haystack, int length, const char* needle, int needleLength)
+{
+    return findScalar(haystack, length, needle, needleLength, 0);
+}
+
+static void flipCaseScalar(char* dest, const char* src, int length, char low, char high)
+{
+    for (int i = 0; i < length; i++) {
+        char c = src[i];
+        dest[i] = (c >= low && c <= high) ? (char)(c ^ 0x20) : c;
+    }
+}
+
+// The vector kernels compare the first and the last byte of the needle against a whole block of
+// candidate positions at once and only verify the positions where both of them match.
+#ifdef __SSE2__
+static int findSse2(const char* haystack, int length, const char* needle, int needleLength)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+    int starts = length - needleLength + 1;
+
+    int i = 0;
+    for (; i + 16 <= starts; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i*)(haystack + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i*)(haystack + i + needleLength - 1));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+
+        while (mask != 0) {
+            int offset = i + __builtin_ctz(mask);
+            if (memcmp(haystack + offset + 1, needle + 1, needleLength - 2) == 0) {
+                return offset;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(haystack, length, needle, needleLength, i);
+}
+
+static void flipCaseSse2(char* dest, const char* src, int length, char low, char high)
+{
+    const __m128i below = _mm_set1_epi8((char)(low - 1));
+    const __m128i above = _mm_set1_epi8((char)(high + 1));
+    const __m128i flip = _mm_set1_epi8(0x20);
+
+    int i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i inRange = _mm_and_si128(_mm_cmpgt_epi8(block, below), _mm_cmplt_epi8(block, above));
+        block = _mm_xor_si128(block, _mm_and_si128(inRange, flip));
+        _mm_storeu_si128((__m128i*)(dest + i), block);
+    }
+    flipCaseScalar(dest + i, src + i, length - i, low, high);
+}
+#endif
+
+#ifdef CPU_X86
+__attribute__((target("avx2"))) static int findAvx2(
+    const char* haystack, int length, const char* needle, int needleLength)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+    int starts = length - needleLength + 1;
+
+    int i = 0;
+    for (; i + 32 <= starts; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(haystack + i));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i*)(haystack + i + needleLength - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast)));
+
+        while (mask != 0) {
+            int offset = i + __builtin_ctz(mask);
+            if (memcmp(haystack + offset + 1, needle + 1, needleLength - 2) == 0) {
+                return offset;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(haystack, length, needle, needleLength, i);
+}
+
+__attribute__((target("avx2"))) static void flipCaseAvx2(
+    char* dest, const char* src, int length, char low, char high)
+{
+    const __m256i below = _mm256_set1_epi8((char)(low - 1));
+    const __m256i above = _mm256_set1_epi8((char)(high + 1));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i inRange
+            = _mm256_and_si256(_mm256_cmpgt_epi8(block, below), _mm256_cmpgt_epi8(above, block));
+        block = _mm256_xor_si256(block, _mm256_and_si256(inRange, flip));
+        _mm256_storeu_si256((__m256i*)(dest + i), block);
+    }
+    flipCaseScalar(dest + i, src + i, length - i, low, high);
+}
+#endif
+
+static FindFn findKernel = findGeneric;
+static FlipCaseFn flipCaseKernel = flipCaseScalar;
+
+void initStringKernels()
+{
+#ifdef __SSE2__
+    findKernel = findSse2;
+    flipCaseKernel = flipCaseSse2;
+#endif
+#ifdef CPU_X86
+    if (cpuHasAvx2()) {
+        findKernel = findAvx2;
+        flipCaseKernel = flipCaseAvx2;
+    }
+#endif
+}
+
+int findSubstring(const char* haystack, int length, const char* needle, int needleLength)
+{
+    if (needleLength == 0) {
+        return 0;
+    }
+    if (needleLength > length) {
+        return -1;
+    }
+    if (needleLength == 1) {
+        const char* found = memchr(haystack, needle[0], length);
+        return found == NULL ? -1 : (int)(found - haystack);
+    }
+    return findKernel(haystack, length, needle, needleLength);
+}
+
+int countSubstring(const char* haystack, int length, const char* needle, int needleLength)
+{
+    int count = 0;
+    int offset = 0;
+    for (;;) {
+        int found = findSubstring(haystack + offset, length - offset, needle, needleLength);
+        if (found == -1) {
+            return count;
+        }
+        count++;
+        offset += found + needleLength;
+    }
+}
+
+void asciiToUpper(char* dest, const char* src, int length)
+{
+    flipCaseKernel(dest, src, length, 'a', 'z');
+}
+
+void asciiToLower(char* dest, const char* src, int length)
+{
+    flipCaseKernel(dest, src, length, 'A', 'Z');
+}
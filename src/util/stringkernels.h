@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../common.h"
+
+// Selects the fastest kernels the cpu supports. Falls back to the scalar
+// implementations, when never called.
+void initStringKernels();
+
+// Offset of the first occurrence of needle in haystack or -1.
+int findSubstring(const char* haystack, int length, const char* needle, int needleLength);
+// Count of non overlapping occurrences of needle (needs to be non-empty).
+int countSubstring(const char* haystack, int length, const char* needle, int needleLength);
+
+void asciiToUpper(char* dest, const char* src, int length);
+void asciiToLower(char* dest, const char* src, int length);
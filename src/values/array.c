@@ -0,0 +1,172 @@
+#include "array.h"
+#include "../util/memory.h"
+#include "../vm.h"
+
+void arrayBoxNumbers(ObjArray* array)
+{
+    if (array->kind != ARRAY_NUMBERS) {
+        return;
+    }
+    if (array->shared != NULL) {
+        arrayUnshare(array);
+    }
+#ifdef NAN_BOXING
+    // a boxed number has the same bits as the double
+    array->kind = ARRAY_VALUES;
+#else
+    Value* values = ALLOCATE(Value, array->capacity);
+    for (unsigned int i = 0; i < array->count; i++) {
+        values[i] = NUMBER_VAL(array->as.numbers[i]);
+    }
+    FREE_ARRAY(double, array->as.numbers, array->capacity);
+
+    array->as.values = values;
+    array->kind = ARRAY_VALUES;
+#endif
+}
+
+ObjArray* newNumberArray(unsigned int count)
+{
+    ObjArray* array = newArray();
+    push(OBJ_VAL(array));
+    array->as.numbers = ALLOCATE(double, count);
+    array->capacity = count;
+    array->count = count;
+    pop();
+    return array;
+}
+
+bool arrayPackNumbers(ObjArray* array)
+{
+    if (array->kind == ARRAY_NUMBERS) {
+        return true;
+    }
+    for (unsigned int i = 0; i < array->count; i++) {
+        if (!IS_NUMBER(arrayGet(array, i))) {
+            return false;
+        }
+    }
+    if (array->shared != NULL) {
+        arrayUnshare(array);
+    }
+
+#ifdef NAN_BOXING
+    array->kind = ARRAY_NUMBERS;
+#else
+    double* numbers = ALLOCATE(double, array->capacity);
+    for (unsigned int i = 0; i < array->count; i++) {
+        numbers[i] = AS_NUMBER(array->as.values[i]);
+    }
+    FREE_ARRAY(Value, array->as.values, array->capacity);
+
+    array->as.numbers = numbers;
+    array->kind = ARRAY_NUMBERS;
+#endif
+    return true;
+}
+
+ObjArray* newArrayView(ObjArray* array, unsigned int start, unsigned int count, unsigned int stride)
+{
+    if (array->shared == NULL) {
+        // the storage moves to a hidden array, that lives as long as anything still shares it
+        ObjArray* storage = newArray();
+        storage->kind = array->kind;
+        storage->count = array->count;
+        storage->capacity = array->capacity;
+        storage->as = array->as;
+        array->shared = storage;
+    }
+
+    ObjArray* view = newArray();
+    view->kind = array->kind;
+    view->count = count;
+    view->capacity = count;
+    view->stride = array->stride * stride;
+    if (array->kind == ARRAY_NUMBERS) {
+        view->as.numbers = array->as.numbers + (size_t)start * array->stride;
+    } else {
+        view->as.values = array->as.values + (size_t)start * array->stride;
+    }
+    view->shared = array->shared;
+    return view;
+}
+
+void arrayUnshare(ObjArray* array)
+{
+    // the shared storage stays reachable through the array, while the copy allocates
+    if (array->kind == ARRAY_NUMBERS) {
+        double* numbers = ALLOCATE(double, array->count);
+        for (unsigned int i = 0; i < array->count; i++) {
+            numbers[i] = array->as.numbers[i * array->stride];
+        }
+        array->as.numbers = numbers;
+    } else {
+        Value* values = ALLOCATE(Value, array->count);
+        for (unsigned int i = 0; i < array->count; i++) {
+            values[i] = array->as.values[i * array->stride];
+        }
+        array->as.values = values;
+    }
+    array->capacity = array->count;
+    array->stride = 1;
+    array->shared = NULL;
+}
+
+void arrayPush(ObjArray* array, Value value)
+{
+    if (array->shared != NULL) {
+        arrayUnshare(array);
+    }
+    if (array->kind == ARRAY_NUMBERS && !IS_NUMBER(value)) {
+        arrayBoxNumbers(array);
+    }
+
+    if (array->capacity < array->count + 1) {
+        unsigned int oldCapacity = array->capacity;
+        array->capacity = GROW_CAPACITY(oldCapacity);
+        if (array->kind == ARRAY_NUMBERS) {
+            array->as.numbers
+                = GROW_ARRAY(double, array->as.numbers, oldCapacity, array->capacity);
+        } else {
+            array->as.values = GROW_ARRAY(Value, array->as.values, oldCapacity, array->capacity);
+        }
+    }
+
+    if (array->kind == ARRAY_NUMBERS) {
+        array->as.numbers[array->count] = AS_NUMBER(value);
+    } else {
+        array->as.values[array->count] = value;
+    }
+    array->count++;
+}
+
+void freeArrayStorage(ObjArray* array)
+{
+    // shared storage is freed together with the array owning it
+    if (array->shared == NULL) {
+        if (array->kind == ARRAY_NUMBERS) {
+            FREE_ARRAY(double, array->as.numbers, array->capacity);
+        } else {
+            FREE_ARRAY(Value, array->as.values, array->capacity);
+        }
+    }
+    array->count = 0;
+    array->capacity = 0;
+    array->as.values = NULL;
+    array->stride = 1;
+    array->shared = NULL;
+}
+
+void markArray(ObjArray* array)
+{
+    if (array->shared != NULL) {
+        markObject((Obj*)array->shared);
+        return;
+    }
+    if (array->kind == ARRAY_NUMBERS) {
+        return;
+    }
+    for (unsigned int i = 0; i < array->count; i++) {
+        markValue(array->as.values[i]);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../common.h"
+#include "object.h"
+#include "value.h"
+
+// A packed number array of the given length, with uninitialized elements.
+ObjArray* newNumberArray(unsigned int count);
+// Switches an array back to packed numbers. Fails, if it holds anything else.
+bool arrayPackNumbers(ObjArray* array);
+
+// Boxes all elements. The array has to be reachable, because this allocates.
+void arrayBoxNumbers(ObjArray* array);
+// A view of count elements, starting at start and stride elements apart. It shares the storage,
+// until either side is written to.
+ObjArray* newArrayView(ObjArray* array, unsigned int start, unsigned int count, unsigned int stride);
+// Copies shared storage, so the array can be written to or read as a contiguous block.
+void arrayUnshare(ObjArray* array);
+
+void arrayPush(ObjArray* array, Value value);
+
+void freeArrayStorage(ObjArray* array);
+void markArray(ObjArray* array);
+
+static inline Value arrayGet(const ObjArray* array, unsigned int index)
+{
+    if (array->kind == ARRAY_NUMBERS) {
+        return NUMBER_VAL(array->as.numbers[index * array->stride]);
+    }
+    return array->as.values[index * array->stride];
+}
+
+static inline void arraySet(ObjArray* array, unsigned int index, Value value)
+{
+    if (array->shared != NULL) {
+        arrayUnshare(array);
+    }
+    if (array->kind == ARRAY_NUMBERS) {
+        if (IS_NUMBER(value)) {
+            array->as.numbers[index] = AS_NUMBER(value);
+            return;
+        }
+        arrayBoxNumbers(array);
+    }
+    array->as.values[index] = value;
+}
@@ -0,0 +1,197 @@
+#include "map.h"
+#include "../util/memory.h"
+#include "../vm.h"
+
+#define SLOT_EMPTY -1
+#define SLOT_DELETED -2
+
+// Spreads the bits of numbers and pointers, whose low bits are often all the same.
+static uint32_t mixBits(uint64_t bits)
+{
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    bits *= 0xc4ceb9fe1a85ec53ULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+static uint32_t hashValue(Value key)
+{
+    if (IS_NUMBER(key)) {
+        double number = AS_NUMBER(key);
+        if (number == 0) {
+            // -0 equals 0, so it has to hash the same
+            number = 0;
+        }
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return mixBits(bits);
+    }
+    if (IS_STRING(key)) {
+        return AS_STRING(key)->hash;
+    }
+    if (IS_STRUCT(key)) {
+        // equal structs are different objects, so they hash by their fields
+        const ObjStruct* element = AS_STRUCT(key);
+        uint64_t hash = (uintptr_t)element->type;
+        for (int i = 0; i < element->fieldCount; i++) {
+            hash = hash * 31 + hashValue(element->fields[i]);
+        }
+        return mixBits(hash);
+    }
+    if (IS_OBJ(key)) {
+        return mixBits((uint64_t)(uintptr_t)AS_OBJ(key));
+    }
+    // only booleans are left
+    return AS_BOOL(key) ? 1 : 2;
+}
+
+bool isMapKey(Value key)
+{
+    if (IS_NUMBER(key)) {
+        return AS_NUMBER(key) == AS_NUMBER(key);
+    }
+    return !IS_NIL(key);
+}
+
+// The slot holding the key, or the slot to insert it into. There is always an empty slot, because
+// there are twice as many slots as entries.
+static int32_t* findSlot(int32_t* slots, int slotCount, const MapEntry* entries, Value key,
+    uint32_t hash)
+{
+    uint32_t mask = (uint32_t)slotCount - 1;
+    uint32_t index = hash & mask;
+    int32_t* tombstone = NULL;
+    for (;;) {
+        int32_t* slot = &slots[index];
+        if (*slot == SLOT_EMPTY) {
+            return tombstone != NULL ? tombstone : slot;
+        }
+        if (*slot == SLOT_DELETED) {
+            if (tombstone == NULL) {
+                tombstone = slot;
+            }
+        } else if (valuesEqual(entries[*slot].key, key)) {
+            return slot;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+// Moves the live entries into new storage of the given capacity, dropping deleted entries.
+static void resize(ObjMap* map, int capacity)
+{
+    MapEntry* entries = ALLOCATE(MapEntry, capacity);
+    int32_t* slots = ALLOCATE(int32_t, capacity * 2);
+    for (int i = 0; i < capacity * 2; i++) {
+        slots[i] = SLOT_EMPTY;
+    }
+
+    int count = 0;
+    for (int i = 0; i < map->entryCount; i++) {
+        MapEntry* entry = &map->entries[i];
+        if (IS_NIL(entry->key)) {
+            continue;
+        }
+        entries[count] = *entry;
+        *findSlot(slots, capacity * 2, entries, entry->key, hashValue(entry->key)) = count;
+        count++;
+    }
+
+    FREE_ARRAY(MapEntry, map->entries, map->entryCapacity);
+    FREE_ARRAY(int32_t, map->slots, map->entryCapacity * 2);
+    map->entries = entries;
+    map->slots = slots;
+    map->entryCount = count;
+    map->entryCapacity = capacity;
+}
+
+void mapReserve(ObjMap* map, int count)
+{
+    int needed = map->count + count;
+    if (needed <= map->entryCapacity) {
+        return;
+    }
+    int capacity = GROW_CAPACITY(0);
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    resize(map, capacity);
+}
+
+bool mapGet(const ObjMap* map, Value key, Value* value)
+{
+    if (map->count == 0) {
+        return false;
+    }
+    int32_t* slot
+        = findSlot(map->slots, map->entryCapacity * 2, map->entries, key, hashValue(key));
+    if (*slot < 0) {
+        return false;
+    }
+    *value = map->entries[*slot].value;
+    return true;
+}
+
+bool mapSet(ObjMap* map, Value key, Value value)
+{
+    uint32_t hash = hashValue(key);
+    if (map->count > 0) {
+        int32_t* slot = findSlot(map->slots, map->entryCapacity * 2, map->entries, key, hash);
+        if (*slot >= 0) {
+            map->entries[*slot].value = value;
+            return false;
+        }
+    }
+
+    if (map->entryCount == map->entryCapacity) {
+        // compact, when at least half of the entries are deleted
+        bool compact = map->count < map->entryCapacity / 2;
+        resize(map, compact ? map->entryCapacity : GROW_CAPACITY(map->entryCapacity));
+    }
+
+    int32_t* slot = findSlot(map->slots, map->entryCapacity * 2, map->entries, key, hash);
+    *slot = map->entryCount;
+    map->entries[map->entryCount].key = key;
+    map->entries[map->entryCount].value = value;
+    map->entryCount++;
+    map->count++;
+    return true;
+}
+
+bool mapDelete(ObjMap* map, Value key)
+{
+    if (map->count == 0) {
+        return false;
+    }
+    int32_t* slot
+        = findSlot(map->slots, map->entryCapacity * 2, map->entries, key, hashValue(key));
+    if (*slot < 0) {
+        return false;
+    }
+    map->entries[*slot].key = NIL_VAL;
+    map->entries[*slot].value = NIL_VAL;
+    *slot = SLOT_DELETED;
+    map->count--;
+    return true;
+}
+
+void freeMapStorage(ObjMap* map)
+{
+    FREE_ARRAY(MapEntry, map->entries, map->entryCapacity);
+    FREE_ARRAY(int32_t, map->slots, map->entryCapacity * 2);
+    map->count = 0;
+    map->entryCount = 0;
+    map->entryCapacity = 0;
+    map->entries = NULL;
+    map->slots = NULL;
+}
+
+void markMap(ObjMap* map)
+{
+    for (int i = 0; i < map->entryCount; i++) {
+        markValue(map->entries[i].key);
+        markValue(map->entries[i].value);
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../common.h"
+#include "object.h"
+#include "value.h"
+
+// nil and NaN can not be keys, everything else can. Numbers are compared by value, strings by
+// their characters (they are interned) and all other objects by identity.
+bool isMapKey(Value key);
+
+// Makes room for count entries, so that inserting them does not resize the map again.
+void mapReserve(ObjMap* map, int count);
+
+bool mapGet(const ObjMap* map, Value key, Value* value);
+// Returns true, if the key was not in the map yet. The map has to be reachable, because this
+// allocates.
+bool mapSet(ObjMap* map, Value key, Value value);
+bool mapDelete(ObjMap* map, Value key);
+
+void freeMapStorage(ObjMap* map);
+void markMap(ObjMap* map);
@@ -2,6 +2,9 @@
 #include <string.h>
 
 #include "../util/memory.h"
+#include "array.h"
+#include "map.h"
+#include "struct.h"
 #include "object.h"
 #include "../table.h"
 #include "value.h"
@@ -66,7 +69,12 @@ static uint32_t hashString(const char* key, int length)
 ObjArray* newArray()
 {
     ObjArray* array = ALLOCATE_OBJ(ObjArray, OBJ_ARRAY);
-    initValueArray(&array->valueArray);
+    array->kind = ARRAY_NUMBERS;
+    array->count = 0;
+    array->capacity = 0;
+    array->stride = 1;
+    array->as.values = NULL;
+    array->shared = NULL;
     return array;
 }
 
@@ -86,14 +94,66 @@ ObjInstance* newInstance(ObjClass* klass)
     return instance;
 }
 
+ObjIterator* newIterator(IteratorKind kind, Value source)
+{
+    ObjIterator* iterator = ALLOCATE_OBJ(ObjIterator, OBJ_ITERATOR);
+    iterator->kind = kind;
+    iterator->source = source;
+    iterator->upstream = NULL;
+    iterator->other = NULL;
+    iterator->depth = 0;
+    iterator->position = 0;
+    iterator->end = 0;
+    iterator->step = 1;
+    return iterator;
+}
+
+ObjMap* newMap()
+{
+    ObjMap* map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+    map->count = 0;
+    map->entryCount = 0;
+    map->entryCapacity = 0;
+    map->entries = NULL;
+    map->slots = NULL;
+    return map;
+}
+
 ObjClass* newClass(ObjString* name)
 {
     ObjClass* klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
     klass->name = name;
-    initTable(&klass->methods);
+    initValueArray(&klass->methods);
+    klass->methodsOwner = klass;
     return klass;
 }
 
+// Only called before the class body ran, so the class has no methods of its own yet. The shared
+// methods are never changed, because classes only get methods while their body runs.
+void inheritMethods(ObjClass* klass, ObjClass* superclass)
+{
+    klass->methods = superclass->methods;
+    klass->methodsOwner = superclass->methodsOwner;
+}
+
+void setMethod(ObjClass* klass, uint32_t selector, Value method)
+{
+    if (klass->methodsOwner != klass) {
+        // the inherited values stay reachable through their owner while copying
+        Value* values = ALLOCATE(Value, klass->methods.capacity);
+        if (klass->methods.count > 0) {
+            memcpy(values, klass->methods.values, sizeof(Value) * klass->methods.count);
+        }
+        klass->methods.values = values;
+        klass->methodsOwner = klass;
+    }
+
+    while (klass->methods.count <= selector) {
+        writeValueArray(&klass->methods, NIL_VAL);
+    }
+    klass->methods.values[selector] = method;
+}
+
 ObjClosure* newClosure(ObjFunction* function)
 {
     ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*, function->upvalueCount);
@@ -101,20 +161,40 @@ ObjClosure* newClosure(ObjFunction* function)
         upvalues[i] = NULL;
     }
 
+    Value* captured = ALLOCATE(Value, function->capturedCount);
+    for (int i = 0; i < function->capturedCount; i++) {
+        captured[i] = NIL_VAL;
+    }
+
     ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
     closure->function = function;
     closure->upvalues = upvalues;
     closure->upvalueCount = function->upvalueCount;
+    closure->captured = captured;
+    closure->capturedCount = function->capturedCount;
 
     return closure;
 }
 
+ObjFrame* newFrame(ObjMap* columns, unsigned int rowCount)
+{
+    ObjFrame* frame = ALLOCATE_OBJ(ObjFrame, OBJ_FRAME);
+    frame->rowCount = rowCount;
+    frame->columns = columns;
+    return frame;
+}
+
 ObjFunction* newFunction()
 {
     ObjFunction* function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
     function->arity = 0;
     function->upvalueCount = 0;
+    function->capturedCount = 0;
     function->name = NULL;
+    function->lazy.chars = NULL;
+    function->lazy.length = 0;
+    function->lazy.line = 0;
+    function->lazy.isMethod = false;
     initChunk(&function->chunk);
     return function;
 }
@@ -126,6 +206,39 @@ ObjNative* newNative(NativeFn function)
     return native;
 }
 
+ObjStructType* newStructType(ObjString* name)
+{
+    ObjStructType* type = ALLOCATE_OBJ(ObjStructType, OBJ_STRUCT_TYPE);
+    type->name = name;
+    type->fieldCount = 0;
+    type->slots = NULL;
+    type->slotCount = 0;
+    return type;
+}
+
+ObjStruct* newStruct(ObjStructType* type)
+{
+    ObjStruct* object = (ObjStruct*)allocateObject(
+        sizeof(ObjStruct) + type->fieldCount * sizeof(Value), OBJ_STRUCT);
+    object->type = type;
+    object->fieldCount = type->fieldCount;
+    for (int i = 0; i < type->fieldCount; i++) {
+        object->fields[i] = NIL_VAL;
+    }
+    return object;
+}
+
+ObjStructArray* newStructArray(ObjStructType* type)
+{
+    ObjStructArray* array = ALLOCATE_OBJ(ObjStructArray, OBJ_STRUCT_ARRAY);
+    array->type = type;
+    array->fieldCount = type->fieldCount;
+    array->count = 0;
+    array->capacity = 0;
+    array->fields = NULL;
+    return array;
+}
+
 ObjString* takeString(char* chars, int length)
 {
     uint32_t hash = hashString(chars, length);
@@ -171,12 +284,47 @@ const char* objectGet(Value receiver, Value address, Value* value)
         }
 
         ObjArray* array = AS_ARRAY(receiver);
-        uint64_t index = (uint64_t)AS_NUMBER(address);
-        if (index >= array->valueArray.count) {
+        double index = AS_NUMBER(address);
+        if (!(index >= 0 && index < array->count)) {
             return "Index out of bounds.";
         }
 
-        *value = array->valueArray.values[index];
+        *value = arrayGet(array, (unsigned int)index);
+        return NULL;
+    }
+    if (IS_STRUCT_ARRAY(receiver)) {
+        if (!IS_NUMBER(address)) {
+            return "Arrays index needs to be of type Number.";
+        }
+
+        ObjStructArray* array = AS_STRUCT_ARRAY(receiver);
+        double index = AS_NUMBER(address);
+        if (!(index >= 0 && index < array->count)) {
+            return "Index out of bounds.";
+        }
+
+        *value = OBJ_VAL(structArrayGet(array, (unsigned int)index));
+        return NULL;
+    }
+    if (IS_MAP(receiver)) {
+        // missing keys read as nil
+        if (!mapGet(AS_MAP(receiver), address, value)) {
+            *value = NIL_VAL;
+        }
+        return NULL;
+    }
+    if (IS_STRING(receiver)) {
+        if (!IS_NUMBER(address)) {
+            return "String index needs to be of type Number.";
+        }
+
+        ObjString* string = AS_STRING(receiver);
+        double index = AS_NUMBER(address);
+        if (!(index >= 0 && index < string->length)) {
+            return "Index out of bounds.";
+        }
+
+        *value = OBJ_VAL(copyString(string->chars + (int)index, 1));
         return NULL;
     }
     return "Value can not accessed with [].";
@@ -190,12 +338,37 @@ const char* objectSet(Value receiver, Value address, Value value)
         }
 
         ObjArray* array = AS_ARRAY(receiver);
-        uint64_t index = (uint64_t)AS_NUMBER(address);
-        if (index >= array->valueArray.count) {
+        double index = AS_NUMBER(address);
+        if (!(index >= 0 && index < array->count)) {
+            return "Index out of bounds.";
+        }
+
+        arraySet(array, (unsigned int)index, value);
+        return NULL;
+    }
+    if (IS_STRUCT_ARRAY(receiver)) {
+        if (!IS_NUMBER(address)) {
+            return "Arrays index needs to be of type Number.";
+        }
+
+        ObjStructArray* array = AS_STRUCT_ARRAY(receiver);
+        double index = AS_NUMBER(address);
+        if (!(index >= 0 && index < array->count)) {
             return "Index out of bounds.";
         }
+        if (!IS_STRUCT(value) || AS_STRUCT(value)->type != array->type) {
+            return "Struct arrays only hold structs of their type.";
+        }
+
+        structArraySet(array, (unsigned int)index, AS_STRUCT(value));
+        return NULL;
+    }
+    if (IS_MAP(receiver)) {
+        if (!isMapKey(address)) {
+            return "Map key can not be nil or NaN.";
+        }
 
-        array->valueArray.values[index] = value;
+        mapSet(AS_MAP(receiver), address, value);
         return NULL;
     }
     return "Value can not accessed with [].";
@@ -213,15 +386,47 @@ static void printFunction(ObjFunction* function)
 static void printArray(ObjArray* array)
 {
     printf("[");
-    for (unsigned int i = 0; i < array->valueArray.count; i++) {
-        printValue(array->valueArray.values[i]);
-        if (i != array->valueArray.count - 1) {
+    for (unsigned int i = 0; i < array->count; i++) {
+        printValue(arrayGet(array, i));
+        if (i != array->count - 1) {
             printf(", ");
         }
     }
     printf("]");
 }
 
+static void printMap(ObjMap* map)
+{
+    printf("{");
+    bool first = true;
+    for (int i = 0; i < map->entryCount; i++) {
+        MapEntry* entry = &map->entries[i];
+        if (IS_NIL(entry->key)) {
+            continue;
+        }
+        if (!first) {
+            printf(", ");
+        }
+        printValue(entry->key);
+        printf(": ");
+        printValue(entry->value);
+        first = false;
+    }
+    printf("}");
+}
+
+static void printStruct(const ObjStructType* type, const Value* fields)
+{
+    printf("%s(", type->name->chars);
+    for (int i = 0; i < type->fieldCount; i++) {
+        printValue(fields[i]);
+        if (i != type->fieldCount - 1) {
+            printf(", ");
+        }
+    }
+    printf(")");
+}
+
 void printObject(Value value)
 {
     switch (OBJ_TYPE(value)) {
@@ -234,12 +439,21 @@ void printObject(Value value)
     case OBJ_INSTANCE:
         printf("<obj %s>", AS_INSTANCE(value)->klass->name->chars);
         break;
+    case OBJ_ITERATOR:
+        printf("<iterator>");
+        break;
+    case OBJ_MAP:
+        printMap(AS_MAP(value));
+        break;
     case OBJ_CLASS:
         printf("<cls %s>", AS_CLASS(value)->name->chars);
         break;
     case OBJ_CLOSURE:
         printFunction(AS_CLOSURE(value)->function);
         break;
+    case OBJ_FRAME:
+        printf("<frame %u rows>", AS_FRAME(value)->rowCount);
+        break;
     case OBJ_FUNCTION:
         printFunction(AS_FUNCTION(value));
         break;
@@ -249,6 +463,24 @@ void printObject(Value value)
     case OBJ_STRING:
         printf("%s", AS_CSTRING(value));
         break;
+    case OBJ_STRUCT:
+        printStruct(AS_STRUCT(value)->type, AS_STRUCT(value)->fields);
+        break;
+    case OBJ_STRUCT_ARRAY: {
+        const ObjStructArray* array = AS_STRUCT_ARRAY(value);
+        printf("[");
+        for (unsigned int i = 0; i < array->count; i++) {
+            printStruct(array->type, array->fields + i * array->fieldCount);
+            if (i != array->count - 1) {
+                printf(", ");
+            }
+        }
+        printf("]");
+        break;
+    }
+    case OBJ_STRUCT_TYPE:
+        printf("<struct %s>", AS_STRUCT_TYPE(value)->name->chars);
+        break;
     case OBJ_UPVALUE:
         printf("upvalue");
         break;
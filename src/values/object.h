@@ -9,31 +9,49 @@
 #define IS_ARRAY(value) isObjType(value, OBJ_ARRAY)
 #define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
 #define IS_INSTANCE(value) isObjType(value, OBJ_INSTANCE)
+#define IS_ITERATOR(value) isObjType(value, OBJ_ITERATOR)
+#define IS_MAP(value) isObjType(value, OBJ_MAP)
 #define IS_CLASS(value) isObjType(value, OBJ_CLASS)
+#define IS_FRAME(value) isObjType(value, OBJ_FRAME)
 #define IS_CLOSURE(value) isObjType(value, OBJ_CLOSURE)
 #define IS_FUNCTION(value) isObjType(value, OBJ_FUNCTION)
 #define IS_NATIVE(value) isObjType(value, OBJ_NATIVE)
 #define IS_STRING(value) isObjType(value, OBJ_STRING)
+#define IS_STRUCT(value) isObjType(value, OBJ_STRUCT)
+#define IS_STRUCT_ARRAY(value) isObjType(value, OBJ_STRUCT_ARRAY)
+#define IS_STRUCT_TYPE(value) isObjType(value, OBJ_STRUCT_TYPE)
 
 #define AS_ARRAY(value) ((ObjArray*)AS_OBJ(value))
 #define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))
 #define AS_INSTANCE(value) ((ObjInstance*)AS_OBJ(value))
+#define AS_ITERATOR(value) ((ObjIterator*)AS_OBJ(value))
+#define AS_MAP(value) ((ObjMap*)AS_OBJ(value))
 #define AS_CLASS(value) ((ObjClass*)AS_OBJ(value))
+#define AS_FRAME(value) ((ObjFrame*)AS_OBJ(value))
 #define AS_CLOSURE(value) ((ObjClosure*)AS_OBJ(value))
 #define AS_FUNCTION(value) ((ObjFunction*)AS_OBJ(value))
 #define AS_NATIVE(value) (((ObjNative*)AS_OBJ(value))->function)
 #define AS_STRING(value) ((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value) (((ObjString*)AS_OBJ(value))->chars)
+#define AS_STRUCT(value) ((ObjStruct*)AS_OBJ(value))
+#define AS_STRUCT_ARRAY(value) ((ObjStructArray*)AS_OBJ(value))
+#define AS_STRUCT_TYPE(value) ((ObjStructType*)AS_OBJ(value))
 
 typedef enum {
     OBJ_ARRAY,
     OBJ_BOUND_METHOD,
     OBJ_CLASS,
     OBJ_CLOSURE,
+    OBJ_FRAME,
     OBJ_FUNCTION,
     OBJ_INSTANCE,
+    OBJ_ITERATOR,
+    OBJ_MAP,
     OBJ_NATIVE,
     OBJ_STRING,
+    OBJ_STRUCT,
+    OBJ_STRUCT_ARRAY,
+    OBJ_STRUCT_TYPE,
     OBJ_UPVALUE,
 } ObjType;
 
@@ -43,12 +61,22 @@ struct Obj {
     struct Obj* next;
 };
 
+// The source of a function from its parameter list on, which is compiled on the first call.
+typedef struct {
+    char* chars; // NULL, once compiled
+    int length;
+    int line;
+    bool isMethod;
+} LazySource;
+
 typedef struct {
     Obj obj;
     int arity;
     int upvalueCount;
+    int capturedCount;
     Chunk chunk;
     ObjString* name;
+    LazySource lazy;
 } ObjFunction;
 
 typedef Value (*NativeFn)(int argCount, Value* args);
@@ -78,12 +106,18 @@ typedef struct {
     ObjFunction* function;
     ObjUpvalue** upvalues;
     int upvalueCount;
+    // variables that never change after the closure is made, copied into it
+    Value* captured;
+    int capturedCount;
 } ObjClosure;
 
-typedef struct {
+typedef struct ObjClass {
     Obj obj;
     ObjString* name;
-    Table methods;
+    ValueArray methods; // indexed by selector, nil where undefined
+    // Subclasses share the methods of their superclass until they define their own. Only the
+    // owner frees them.
+    struct ObjClass* methodsOwner;
 } ObjClass;
 
 typedef struct {
@@ -98,23 +132,135 @@ typedef struct {
     ObjClosure* method;
 } ObjBoundMethod;
 
-typedef struct {
+typedef enum {
+    ARRAY_NUMBERS, // unboxed doubles, until the first other value is stored
+    ARRAY_VALUES,
+} ArrayKind;
+
+typedef struct ObjArray {
     Obj obj;
-    ValueArray valueArray;
+    ArrayKind kind;
+    unsigned int count;
+    unsigned int capacity;
+    // distance between elements in the storage, only views have a stride other than 1
+    unsigned int stride;
+    union {
+        double* numbers;
+        Value* values;
+    } as;
+    // The array owning the storage, when it is shared with views. Arrays sharing their storage
+    // copy it, before they write to it.
+    struct ObjArray* shared;
 } ObjArray;
 
+typedef struct {
+    Value key; // nil for deleted entries
+    Value value;
+} MapEntry;
+
+typedef struct {
+    Obj obj;
+    int count; // live entries
+    // Entries in insertion order. Deleted entries stay until the next resize.
+    int entryCount;
+    int entryCapacity;
+    MapEntry* entries;
+    // Open addressed positions in entries, twice as many as entryCapacity.
+    int32_t* slots;
+} ObjMap;
+
+typedef enum {
+    // sources
+    ITERATOR_RANGE,
+    ITERATOR_ARRAY,
+    ITERATOR_STRING, // one character strings
+    ITERATOR_KEYS, // the keys of a map
+    // stages
+    ITERATOR_MAP,
+    ITERATOR_FILTER,
+    ITERATOR_TAKE,
+    ITERATOR_ZIP,
+} IteratorKind;
+
+// A lazy sequence. Stages pull their elements from the iterators upstream, one at a time, so a
+// whole pipeline runs in a single pass. Iterators are used up, when they are read.
+typedef struct ObjIterator {
+    Obj obj;
+    IteratorKind kind;
+    // the collection of a source or the function of a stage, nil if there is none
+    Value source;
+    // the iterators a stage reads from, other is only used by zip
+    struct ObjIterator* upstream;
+    struct ObjIterator* other;
+    // the number of stages between this iterator and its deepest source
+    int depth;
+    // the next index or number of a source, the elements left for take
+    double position;
+    double end;
+    double step;
+} ObjIterator;
+
+// A table stored by column. All columns have rowCount elements and are never written to, numbers
+// are packed.
+typedef struct {
+    Obj obj;
+    unsigned int rowCount;
+    // column names to arrays, in the order the columns were given
+    ObjMap* columns;
+} ObjFrame;
+
+typedef struct {
+    Obj obj;
+    ObjString* name;
+    int fieldCount;
+    // field slots indexed by selector, -1 where the selector is no field
+    int* slots;
+    uint32_t slotCount;
+} ObjStructType;
+
+// A value type. Its fields are stored inline and never change after construction, so a struct
+// can be shared or copied without a difference.
+typedef struct {
+    Obj obj;
+    ObjStructType* type;
+    // a copy of the type's, the type may be freed first
+    int fieldCount;
+    Value fields[];
+} ObjStruct;
+
+// Structs of one type, with the fields of all elements stored inline one after the other.
+typedef struct {
+    Obj obj;
+    ObjStructType* type;
+    int fieldCount;
+    unsigned int count;
+    unsigned int capacity;
+    Value* fields;
+} ObjStructArray;
+
 ObjArray* newArray();
 ObjBoundMethod* newBoundMethod(Value receiver, ObjClosure* method);
 ObjInstance* newInstance(ObjClass* klass);
+ObjIterator* newIterator(IteratorKind kind, Value source);
+ObjMap* newMap();
 ObjClass* newClass(ObjString* name);
 ObjClosure* newClosure(ObjFunction* function);
+ObjFrame* newFrame(ObjMap* columns, unsigned int rowCount);
 ObjFunction* newFunction();
 ObjNative* newNative(NativeFn function);
+ObjStructType* newStructType(ObjString* name);
+// A struct with all fields set to nil.
+ObjStruct* newStruct(ObjStructType* type);
+ObjStructArray* newStructArray(ObjStructType* type);
 
 ObjString* takeString(char* chars, int length);
 ObjString* copyString(const char* chars, int length);
 ObjUpvalue* newUpvalue(Value* slot);
 
+void inheritMethods(ObjClass* klass, ObjClass* superclass);
+void setMethod(ObjClass* klass, uint32_t selector, Value method);
+
+// Indexing with []. Returns an error message, when the receiver can not be indexed like that.
 const char* objectGet(Value receiver, Value address, Value* value);
 const char* objectSet(Value receiver, Value address, Value value);
 
@@ -124,4 +270,13 @@ void viewInterned();
 static inline bool isObjType(Value value, ObjType type)
 {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
+}
+
+static inline bool getMethod(const ObjClass* klass, uint32_t selector, Value* method)
+{
+    if (selector >= klass->methods.count || IS_NIL(klass->methods.values[selector])) {
+        return false;
+    }
+    *method = klass->methods.values[selector];
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include <string.h>
+
+#include "struct.h"
+#include "../util/memory.h"
+#include "../vm.h"
+
+bool structAddField(ObjStructType* type, uint32_t selector)
+{
+    if (structSlot(type, selector) >= 0) {
+        return false;
+    }
+    if (selector >= type->slotCount) {
+        uint32_t oldCount = type->slotCount;
+        type->slots = GROW_ARRAY(int, type->slots, oldCount, selector + 1);
+        type->slotCount = selector + 1;
+        for (uint32_t i = oldCount; i < type->slotCount; i++) {
+            type->slots[i] = -1;
+        }
+    }
+    type->slots[selector] = type->fieldCount++;
+    return true;
+}
+
+bool structsEqual(const ObjStruct* a, const ObjStruct* b)
+{
+    if (a->type != b->type) {
+        return false;
+    }
+    for (int i = 0; i < a->fieldCount; i++) {
+        if (!valuesEqual(a->fields[i], b->fields[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void structArrayPush(ObjStructArray* array, const ObjStruct* element)
+{
+    int fieldCount = array->fieldCount;
+    if (array->capacity < array->count + 1) {
+        unsigned int oldCapacity = array->capacity;
+        array->capacity = GROW_CAPACITY(oldCapacity);
+        array->fields = GROW_ARRAY(
+            Value, array->fields, oldCapacity * fieldCount, array->capacity * fieldCount);
+    }
+    array->count++;
+    structArraySet(array, array->count - 1, element);
+}
+
+ObjStruct* structArrayGet(ObjStructArray* array, unsigned int index)
+{
+    ObjStruct* element = newStruct(array->type);
+    int fieldCount = array->fieldCount;
+    memcpy(element->fields, array->fields + index * fieldCount, fieldCount * sizeof(Value));
+    return element;
+}
+
+void structArraySet(ObjStructArray* array, unsigned int index, const ObjStruct* element)
+{
+    int fieldCount = array->fieldCount;
+    memcpy(array->fields + index * fieldCount, element->fields, fieldCount * sizeof(Value));
+}
+
+void freeStructArrayStorage(ObjStructArray* array)
+{
+    FREE_ARRAY(Value, array->fields, array->capacity * array->fieldCount);
+    array->count = 0;
+    array->capacity = 0;
+    array->fields = NULL;
+}
+
+void markStructArray(ObjStructArray* array)
+{
+    markObject((Obj*)array->type);
+    for (unsigned int i = 0; i < array->count * array->fieldCount; i++) {
+        markValue(array->fields[i]);
+    }
+}
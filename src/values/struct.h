@@ -0,0 +1,32 @@
+#pragma once
+
+#include "../common.h"
+#include "object.h"
+#include "value.h"
+
+// Adds the next field slot. Returns false, if the selector already is a field of the type.
+bool structAddField(ObjStructType* type, uint32_t selector);
+
+// Structs are equal, when they have the same type and equal fields.
+bool structsEqual(const ObjStruct* a, const ObjStruct* b);
+
+// Copies the fields of a struct of the array's type into a new element.
+void structArrayPush(ObjStructArray* array, const ObjStruct* element);
+// A copy of the element. The array has to be reachable, because this allocates.
+ObjStruct* structArrayGet(ObjStructArray* array, unsigned int index);
+void structArraySet(ObjStructArray* array, unsigned int index, const ObjStruct* element);
+
+void freeStructArrayStorage(ObjStructArray* array);
+void markStructArray(ObjStructArray* array);
+
+// The slot of the field named by the selector, -1 if there is none.
+static inline int structSlot(const ObjStructType* type, uint32_t selector)
+{
+    return selector < type->slotCount ? type->slots[selector] : -1;
+}
+
+// A field of an element, read in place.
+static inline Value structArrayField(const ObjStructArray* array, unsigned int index, int slot)
+{
+    return array->fields[index * array->fieldCount + slot];
+}
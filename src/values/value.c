@@ -1,7 +1,9 @@
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "object.h"
+#include "struct.h"
 #include "../util/memory.h"
 #include "value.h"
 
@@ -29,6 +31,32 @@ void freeValueArray(ValueArray* array)
     initValueArray(array);
 }
 
+int formatNumber(double number, char* buffer)
+{
+    // %g prints integers below a million as plain digits, these are written directly
+    if (number > -1e6 && number < 1e6 && number == (int)number
+        && !(number == 0 && signbit(number))) {
+        int value = (int)number;
+        char digits[8];
+        int count = 0;
+        unsigned int rest = value < 0 ? -value : value;
+        do {
+            digits[count++] = (char)('0' + rest % 10);
+            rest /= 10;
+        } while (rest > 0);
+        int length = 0;
+        if (value < 0) {
+            buffer[length++] = '-';
+        }
+        while (count > 0) {
+            buffer[length++] = digits[--count];
+        }
+        buffer[length] = '\0';
+        return length;
+    }
+    return snprintf(buffer, NUMBER_FORMAT_SIZE, "%g", number);
+}
+
 void printValue(Value value)
 {
 #ifdef NAN_BOXING
@@ -77,7 +105,11 @@ bool valuesEqual(Value a, Value b)
     if (IS_NUMBER(a) && IS_NUMBER(b)) {
         return AS_NUMBER(a) == AS_NUMBER(b);
     }
-    return a == b;
+    if (a == b) {
+        return true;
+    }
+    // structs are values, different objects can be equal
+    return IS_STRUCT(a) && IS_STRUCT(b) && structsEqual(AS_STRUCT(a), AS_STRUCT(b));
 #else
     if (a.type != b.type)
         return false;
@@ -89,6 +121,9 @@ bool valuesEqual(Value a, Value b)
     case VAL_NUMBER:
         return AS_NUMBER(a) == AS_NUMBER(b);
     case VAL_OBJ:
+        if (IS_STRUCT(a) && IS_STRUCT(b)) {
+            return structsEqual(AS_STRUCT(a), AS_STRUCT(b));
+        }
         return AS_OBJ(a) == AS_OBJ(b);
     default:
         return false;
@@ -92,4 +92,9 @@ void initValueArray(ValueArray* array);
 void writeValueArray(ValueArray* array, Value value);
 void freeValueArray(ValueArray* array);
 void printValue(Value value);
+
+// Big enough for any number formatted by formatNumber.
+#define NUMBER_FORMAT_SIZE 32
+// Writes the number the way print shows it and returns its length.
+int formatNumber(double number, char* buffer);
 void markValueArray(ValueArray* array);
\ No newline at end of file
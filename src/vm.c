@@ -8,6 +8,9 @@
 #include "util/debug.h"
 // #include "object.h"
 #include "util/memory.h"
+#include "values/array.h"
+#include "values/map.h"
+#include "values/struct.h"
 #include "natives.h"
 
 VM vm;
@@ -19,12 +22,9 @@ static void resetStack()
     vm.openUpvalues = NULL;
 }
 
-static void runtimeError(const char* format, ...)
+static void reportError(const char* format, va_list args)
 {
-    va_list args;
-    va_start(args, format);
     vfprintf(stderr, format, args);
-    va_end(args);
     fputs("\n", stderr);
 
     for (int i = vm.frameCount - 1; i >= 0; i--) {
@@ -33,6 +33,15 @@ static void runtimeError(const char* format, ...)
         size_t instruction = frame->ip - frame->closure->function->chunk.code - 1;
         int line
             = getSourceInfoLinenumber(&frame->closure->function->chunk.sourceinfo, instruction);
+        // inlined code reports the frame its call would have had
+        const InlinedCode* inlined
+            = getInlinedCode(&frame->closure->function->chunk.sourceinfo, instruction);
+        if (inlined != NULL) {
+            const ObjFunction* callee
+                = AS_FUNCTION(function->chunk.constants.values[inlined->function]);
+            fprintf(stderr, "[line %d] in %s()\n", line, callee->name->chars);
+            line = inlined->callLine;
+        }
         fprintf(stderr, "[line %d] in ", line);
         if (function->name == NULL) {
             fprintf(stderr, "script\n");
@@ -40,10 +49,48 @@ static void runtimeError(const char* format, ...)
             fprintf(stderr, "%s()\n", function->name->chars);
         }
     }
+}
+
+static void runtimeError(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    reportError(format, args);
+    va_end(args);
 
     resetStack();
 }
 
+Value nativeError(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    reportError(format, args);
+    va_end(args);
+
+    // the stack is reset by callValue() once the native returned
+    vm.hasNativeError = true;
+    return NIL_VAL;
+}
+
+
+uint32_t makeSelector(ObjString* name)
+{
+    uint32_t selector;
+    if (addresstableGetAddress(&vm.selectorTable, name, &selector)) {
+        return selector;
+    }
+
+    push(OBJ_VAL(name));
+    selector = addresstableAdd(&vm.selectorTable, name,
+        (Var) {
+            .identifier = name,
+            .readonly = false,
+        });
+    pop(); // name
+
+    return selector;
+}
 
 void push(Value value)
 {
@@ -81,6 +128,13 @@ static bool call(ObjClosure* closure, int argCount)
         runtimeError("Stack overflow.");
         return false;
     }
+    ObjFunction* function = closure->function;
+    if (function->lazy.chars != NULL && !compileLazy(function)) {
+        // the errors are reported already, like those found before running
+        vm.hasCompileError = true;
+        resetStack();
+        return false;
+    }
     CallFrame* frame = &vm.frames[vm.frameCount++];
     frame->closure = closure;
     frame->ip = closure->function->chunk.code;
@@ -101,7 +155,7 @@ static bool callValue(Value callee, int argCount)
             ObjClass* klass = AS_CLASS(callee);
             vm.stackTop[-argCount - 1] = OBJ_VAL(newInstance(klass));
             Value initializer;
-            if (tableGet(&klass->methods, vm.initString, &initializer)) {
+            if (getMethod(klass, vm.initSelector, &initializer)) {
                 return call(AS_CLOSURE(initializer), argCount);
             } else if (argCount != 0) {
                 runtimeError("Expected 0 arguments but got %d.", argCount);
@@ -111,9 +165,26 @@ static bool callValue(Value callee, int argCount)
         }
         case OBJ_CLOSURE:
             return call(AS_CLOSURE(callee), argCount);
+        case OBJ_STRUCT_TYPE: {
+            ObjStructType* type = AS_STRUCT_TYPE(callee);
+            if (argCount != type->fieldCount) {
+                runtimeError("Expected %d arguments but got %d.", type->fieldCount, argCount);
+                return false;
+            }
+            ObjStruct* element = newStruct(type);
+            memcpy(element->fields, vm.stackTop - argCount, argCount * sizeof(Value));
+            vm.stackTop -= argCount;
+            vm.stackTop[-1] = OBJ_VAL(element);
+            return true;
+        }
         case OBJ_NATIVE: {
             NativeFn native = AS_NATIVE(callee);
             Value result = native(argCount, vm.stackTop - argCount);
+            if (vm.hasNativeError) {
+                vm.hasNativeError = false;
+                resetStack();
+                return false;
+            }
             vm.stackTop -= argCount + 1;
             push(result);
             return true;
@@ -127,41 +198,87 @@ static bool callValue(Value callee, int argCount)
     return false;
 }
 
-static bool invokeFromClass(ObjClass* klass, ObjString* name, uint8_t argCount)
+static inline ObjString* selectorName(uint32_t selector)
+{
+    return addresstableGetName(&vm.selectorTable, selector);
+}
+
+static bool invokeFromClass(ObjClass* klass, uint32_t selector, uint8_t argCount)
 {
     Value method;
-    if (!tableGet(&klass->methods, name, &method)) {
-        runtimeError("Undefined property '%s'.", name->chars);
+    if (!getMethod(klass, selector, &method)) {
+        runtimeError("Undefined property '%s'.", selectorName(selector)->chars);
         return false;
     }
 
     return call(AS_CLOSURE(method), argCount);
 }
-static bool invoke(ObjString* name, uint8_t argCount)
+// Builtin methods are natives, that get the receiver as their first argument.
+static bool invokeNative(Value receiver, uint32_t selector, uint8_t argCount)
+{
+    NativeMethods* methods;
+    if (IS_ARRAY(receiver)) {
+        methods = &vm.arrayMethods;
+    } else if (IS_STRING(receiver)) {
+        methods = &vm.stringMethods;
+    } else if (IS_ITERATOR(receiver)) {
+        methods = &vm.iteratorMethods;
+    } else if (IS_FRAME(receiver)) {
+        methods = &vm.frameMethods;
+    } else {
+        runtimeError("Only instances have methods.");
+        return false;
+    }
+    if (selector >= methods->count || methods->functions[selector] == NULL) {
+        runtimeError("Undefined property '%s'.", selectorName(selector)->chars);
+        return false;
+    }
+
+    Value* args = vm.stackTop - argCount - 1;
+    Value result = methods->functions[selector](argCount + 1, args);
+    if (vm.hasNativeError) {
+        vm.hasNativeError = false;
+        resetStack();
+        return false;
+    }
+    vm.stackTop = args;
+    push(result);
+    return true;
+}
+
+static bool invoke(uint32_t selector, uint8_t argCount)
 {
     Value receiver = peek(argCount);
 
+    if (IS_STRUCT(receiver)) {
+        int slot = structSlot(AS_STRUCT(receiver)->type, selector);
+        if (slot < 0) {
+            runtimeError("Undefined property '%s'.", selectorName(selector)->chars);
+            return false;
+        }
+        vm.stackTop[-argCount - 1] = AS_STRUCT(receiver)->fields[slot];
+        return callValue(vm.stackTop[-argCount - 1], argCount);
+    }
     if (!IS_INSTANCE(receiver)) {
-        runtimeError("Only instances have methods.");
-        return false;
+        return invokeNative(receiver, selector, argCount);
     }
 
     ObjInstance* instance = AS_INSTANCE(receiver);
 
     Value value;
-    if (tableGet(&instance->fields, name, &value)) {
+    if (tableGet(&instance->fields, selectorName(selector), &value)) {
         vm.stackTop[-argCount - 1] = value;
         return callValue(value, argCount);
     }
 
-    return invokeFromClass(instance->klass, name, argCount);
+    return invokeFromClass(instance->klass, selector, argCount);
 }
 
-static bool bindMethod(ObjClass* klass, ObjString* name)
+static bool bindMethod(ObjClass* klass, uint32_t selector)
 {
     Value method;
-    if (!tableGet(&klass->methods, name, &method)) {
-        runtimeError("Undefined property '%s'.", name->chars);
+    if (!getMethod(klass, selector, &method)) {
+        runtimeError("Undefined property '%s'.", selectorName(selector)->chars);
         return false;
     }
 
@@ -204,11 +321,11 @@ static void closeUpvalues(Value* last)
     }
 }
 
-static void defineMethod(ObjString* name)
+static void defineMethod(uint32_t selector)
 {
     Value method = peek(0);
     ObjClass* klass = AS_CLASS(peek(1));
-    tableSet(&klass->methods, name, method);
+    setMethod(klass, selector, method);
     pop();
 }
 
@@ -236,6 +353,54 @@ static void concatinate()
     push(OBJ_VAL(result));
 }
 
+// Joins the top count values into one string. With stringify set, numbers, booleans and nil are
+// written the way print shows them, otherwise all values need to be strings.
+static bool concatenateValues(int count, bool stringify)
+{
+    Value* parts = vm.stackTop - count;
+    const char* chars[UINT8_COUNT];
+    int lengths[UINT8_COUNT];
+    char numbers[UINT8_COUNT][NUMBER_FORMAT_SIZE];
+
+    int length = 0;
+    for (int i = 0; i < count; i++) {
+        Value part = parts[i];
+        if (IS_STRING(part)) {
+            chars[i] = AS_STRING(part)->chars;
+            lengths[i] = AS_STRING(part)->length;
+        } else if (!stringify) {
+            runtimeError("Operands must be two numbers or two strings.");
+            return false;
+        } else if (IS_NUMBER(part)) {
+            chars[i] = numbers[i];
+            lengths[i] = formatNumber(AS_NUMBER(part), numbers[i]);
+        } else if (IS_BOOL(part)) {
+            chars[i] = AS_BOOL(part) ? "true" : "false";
+            lengths[i] = AS_BOOL(part) ? 4 : 5;
+        } else if (IS_NIL(part)) {
+            chars[i] = "nil";
+            lengths[i] = 3;
+        } else {
+            runtimeError("Only strings, numbers, booleans and nil can be interpolated.");
+            return false;
+        }
+        length += lengths[i];
+    }
+
+    char* result = ALLOCATE(char, length + 1);
+    char* dest = result;
+    for (int i = 0; i < count; i++) {
+        memcpy(dest, chars[i], lengths[i]);
+        dest += lengths[i];
+    }
+    result[length] = '\0';
+
+    ObjString* string = takeString(result, length);
+    vm.stackTop = parts;
+    push(OBJ_VAL(string));
+    return true;
+}
+
 void initVM()
 {
     vm.tempsCount = 0;
@@ -253,9 +418,19 @@ void initVM()
     initTable(&vm.strings);
 
     initAddressTable(&vm.gloablsTable);
-
-    vm.initString = NULL;
-    vm.initString = copyString("init", 4);
+    initAddressTable(&vm.selectorTable);
+    vm.optimize = false;
+    vm.lazy = false;
+    vm.hasCompileError = false;
+    initValueArray(&vm.inlineFunctions);
+    initValueArray(&vm.inlineMethods);
+    vm.arrayMethods = (NativeMethods) { NULL, 0 };
+    vm.stringMethods = (NativeMethods) { NULL, 0 };
+    vm.iteratorMethods = (NativeMethods) { NULL, 0 };
+    vm.frameMethods = (NativeMethods) { NULL, 0 };
+
+    vm.initSelector = makeSelector(copyString("init", 4));
+    vm.hasNativeError = false;
 
     defineNatives();
 }
@@ -269,8 +444,20 @@ void freeVM()
     freeObjects();
 
     freeAddressTable(&vm.gloablsTable);
-
-    vm.initString = NULL;
+    freeAddressTable(&vm.selectorTable);
+    freeValueArray(&vm.inlineFunctions);
+    freeValueArray(&vm.inlineMethods);
+    FREE_ARRAY(NativeFn, vm.arrayMethods.functions, vm.arrayMethods.count);
+    FREE_ARRAY(NativeFn, vm.stringMethods.functions, vm.stringMethods.count);
+    FREE_ARRAY(NativeFn, vm.iteratorMethods.functions, vm.iteratorMethods.count);
+    FREE_ARRAY(NativeFn, vm.frameMethods.functions, vm.frameMethods.count);
+
+#ifdef DEBUG_TABLE_STATS
+    printTableStats();
+#endif
+#ifdef DEBUG_CONSTANT_STATS
+    printConstantStats();
+#endif
 }
 
 static inline bool checkGlobalDefined(uint32_t addr)
@@ -279,32 +466,45 @@ static inline bool checkGlobalDefined(uint32_t addr)
         || (IS_OBJ(vm.globals.values[addr]) && AS_OBJ(vm.globals.values[addr]) == NULL);
 }
 
-static inline bool getProperty(CallFrame* frame, Value instanceValue, uint32_t propertyAddr)
+static inline bool getProperty(Value instanceValue, uint32_t selector)
 {
+    if (IS_STRUCT(instanceValue)) {
+        ObjStruct* element = AS_STRUCT(instanceValue);
+        int slot = structSlot(element->type, selector);
+        if (slot < 0) {
+            runtimeError("Undefined property '%s'.", selectorName(selector)->chars);
+            return false;
+        }
+        vm.stackTop[-1] = element->fields[slot];
+        return true;
+    }
     if (!IS_INSTANCE(instanceValue)) {
         runtimeError("Only instances have properties.");
         return false;
     }
     ObjInstance* instance = AS_INSTANCE(instanceValue);
-    ObjString* name = AS_STRING(frame->closure->function->chunk.constants.values[propertyAddr]);
 
     Value value;
-    if (tableGet(&instance->fields, name, &value)) {
+    if (tableGet(&instance->fields, selectorName(selector), &value)) {
         pop();
         push(value);
         return true;
     }
 
-    return bindMethod(instance->klass, name);
+    return bindMethod(instance->klass, selector);
 }
 
-static inline bool setProperty(CallFrame* frame, Value instanceValue, uint32_t propertyAddr)
+static inline bool setProperty(Value instanceValue, uint32_t selector)
 {
+    if (IS_STRUCT(instanceValue)) {
+        runtimeError("Struct fields can not be changed.");
+        return false;
+    }
     if (!IS_INSTANCE(instanceValue)) {
         runtimeError("Only instances have fields.");
         return false;
     }
-    ObjString* propName = AS_STRING(frame->closure->function->chunk.constants.values[propertyAddr]);
+    ObjString* propName = selectorName(selector);
 
     ObjInstance* instance = AS_INSTANCE(instanceValue);
     tableSet(&instance->fields, propName, peek(0));
@@ -314,7 +514,53 @@ static inline bool setProperty(CallFrame* frame, Value instanceValue, uint32_t p
     return true;
 }
 
-static InterpretResult run()
+// Appending with [] = to anything but an array.
+static bool addStruct(Value receiver, Value value)
+{
+    if (!IS_STRUCT_ARRAY(receiver)) {
+        runtimeError("Only arrays can be appended to.");
+        return false;
+    }
+    ObjStructArray* array = AS_STRUCT_ARRAY(receiver);
+    if (!IS_STRUCT(value) || AS_STRUCT(value)->type != array->type) {
+        runtimeError("Struct arrays only hold structs of their type.");
+        return false;
+    }
+    structArrayPush(array, AS_STRUCT(value));
+    return true;
+}
+
+// Everything indexing does besides reading an array element. OP_GET_INDEX handles that inline.
+static bool getIndex(Value receiver, Value index)
+{
+    Value value;
+    const char* error = objectGet(receiver, index, &value);
+    if (error != NULL) {
+        runtimeError(error);
+        return false;
+    }
+    pop();
+    pop();
+    push(value);
+    return true;
+}
+
+static bool setIndex(Value receiver, Value index, Value value)
+{
+    const char* error = objectSet(receiver, index, value);
+    if (error != NULL) {
+        runtimeError(error);
+        return false;
+    }
+    pop();
+    pop();
+    pop();
+    push(value);
+    return true;
+}
+
+// Runs until the frame at baseFrame returns.
+static InterpretResult run(int baseFrame)
 {
     CallFrame* frame = &vm.frames[vm.frameCount - 1];
 #define READ_BYTE() (*frame->ip++)
@@ -333,6 +579,11 @@ static InterpretResult run()
         double a = AS_NUMBER(pop());                                                               \
         push(valueType(a op b));                                                                   \
     } while (false)
+#define NUMBER_OP(valueType, op)                                                                   \
+    do {                                                                                           \
+        vm.stackTop[-2] = valueType(AS_NUMBER(vm.stackTop[-2]) op AS_NUMBER(vm.stackTop[-1]));     \
+        vm.stackTop--;                                                                             \
+    } while (false)
 
     for (;;) {
 #ifdef DEBUG_TRACE_EXECUTION
@@ -414,44 +665,40 @@ static InterpretResult run()
             break;
         }
         case OP_INVOKE: {
-            uint32_t addr = READ_BYTE();
-            ObjString* method = GET_STRING(addr);
+            uint32_t selector = READ_BYTE();
             uint8_t argCount = READ_BYTE();
-            if (!invoke(method, argCount)) {
+            if (!invoke(selector, argCount)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             frame = &vm.frames[vm.frameCount - 1];
             break;
         }
         case OP_INVOKE_LONG: {
-            uint32_t addr = READ_UINT24();
-            ObjString* method = GET_STRING(addr);
+            uint32_t selector = READ_UINT24();
             uint8_t argCount = READ_BYTE();
-            if (!invoke(method, argCount)) {
+            if (!invoke(selector, argCount)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             frame = &vm.frames[vm.frameCount - 1];
             break;
         }
         case OP_SUPER_INVOKE: {
-            uint32_t addr = READ_BYTE();
-            ObjString* method = GET_STRING(addr);
+            uint32_t selector = READ_BYTE();
             uint8_t argCount = READ_BYTE();
             ObjClass* superclass = AS_CLASS(pop());
 
-            if (!invokeFromClass(superclass, method, argCount)) {
+            if (!invokeFromClass(superclass, selector, argCount)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             frame = &vm.frames[vm.frameCount - 1];
             break;
         }
         case OP_SUPER_INVOKE_LONG: {
-            uint32_t addr = READ_UINT24();
-            ObjString* method = GET_STRING(addr);
+            uint32_t selector = READ_UINT24();
             uint8_t argCount = READ_BYTE();
             ObjClass* superclass = AS_CLASS(pop());
 
-            if (!invokeFromClass(superclass, method, argCount)) {
+            if (!invokeFromClass(superclass, selector, argCount)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             frame = &vm.frames[vm.frameCount - 1];
@@ -474,23 +721,24 @@ static InterpretResult run()
                 return INTERPRET_RUNTIME_ERROR;
             }
             ObjClass* subClass = AS_CLASS(peek(0));
-            tableAddAll(&AS_CLASS(superclass)->methods, &subClass->methods);
+            inheritMethods(subClass, AS_CLASS(superclass));
             pop();
 
             break;
         }
         case OP_METHOD: {
-            uint32_t addr = READ_BYTE();
-            defineMethod(GET_STRING(addr));
+            uint32_t selector = READ_BYTE();
+            defineMethod(selector);
             break;
         }
         case OP_METHOD_LONG: {
-            uint32_t addr = READ_UINT24();
-            defineMethod(GET_STRING(addr));
+            uint32_t selector = READ_UINT24();
+            defineMethod(selector);
             break;
         }
-        case OP_CLOSURE: {
-            uint8_t addr = READ_BYTE();
+        case OP_CLOSURE:
+        case OP_CLOSURE_LONG: {
+            uint32_t addr = instruction == OP_CLOSURE ? READ_BYTE() : READ_UINT24();
             Value constant = GET_CONSTANT(addr);
             ObjFunction* function = AS_FUNCTION(constant);
             ObjClosure* closure = newClosure(function);
@@ -504,14 +752,12 @@ static InterpretResult run()
                     closure->upvalues[i] = frame->closure->upvalues[index];
                 }
             }
-            break;
-        }
-        case OP_CLOSURE_LONG: {
-            uint8_t addr = READ_UINT24();
-            Value constant = GET_CONSTANT(addr);
-            ObjFunction* function = AS_FUNCTION(constant);
-            ObjClosure* closure = newClosure(function);
-            push(OBJ_VAL(closure));
+            for (int i = 0; i < closure->capturedCount; i++) {
+                uint8_t isLocal = READ_BYTE();
+                uint8_t index = READ_BYTE();
+                closure->captured[i]
+                    = isLocal ? frame->slots[index] : frame->closure->captured[index];
+            }
             break;
         }
         case OP_CLOSE_UPVALUE:
@@ -522,16 +768,28 @@ static InterpretResult run()
             Value result = pop();
             closeUpvalues(frame->slots);
             vm.frameCount--;
-            if (vm.frameCount == 0) {
-                pop();
+            vm.stackTop = frame->slots;
+            if (vm.frameCount == baseFrame) {
+                if (baseFrame > 0) {
+                    push(result);
+                }
                 return INTERPRET_OK;
             }
 
-            vm.stackTop = frame->slots;
             push(result);
             frame = &vm.frames[vm.frameCount - 1];
             break;
         }
+        case OP_CONCAT_N:
+            if (!concatenateValues(READ_BYTE(), true)) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+        case OP_ADD_STRINGS:
+            if (!concatenateValues(READ_BYTE(), false)) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
         case OP_ARRAY_INIT: {
             uint8_t argCount = READ_BYTE();
             ObjArray* array = newArray();
@@ -539,7 +797,7 @@ static InterpretResult run()
 
             for (int i = argCount - 1; i >= 0; i--) {
                 Value value = peek(i);
-                writeValueArray(&array->valueArray, value);
+                arrayPush(array, value);
             }
             popN(argCount);
 
@@ -548,11 +806,35 @@ static InterpretResult run()
             vm.tempsCount--;
             break;
         }
+        case OP_MAP_INIT: {
+            uint8_t entryCount = READ_BYTE();
+            ObjMap* map = newMap();
+            vm.temps[vm.tempsCount++] = OBJ_VAL(map);
+            mapReserve(map, entryCount);
+
+            for (int i = entryCount * 2 - 1; i > 0; i -= 2) {
+                Value key = peek(i);
+                if (!isMapKey(key)) {
+                    vm.tempsCount--;
+                    runtimeError("Map key can not be nil or NaN.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                mapSet(map, key, peek(i - 1));
+            }
+            popN(entryCount * 2);
+
+            push(OBJ_VAL(map));
+
+            vm.tempsCount--;
+            break;
+        }
         case OP_ARRAY_ADD: {
-            ObjArray* array = AS_ARRAY(peek(1));
             Value value = peek(0);
-
-            writeValueArray(&array->valueArray, value);
+            if (IS_ARRAY(peek(1))) {
+                arrayPush(AS_ARRAY(peek(1)), value);
+            } else if (!addStruct(peek(1), value)) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
 
             pop();
             pop();
@@ -671,94 +953,150 @@ static InterpretResult run()
             *frame->closure->upvalues[slot]->location = peek(0);
             break;
         }
+        case OP_GET_OUTER_LOCAL: {
+            uint8_t slot = READ_BYTE();
+            push(frame[-1].slots[slot]);
+            break;
+        }
+        case OP_SET_OUTER_LOCAL: {
+            uint8_t slot = READ_BYTE();
+            frame[-1].slots[slot] = peek(0);
+            break;
+        }
+        case OP_GET_OUTER_UPVALUE: {
+            uint8_t slot = READ_BYTE();
+            push(*frame[-1].closure->upvalues[slot]->location);
+            break;
+        }
+        case OP_SET_OUTER_UPVALUE: {
+            uint8_t slot = READ_BYTE();
+            *frame[-1].closure->upvalues[slot]->location = peek(0);
+            break;
+        }
+        case OP_GET_CAPTURED: {
+            uint8_t slot = READ_BYTE();
+            push(frame->closure->captured[slot]);
+            break;
+        }
+        case OP_GET_OUTER_CAPTURED: {
+            uint8_t slot = READ_BYTE();
+            push(frame[-1].closure->captured[slot]);
+            break;
+        }
         case OP_GET_PROPERTY: {
-            uint32_t propAddr = READ_BYTE();
+            uint32_t selector = READ_BYTE();
 
-            if (!getProperty(frame, peek(0), propAddr)) {
+            if (!getProperty(peek(0), selector)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
         }
         case OP_GET_PROPERTY_LONG: {
-            uint32_t propAddr = READ_UINT24();
-            if (!getProperty(frame, peek(0), propAddr)) {
+            uint32_t selector = READ_UINT24();
+            if (!getProperty(peek(0), selector)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
         }
-        case OP_GET_PROPERTY_STACK: {
+        case OP_GET_INDEX: {
             Value receiver = peek(1);
-            Value address = peek(0);
-
-            if (IS_OBJ(receiver)) {
-                Value value;
-                const char* error = objectGet(receiver, address, &value);
-                if (error != NULL) {
-                    runtimeError(error);
+            Value index = peek(0);
+
+            if (IS_ARRAY(receiver) && IS_NUMBER(index)) {
+                ObjArray* array = AS_ARRAY(receiver);
+                double number = AS_NUMBER(index);
+                if (number >= 0 && number < array->count) {
+                    vm.stackTop--;
+                    vm.stackTop[-1] = arrayGet(array, (unsigned int)number);
+                    break;
+                }
+            }
+            if (!getIndex(receiver, index)) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            break;
+        }
+        case OP_GET_INDEX_PROPERTY: {
+            uint32_t selector = READ_BYTE();
+            Value receiver = peek(1);
+            Value index = peek(0);
+
+            // a field of a struct array element is read in place, without copying the element
+            if (IS_STRUCT_ARRAY(receiver) && IS_NUMBER(index)) {
+                ObjStructArray* array = AS_STRUCT_ARRAY(receiver);
+                double number = AS_NUMBER(index);
+                int slot = structSlot(array->type, selector);
+                if (number >= 0 && number < array->count && slot >= 0) {
+                    vm.stackTop--;
+                    vm.stackTop[-1] = structArrayField(array, (unsigned int)number, slot);
+                    break;
+                }
+            }
+            if (IS_ARRAY(receiver) && IS_NUMBER(index)) {
+                ObjArray* array = AS_ARRAY(receiver);
+                double number = AS_NUMBER(index);
+                if (number >= 0 && number < array->count) {
+                    vm.stackTop--;
+                    vm.stackTop[-1] = arrayGet(array, (unsigned int)number);
+                } else if (!getIndex(receiver, index)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
-                pop();
-                pop();
-                push(value);
-            } else {
-                runtimeError("Value can not accessed with [].");
+            } else if (!getIndex(receiver, index)) {
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            if (!getProperty(peek(0), selector)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
         }
-        case OP_SET_PROPERTY_STACK: {
+        case OP_SET_INDEX: {
             Value receiver = peek(2);
-            Value address = peek(1);
+            Value index = peek(1);
             Value value = peek(0);
 
-            if (IS_OBJ(receiver)) {
-                const char* error = objectSet(receiver, address, value);
-                if (error != NULL) {
-                    runtimeError(error);
-                    return INTERPRET_RUNTIME_ERROR;
+            if (IS_ARRAY(receiver) && IS_NUMBER(index)) {
+                ObjArray* array = AS_ARRAY(receiver);
+                double number = AS_NUMBER(index);
+                if (number >= 0 && number < array->count) {
+                    arraySet(array, (unsigned int)number, value);
+                    vm.stackTop -= 2;
+                    vm.stackTop[-1] = value;
+                    break;
                 }
-                pop();
-                pop();
-                pop();
-                push(value);
-            } else {
-                runtimeError("Value can not accessed with [].");
+            }
+            if (!setIndex(receiver, index, value)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
         }
         case OP_SET_PROPERTY: {
-            uint32_t propAddr = READ_BYTE();
-            if (!setProperty(frame, peek(1), propAddr)) {
-                runtimeError("Only instances have fields.");
+            uint32_t selector = READ_BYTE();
+            if (!setProperty(peek(1), selector)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
         }
         case OP_SET_PROPERTY_LONG: {
-            uint32_t propAddr = READ_UINT24();
-            if (!setProperty(frame, peek(1), propAddr)) {
-                runtimeError("Only instances have fields.");
+            uint32_t selector = READ_UINT24();
+            if (!setProperty(peek(1), selector)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
         }
         case OP_GET_SUPER: {
-            uint32_t addr = READ_BYTE();
-            ObjString* name = GET_STRING(addr);
+            uint32_t selector = READ_BYTE();
             ObjClass* superclass = AS_CLASS(pop());
 
-            if (!bindMethod(superclass, name)) {
+            if (!bindMethod(superclass, selector)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
         }
         case OP_GET_SUPER_LONG: {
-            uint32_t addr = READ_UINT24();
-            ObjString* name = GET_STRING(addr);
+            uint32_t selector = READ_UINT24();
             ObjClass* superclass = AS_CLASS(pop());
 
-            if (!bindMethod(superclass, name)) {
+            if (!bindMethod(superclass, selector)) {
                 return INTERPRET_RUNTIME_ERROR;
             }
             break;
@@ -787,6 +1125,105 @@ static InterpretResult run()
         case OP_LESS_EQUAL:
             BINARY_OP(BOOL_VAL, <=);
             break;
+        case OP_ADD_NUMBER:
+            NUMBER_OP(NUMBER_VAL, +);
+            break;
+        case OP_SUBTRACT_NUMBER:
+            NUMBER_OP(NUMBER_VAL, -);
+            break;
+        case OP_MULTIPLY_NUMBER:
+            NUMBER_OP(NUMBER_VAL, *);
+            break;
+        case OP_DIVIDE_NUMBER:
+            NUMBER_OP(NUMBER_VAL, /);
+            break;
+        case OP_NEGATE_NUMBER:
+            vm.stackTop[-1] = NUMBER_VAL(-AS_NUMBER(vm.stackTop[-1]));
+            break;
+        case OP_GREATER_NUMBER:
+            NUMBER_OP(BOOL_VAL, >);
+            break;
+        case OP_GREATER_EQUAL_NUMBER:
+            NUMBER_OP(BOOL_VAL, >=);
+            break;
+        case OP_LESS_NUMBER:
+            NUMBER_OP(BOOL_VAL, <);
+            break;
+        case OP_LESS_EQUAL_NUMBER:
+            NUMBER_OP(BOOL_VAL, <=);
+            break;
+        case OP_CHECK_CALL: {
+            uint8_t argCount = READ_BYTE();
+            const ObjFunction* inlined = AS_FUNCTION(GET_CONSTANT(READ_BYTE()));
+            uint16_t offset = READ_UINT16();
+            Value callee = peek(argCount);
+            if (!IS_CLOSURE(callee) || AS_CLOSURE(callee)->function != inlined) {
+                frame->ip += offset;
+            }
+            break;
+        }
+        case OP_CHECK_INVOKE: {
+            uint32_t selector = READ_BYTE();
+            uint8_t argCount = READ_BYTE();
+            const ObjFunction* inlined = AS_FUNCTION(GET_CONSTANT(READ_BYTE()));
+            uint16_t offset = READ_UINT16();
+            Value receiver = peek(argCount);
+            Value method;
+            // a field of the same name hides the method
+            if (!IS_INSTANCE(receiver) || !getMethod(AS_INSTANCE(receiver)->klass, selector, &method)
+                || AS_CLOSURE(method)->function != inlined
+                || tableGet(&AS_INSTANCE(receiver)->fields, selectorName(selector), &method)) {
+                frame->ip += offset;
+            }
+            break;
+        }
+        case OP_INLINE_RETURN: {
+            // drops the callee and its arguments and locals, like returning from a call would
+            uint8_t count = READ_BYTE();
+            Value result = pop();
+            vm.stackTop -= count;
+            push(result);
+            break;
+        }
+        case OP_FOR_LOOP: {
+            // the counter is advanced by a number literal and compared with the limit on the stack
+            Value* counter = &frame->slots[READ_BYTE()];
+            double step = AS_NUMBER(GET_CONSTANT(READ_BYTE()));
+            uint8_t increment = READ_BYTE();
+            uint8_t compare = READ_BYTE();
+            uint16_t offset = READ_UINT16();
+            if (!IS_NUMBER(*counter)) {
+                runtimeError(increment == OP_ADD ? "Operands must be two numbers or two strings."
+                                                 : "Operands must be numbers.");
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            double value = AS_NUMBER(*counter) + (increment == OP_ADD ? step : -step);
+            *counter = NUMBER_VAL(value);
+            if (!IS_NUMBER(peek(0))) {
+                runtimeError("Operands must be numbers.");
+                return INTERPRET_RUNTIME_ERROR;
+            }
+            double limit = AS_NUMBER(pop());
+            bool again;
+            switch (compare) {
+            case OP_LESS:
+                again = value < limit;
+                break;
+            case OP_LESS_EQUAL:
+                again = value <= limit;
+                break;
+            case OP_GREATER:
+                again = value > limit;
+                break;
+            default:
+                again = value >= limit;
+                break;
+            }
+            if (again) {
+                frame->ip -= offset;
+            }
+            break;
+        }
         default:
             printf("undefined instruction: 0x%02X\n", instruction);
             return INTERPRET_RUNTIME_ERROR;
@@ -799,6 +1236,7 @@ static InterpretResult run()
 #undef GET_CONSTANT
 #undef GET_STRING
 #undef BINARY_OP
+#undef NUMBER_OP
 }
 
 InterpretResult interpret(const char* source)
@@ -814,5 +1252,22 @@ InterpretResult interpret(const char* source)
     push(OBJ_VAL(closure));
     call(closure, 0);
 
-    return run();
+    vm.hasCompileError = false;
+    InterpretResult result = run(0);
+    return vm.hasCompileError ? INTERPRET_COMPILE_ERROR : result;
+}
+
+bool callFunction(int argCount)
+{
+    int frameCount = vm.frameCount;
+    if (!callValue(peek(argCount), argCount)) {
+        vm.hasNativeError = true;
+        return false;
+    }
+    // natives and classes without an initializer are done already
+    if (vm.frameCount > frameCount && run(frameCount) != INTERPRET_OK) {
+        vm.hasNativeError = true;
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
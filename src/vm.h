@@ -17,6 +17,12 @@ typedef struct {
 } CallFrame;
 
 
+// Methods of a builtin type, indexed by selector. NULL where undefined.
+typedef struct {
+    NativeFn* functions;
+    unsigned int count;
+} NativeMethods;
+
 typedef struct {
     CallFrame frames[FRAMES_MAX];
     int frameCount;
@@ -32,10 +38,28 @@ typedef struct {
     ObjUpvalue* openUpvalues;
     Obj* objects;
 
-    ObjString* initString;
+    uint32_t initSelector;
+    bool hasNativeError;
 
     // used by compiler
     AddressTable gloablsTable;
+    // run the optimizer on every compiled function
+    bool optimize;
+    // compile top level functions and methods on their first call. Only their parameters and
+    // the tokens of their bodies are checked up front, errors in a body are reported when it is
+    // first called, and not at all, when it never is.
+    bool lazy;
+    // a function compiled on its first call had errors, the script ends like a compile error
+    bool hasCompileError;
+    // small functions the optimizer may inline, by global address and by selector
+    ValueArray inlineFunctions;
+    ValueArray inlineMethods;
+    // method and property names
+    AddressTable selectorTable;
+    NativeMethods arrayMethods;
+    NativeMethods stringMethods;
+    NativeMethods iteratorMethods;
+    NativeMethods frameMethods;
 
     // garbage collection
     size_t bytesAllocated;
@@ -59,4 +83,9 @@ void initVM();
 void freeVM();
 InterpretResult interpret(const char* source);
 void push(Value value);
-Value pop();
\ No newline at end of file
+Value pop();
+Value nativeError(const char* format, ...);
+uint32_t makeSelector(ObjString* name);
+// Calls the callee below the arguments on the stack from native code and runs it to completion,
+// leaving the result in its place. On a runtime error the native has to return right away.
+bool callFunction(int argCount);
\ No newline at end of file
@@ -0,0 +1,190 @@
+/**
+ * @file array.c
+ * @brief Tests for arrays and their element kinds
+ *
+ */
+
+
+/*
+ * Includes
+ *
+ */
+#include <string.h>
+
+#include "test.h"
+#include "util/memory.h"
+#include "values/array.h"
+#include "vm.h"
+
+
+/*
+ * Tests
+ *
+ */
+
+/**
+ * @brief A new array is empty and stores numbers unboxed.
+ *
+ * @param state unused
+ */
+static void array_initializes(void** state)
+{
+    (void)state;
+
+    ObjArray* array = newArray();
+
+    assert_int_equal(array->kind, ARRAY_NUMBERS);
+    assert_int_equal(array->count, 0);
+    assert_int_equal(array->capacity, 0);
+    assert_ptr_equal(array->as.numbers, NULL);
+}
+
+/**
+ * @brief Arrays stay packed as long as only numbers are written.
+ *
+ * @param state unused
+ */
+static void array_packs_numbers(void** state)
+{
+    (void)state;
+
+    ObjArray* array = newArray();
+    push(OBJ_VAL(array));
+    for (int i = 0; i < 20; i++) {
+        arrayPush(array, NUMBER_VAL(i * 0.5));
+    }
+    arraySet(array, 3, NUMBER_VAL(-1));
+
+    assert_int_equal(array->kind, ARRAY_NUMBERS);
+    assert_int_equal(array->count, 20);
+    assert_true(array->as.numbers[3] == -1);
+    assert_true(array->as.numbers[19] == 9.5);
+    assert_true(valuesEqual(arrayGet(array, 10), NUMBER_VAL(5)));
+
+    pop();
+}
+
+/**
+ * @brief The first element, that is not a number, switches the array to boxed values.
+ *
+ * @param state unused
+ */
+static void array_switches_to_values(void** state)
+{
+    (void)state;
+
+    ObjArray* pushed = newArray();
+    push(OBJ_VAL(pushed));
+    arrayPush(pushed, NUMBER_VAL(1));
+    arrayPush(pushed, NIL_VAL);
+    arrayPush(pushed, NUMBER_VAL(3));
+
+    assert_int_equal(pushed->kind, ARRAY_VALUES);
+    assert_true(valuesEqual(arrayGet(pushed, 0), NUMBER_VAL(1)));
+    assert_true(IS_NIL(arrayGet(pushed, 1)));
+    assert_true(valuesEqual(arrayGet(pushed, 2), NUMBER_VAL(3)));
+
+    ObjArray* set = newArray();
+    push(OBJ_VAL(set));
+    arrayPush(set, NUMBER_VAL(1));
+    arrayPush(set, NUMBER_VAL(2));
+    arraySet(set, 1, BOOL_VAL(true));
+
+    assert_int_equal(set->kind, ARRAY_VALUES);
+    assert_true(valuesEqual(arrayGet(set, 0), NUMBER_VAL(1)));
+    assert_true(valuesEqual(arrayGet(set, 1), BOOL_VAL(true)));
+
+    pop();
+    pop();
+}
+
+/**
+ * @brief Objects in arrays survive garbage collection.
+ *
+ * @param state unused
+ */
+static void array_marks_values(void** state)
+{
+    (void)state;
+
+    ObjArray* array = newArray();
+    push(OBJ_VAL(array));
+    ObjString* string = copyString("survivor", 8);
+    push(OBJ_VAL(string));
+    arrayPush(array, OBJ_VAL(string));
+    pop();
+
+    collectGarbage();
+
+    assert_ptr_equal(AS_STRING(arrayGet(array, 0)), string);
+    assert_int_equal(strcmp(AS_CSTRING(arrayGet(array, 0)), "survivor"), 0);
+
+    pop();
+}
+
+/**
+ * @brief A view shares the storage, until the array is written to.
+ *
+ * @param state unused
+ */
+static void array_view_shares_storage(void** state)
+{
+    (void)state;
+
+    ObjArray* array = newNumberArray(6);
+    push(OBJ_VAL(array));
+    for (unsigned int i = 0; i < array->count; i++) {
+        array->as.numbers[i] = i;
+    }
+
+    ObjArray* view = newArrayView(array, 1, 3, 2);
+    push(OBJ_VAL(view));
+    assert_int_equal(view->count, 3);
+    assert_int_equal(view->stride, 2);
+    assert_ptr_equal(view->as.numbers, array->as.numbers + 1);
+    assert_ptr_equal(view->shared, array->shared);
+    assert_true(AS_NUMBER(arrayGet(view, 2)) == 5);
+
+    arraySet(array, 1, NUMBER_VAL(-1));
+    assert_ptr_equal(array->shared, NULL);
+    assert_true(AS_NUMBER(arrayGet(array, 1)) == -1);
+    assert_true(AS_NUMBER(arrayGet(view, 0)) == 1);
+
+    collectGarbage();
+
+    assert_true(AS_NUMBER(arrayGet(view, 1)) == 3);
+    arrayUnshare(view);
+    assert_int_equal(view->stride, 1);
+    assert_ptr_equal(view->shared, NULL);
+    assert_true(view->as.numbers[2] == 5);
+
+    pop();
+    pop();
+}
+
+/*
+ * Main test program
+ *
+ */
+
+/**
+ * @brief Main
+ *
+ * @return int count of failed tests
+ */
+int main(void)
+{
+    initVM();
+
+    const struct CMUnitTest tests_nothing[] = {
+        cmocka_unit_test(array_initializes),
+        cmocka_unit_test(array_packs_numbers),
+        cmocka_unit_test(array_switches_to_values),
+        cmocka_unit_test(array_marks_values),
+        cmocka_unit_test(array_view_shares_storage),
+    };
+    int result = cmocka_run_group_tests(tests_nothing, NULL, NULL);
+
+    freeVM();
+    return result;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file constantindex.c
+ * @brief Tests for the index of shared constants
+ *
+ */
+
+
+/*
+ * Includes
+ *
+ */
+
+#include "../test.h"
+#include "chunk/constantindex.h"
+#include "values/object.h"
+#include "vm.h"
+
+/*
+ * Tests
+ *
+ */
+
+/**
+ * @brief The same number is only added to the pool once.
+ *
+ * @param state unused
+ */
+static void constantindex_shares_numbers(void** state)
+{
+    (void)state;
+
+    Chunk chunk;
+    initChunk(&chunk);
+    ConstantIndex index;
+    initConstantIndex(&index);
+
+    for (int i = 0; i < 300; i++) {
+        assert_int_equal(findOrAddConstant(&index, &chunk, NUMBER_VAL(i)), i);
+    }
+    for (int i = 0; i < 300; i++) {
+        assert_int_equal(findOrAddConstant(&index, &chunk, NUMBER_VAL(i)), i);
+    }
+    assert_int_equal(chunk.constants.count, 300);
+
+    freeConstantIndex(&index);
+    freeChunk(&chunk);
+}
+
+/**
+ * @brief Numbers are compared by their bits, so 0 and -0 are different constants.
+ *
+ * @param state unused
+ */
+static void constantindex_keeps_negative_zero(void** state)
+{
+    (void)state;
+
+    Chunk chunk;
+    initChunk(&chunk);
+    ConstantIndex index;
+    initConstantIndex(&index);
+
+    assert_int_equal(findOrAddConstant(&index, &chunk, NUMBER_VAL(0)), 0);
+    assert_int_equal(findOrAddConstant(&index, &chunk, NUMBER_VAL(-0.0)), 1);
+    assert_int_equal(findOrAddConstant(&index, &chunk, NUMBER_VAL(-0.0)), 1);
+
+    freeConstantIndex(&index);
+    freeChunk(&chunk);
+}
+
+/**
+ * @brief Interned strings are shared, numbers with the same bits as a string are not.
+ *
+ * @param state unused
+ */
+static void constantindex_shares_strings(void** state)
+{
+    (void)state;
+
+    Chunk chunk;
+    initChunk(&chunk);
+    ConstantIndex index;
+    initConstantIndex(&index);
+
+    ObjString* string = copyString("name", 4);
+    push(OBJ_VAL(string));
+    assert_int_equal(findOrAddConstant(&index, &chunk, OBJ_VAL(string)), 0);
+    assert_int_equal(findOrAddConstant(&index, &chunk, OBJ_VAL(copyString("name", 4))), 0);
+    assert_int_equal(findOrAddConstant(&index, &chunk, OBJ_VAL(copyString("other", 5))), 1);
+    assert_int_equal(chunk.constants.count, 2);
+    pop();
+
+    freeConstantIndex(&index);
+    freeChunk(&chunk);
+}
+
+/**
+ * @brief Constants cut from the pool are added again.
+ *
+ * @param state unused
+ */
+static void constantindex_adds_truncated_constants(void** state)
+{
+    (void)state;
+
+    Chunk chunk;
+    initChunk(&chunk);
+    ConstantIndex index;
+    initConstantIndex(&index);
+
+    findOrAddConstant(&index, &chunk, NUMBER_VAL(1));
+    findOrAddConstant(&index, &chunk, NUMBER_VAL(2));
+    truncateChunk(&chunk, 0, 1);
+
+    assert_int_equal(findOrAddConstant(&index, &chunk, NUMBER_VAL(3)), 1);
+    assert_int_equal(findOrAddConstant(&index, &chunk, NUMBER_VAL(2)), 2);
+    assert_int_equal(findOrAddConstant(&index, &chunk, NUMBER_VAL(1)), 0);
+    assert_double_equal(AS_NUMBER(chunk.constants.values[2]), 2, 0);
+
+    freeConstantIndex(&index);
+    freeChunk(&chunk);
+}
+
+
+/*
+ * Main test program
+ *
+ */
+
+/**
+ * @brief Main
+ *
+ * @return int count of failed tests
+ */
+int main(void)
+{
+    initVM();
+
+    const struct CMUnitTest tests_constantindex[] = {
+        cmocka_unit_test(constantindex_shares_numbers),
+        cmocka_unit_test(constantindex_keeps_negative_zero),
+        cmocka_unit_test(constantindex_shares_strings),
+        cmocka_unit_test(constantindex_adds_truncated_constants),
+    };
+    int result = cmocka_run_group_tests(tests_constantindex, NULL, NULL);
+
+    freeVM();
+    return result;
+}
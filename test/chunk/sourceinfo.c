@@ -145,6 +145,43 @@ static void sourceinfo_get_line(void** state)
     freeSourceInfo(&info);
 }
 
+/**
+ * @brief Removing the lines of the last bytes shrinks or drops the last counters.
+ *
+ * @param state unused
+ */
+static void sourceinfo_remove_linenumbers(void** state)
+{
+    (void)state;
+
+    SourceInfo info;
+    initSourceInfo(&info);
+
+    addLinenumer(&info, 1); // offset 0
+    addLinenumer(&info, 2); // offset 1
+    addLinenumer(&info, 2); // offset 2
+    addLinenumer(&info, 3); // offset 3
+    addLinenumer(&info, 3); // offset 4
+
+    removeLinenumbers(&info, 1);
+    assert_int_equal(info.count, 3);
+    assert_int_equal(info.linenumberCounter[2], 1);
+
+    removeLinenumbers(&info, 2);
+    assert_int_equal(info.count, 2);
+    assert_int_equal(info.linenumberCounter[1], 1);
+    assert_int_equal(getSourceInfoLinenumber(&info, 1), 2);
+
+    removeLinenumbers(&info, 2);
+    assert_int_equal(info.count, 0);
+
+    addLinenumer(&info, 4);
+    assert_int_equal(info.count, 1);
+    assert_int_equal(getSourceInfoLinenumber(&info, 0), 4);
+
+    freeSourceInfo(&info);
+}
+
 
 /**
  * @brief Function reallocate should allocate memory, when it isn't already.
@@ -186,6 +223,7 @@ int main(void)
         cmocka_unit_test(sourceinfo_incement_counter),
         cmocka_unit_test(sourceinfo_can_be_freed),
         cmocka_unit_test(sourceinfo_get_line),
+        cmocka_unit_test(sourceinfo_remove_linenumbers),
     };
     return cmocka_run_group_tests(tests_sourceinfo, NULL, NULL);
 }
@@ -0,0 +1,234 @@
+/**
+ * @file map.c
+ * @brief Tests for maps with arbitrary value keys
+ *
+ */
+
+
+/*
+ * Includes
+ *
+ */
+#include <math.h>
+#include <string.h>
+
+#include "test.h"
+#include "util/memory.h"
+#include "values/map.h"
+#include "vm.h"
+
+
+/**
+ * helpers
+ *
+ */
+
+// The map is pushed onto the vm stack, so that the garbage collector does not free it.
+static ObjMap* makeMap()
+{
+    ObjMap* map = newMap();
+    push(OBJ_VAL(map));
+    return map;
+}
+
+static void releaseMaps()
+{
+    vm.stackTop = vm.stack;
+}
+
+
+/*
+ * Tests
+ *
+ */
+
+/**
+ * @brief Numbers, booleans and strings are keys, nil and NaN are not.
+ *
+ * @param state unused
+ */
+static void map_checks_keys(void** state)
+{
+    (void)state;
+
+    assert_true(isMapKey(NUMBER_VAL(1)));
+    assert_true(isMapKey(BOOL_VAL(false)));
+    assert_true(isMapKey(OBJ_VAL(copyString("key", 3))));
+    assert_false(isMapKey(NIL_VAL));
+    assert_false(isMapKey(NUMBER_VAL(NAN)));
+}
+
+/**
+ * @brief Values can be stored and read back. Setting an existing key overwrites its value.
+ *
+ * @param state unused
+ */
+static void map_sets_and_gets(void** state)
+{
+    (void)state;
+
+    ObjMap* map = makeMap();
+    Value value;
+    assert_false(mapGet(map, NUMBER_VAL(1), &value));
+
+    assert_true(mapSet(map, NUMBER_VAL(1), NUMBER_VAL(10)));
+    assert_true(mapSet(map, BOOL_VAL(true), NUMBER_VAL(20)));
+    assert_false(mapSet(map, NUMBER_VAL(1), NUMBER_VAL(30)));
+
+    assert_int_equal(map->count, 2);
+    assert_true(mapGet(map, NUMBER_VAL(1), &value));
+    assert_true(valuesEqual(value, NUMBER_VAL(30)));
+    assert_true(mapGet(map, BOOL_VAL(true), &value));
+    assert_true(valuesEqual(value, NUMBER_VAL(20)));
+    assert_false(mapGet(map, BOOL_VAL(false), &value));
+
+    // -0 and 0 are the same key
+    assert_true(mapSet(map, NUMBER_VAL(0), NIL_VAL));
+    assert_false(mapSet(map, NUMBER_VAL(-0.0), NIL_VAL));
+    assert_int_equal(map->count, 3);
+
+    releaseMaps();
+}
+
+/**
+ * @brief Deleted keys are gone. Their entries are dropped once the map runs out of room, so
+ * inserting and deleting over and over again grows the map at most once.
+ *
+ * @param state unused
+ */
+static void map_deletes(void** state)
+{
+    (void)state;
+
+    ObjMap* map = makeMap();
+    for (int i = 0; i < 100; i++) {
+        mapSet(map, NUMBER_VAL(i), NUMBER_VAL(i));
+    }
+    int capacity = map->entryCapacity;
+
+    for (int i = 0; i < 1000; i++) {
+        mapSet(map, NUMBER_VAL(-1), NUMBER_VAL(i));
+        assert_true(mapDelete(map, NUMBER_VAL(-1)));
+        assert_false(mapDelete(map, NUMBER_VAL(-1)));
+    }
+
+    assert_int_equal(map->count, 100);
+    assert_true(map->entryCapacity <= 2 * capacity);
+    Value value;
+    for (int i = 0; i < 100; i++) {
+        assert_true(mapGet(map, NUMBER_VAL(i), &value));
+        assert_true(valuesEqual(value, NUMBER_VAL(i)));
+    }
+
+    releaseMaps();
+}
+
+/**
+ * @brief Entries keep their insertion order across deletes and resizes.
+ *
+ * @param state unused
+ */
+static void map_keeps_order(void** state)
+{
+    (void)state;
+
+    ObjMap* map = makeMap();
+    for (int i = 0; i < 50; i++) {
+        mapSet(map, NUMBER_VAL(i), NIL_VAL);
+    }
+    for (int i = 0; i < 50; i += 2) {
+        mapDelete(map, NUMBER_VAL(i));
+    }
+    for (int i = 50; i < 200; i++) {
+        mapSet(map, NUMBER_VAL(i), NIL_VAL);
+    }
+
+    double previous = -1;
+    for (int i = 0; i < map->entryCount; i++) {
+        if (IS_NIL(map->entries[i].key)) {
+            continue;
+        }
+        double key = AS_NUMBER(map->entries[i].key);
+        assert_true(key > previous);
+        previous = key;
+    }
+
+    releaseMaps();
+}
+
+/**
+ * @brief Reserving room up front avoids resizing while the entries are inserted.
+ *
+ * @param state unused
+ */
+static void map_reserves(void** state)
+{
+    (void)state;
+
+    ObjMap* map = makeMap();
+    mapReserve(map, 100);
+    int capacity = map->entryCapacity;
+    MapEntry* entries = map->entries;
+    assert_true(capacity >= 100);
+
+    for (int i = 0; i < 100; i++) {
+        mapSet(map, NUMBER_VAL(i), NUMBER_VAL(i));
+    }
+    assert_int_equal(map->entryCapacity, capacity);
+    assert_ptr_equal(map->entries, entries);
+
+    releaseMaps();
+}
+
+/**
+ * @brief Keys and values of a reachable map survive a collection.
+ *
+ * @param state unused
+ */
+static void map_marks_entries(void** state)
+{
+    (void)state;
+
+    ObjMap* map = makeMap();
+    push(OBJ_VAL(copyString("key", 3)));
+    push(OBJ_VAL(copyString("survivor", 8)));
+    mapSet(map, vm.stackTop[-2], vm.stackTop[-1]);
+    pop();
+    pop();
+
+    collectGarbage();
+
+    Value value;
+    assert_true(mapGet(map, OBJ_VAL(copyString("key", 3)), &value));
+    assert_int_equal(strcmp(AS_CSTRING(value), "survivor"), 0);
+
+    releaseMaps();
+}
+
+/*
+ * Main test program
+ *
+ */
+
+/**
+ * @brief Main
+ *
+ * @return int count of failed tests
+ */
+int main(void)
+{
+    initVM();
+
+    const struct CMUnitTest tests_nothing[] = {
+        cmocka_unit_test(map_checks_keys),
+        cmocka_unit_test(map_sets_and_gets),
+        cmocka_unit_test(map_deletes),
+        cmocka_unit_test(map_keeps_order),
+        cmocka_unit_test(map_reserves),
+        cmocka_unit_test(map_marks_entries),
+    };
+    int result = cmocka_run_group_tests(tests_nothing, NULL, NULL);
+
+    freeVM();
+    return result;
+}
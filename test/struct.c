@@ -0,0 +1,156 @@
+/**
+ * @file struct.c
+ * @brief Tests for struct types and arrays storing structs inline
+ *
+ */
+
+
+/*
+ * Includes
+ *
+ */
+#include <string.h>
+
+#include "test.h"
+#include "util/memory.h"
+#include "values/struct.h"
+#include "vm.h"
+
+
+/**
+ * helpers
+ *
+ */
+
+// A type with the fields x and y, pushed onto the vm stack so that it is not collected.
+static ObjStructType* makePointType()
+{
+    ObjString* name = copyString("Point", 5);
+    push(OBJ_VAL(name));
+    ObjStructType* type = newStructType(name);
+    pop();
+    push(OBJ_VAL(type));
+    structAddField(type, makeSelector(copyString("x", 1)));
+    structAddField(type, makeSelector(copyString("y", 1)));
+    return type;
+}
+
+static ObjStruct* makePoint(ObjStructType* type, double x, double y)
+{
+    ObjStruct* point = newStruct(type);
+    point->fields[0] = NUMBER_VAL(x);
+    point->fields[1] = NUMBER_VAL(y);
+    return point;
+}
+
+
+/*
+ * Tests
+ *
+ */
+
+/**
+ * @brief Fields get consecutive slots, looked up by selector.
+ *
+ * @param state unused
+ */
+static void struct_adds_fields(void** state)
+{
+    (void)state;
+
+    ObjStructType* type = makePointType();
+    uint32_t x = makeSelector(copyString("x", 1));
+    uint32_t y = makeSelector(copyString("y", 1));
+
+    assert_int_equal(type->fieldCount, 2);
+    assert_int_equal(structSlot(type, x), 0);
+    assert_int_equal(structSlot(type, y), 1);
+    assert_int_equal(structSlot(type, makeSelector(copyString("z", 1))), -1);
+    assert_false(structAddField(type, x));
+    assert_int_equal(type->fieldCount, 2);
+
+    vm.stackTop = vm.stack;
+}
+
+/**
+ * @brief Structs with the same type and fields are equal.
+ *
+ * @param state unused
+ */
+static void struct_compares_fields(void** state)
+{
+    (void)state;
+
+    ObjStructType* type = makePointType();
+    ObjStruct* a = makePoint(type, 1, 2);
+    push(OBJ_VAL(a));
+    ObjStruct* b = makePoint(type, 1, 2);
+    push(OBJ_VAL(b));
+
+    assert_true(structsEqual(a, b));
+    assert_true(valuesEqual(OBJ_VAL(a), OBJ_VAL(b)));
+    b->fields[1] = NUMBER_VAL(3);
+    assert_false(structsEqual(a, b));
+
+    vm.stackTop = vm.stack;
+}
+
+/**
+ * @brief Struct arrays copy the fields in and out, and keep them through a collection.
+ *
+ * @param state unused
+ */
+static void struct_array_stores_inline(void** state)
+{
+    (void)state;
+
+    ObjStructType* type = makePointType();
+    ObjStructArray* array = newStructArray(type);
+    push(OBJ_VAL(array));
+    for (int i = 0; i < 20; i++) {
+        ObjStruct* point = makePoint(type, i, -i);
+        push(OBJ_VAL(point));
+        structArrayPush(array, point);
+        pop();
+    }
+
+    collectGarbage();
+
+    assert_int_equal(array->count, 20);
+    assert_true(AS_NUMBER(structArrayField(array, 7, 1)) == -7);
+    assert_true(AS_NUMBER(array->fields[2 * 13]) == 13);
+
+    ObjStruct* copy = structArrayGet(array, 5);
+    assert_int_equal(copy->fieldCount, 2);
+    assert_true(AS_NUMBER(copy->fields[0]) == 5);
+    copy->fields[0] = NUMBER_VAL(50);
+    assert_true(AS_NUMBER(structArrayField(array, 5, 0)) == 5);
+
+    vm.stackTop = vm.stack;
+}
+
+
+/*
+ * Main test program
+ *
+ */
+
+/**
+ * @brief Main
+ *
+ * @return int count of failed tests
+ */
+int main(void)
+{
+    initVM();
+
+    const struct CMUnitTest tests_nothing[] = {
+        cmocka_unit_test(struct_adds_fields),
+        cmocka_unit_test(struct_compares_fields),
+        cmocka_unit_test(struct_array_stores_inline),
+    };
+    int result = cmocka_run_group_tests(tests_nothing, NULL, NULL);
+
+    freeVM();
+    return result;
+}
@@ -0,0 +1,383 @@
+/**
+ * @file table.c
+ * @brief Tests for the hash table
+ *
+ */
+
+
+/*
+ * Includes
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "table.h"
+#include "values/object.h"
+#include "vm.h"
+
+
+/**
+ * helpers
+ *
+ */
+
+// Keys are pushed onto the vm stack, so that the garbage collector does not free them.
+static ObjString* makeKey(const char* name)
+{
+    ObjString* key = copyString(name, (int)strlen(name));
+    push(OBJ_VAL(key));
+    return key;
+}
+
+static void releaseKeys()
+{
+    vm.stackTop = vm.stack;
+}
+
+static ObjString* makeNumberedKey(int i)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "key%d", i);
+    return makeKey(name);
+}
+
+
+/*
+ * Tests
+ *
+ */
+
+/**
+ * @brief A freshly initialized table is empty.
+ *
+ * @param state unused
+ */
+static void table_initializes(void** state)
+{
+    (void)state;
+
+    Table table;
+    initTable(&table);
+
+    assert_int_equal(table.count, 0);
+    assert_int_equal(table.capacity, 0);
+    assert_ptr_equal(table.entries, NULL);
+    assert_ptr_equal(table.control, NULL);
+
+    Value value;
+    assert_false(tableGet(&table, makeKey("missing"), &value));
+    assert_false(tableDelete(&table, makeKey("missing")));
+
+    releaseKeys();
+}
+
+/**
+ * @brief Values can be stored and read back. Setting an existing key overwrites its value.
+ *
+ * @param state unused
+ */
+static void table_sets_and_gets(void** state)
+{
+    (void)state;
+
+    Table table;
+    initTable(&table);
+    ObjString* a = makeKey("a");
+    ObjString* b = makeKey("b");
+
+    assert_true(tableSet(&table, a, NUMBER_VAL(1)));
+    assert_true(tableSet(&table, b, NUMBER_VAL(2)));
+    assert_false(tableSet(&table, a, NUMBER_VAL(3)));
+
+    Value value;
+    assert_true(tableGet(&table, a, &value));
+    assert_true(valuesEqual(value, NUMBER_VAL(3)));
+    assert_true(tableGet(&table, b, &value));
+    assert_true(valuesEqual(value, NUMBER_VAL(2)));
+    assert_false(tableGet(&table, makeKey("c"), &value));
+
+    freeTable(&table);
+    releaseKeys();
+}
+
+/**
+ * @brief Uint32 entries share the storage with values.
+ *
+ * @param state unused
+ */
+static void table_stores_uint32(void** state)
+{
+    (void)state;
+
+    Table table;
+    initTable(&table);
+    ObjString* key = makeKey("global");
+
+    assert_true(tableSetUint32(&table, key, 0xDEADBEEF));
+    uint32_t value = 0;
+    assert_true(tableGetUint32(&table, key, &value));
+    assert_int_equal(value, 0xDEADBEEF);
+
+    freeTable(&table);
+    releaseKeys();
+}
+
+/**
+ * @brief Deleted keys are gone, the remaining keys are still found and deleted slots are reused.
+ *
+ * @param state unused
+ */
+static void table_deletes(void** state)
+{
+    (void)state;
+
+    Table table;
+    initTable(&table);
+    ObjString* keys[64];
+    for (int i = 0; i < 64; i++) {
+        keys[i] = makeNumberedKey(i);
+        tableSet(&table, keys[i], NUMBER_VAL(i));
+    }
+
+    for (int i = 0; i < 64; i += 2) {
+        assert_true(tableDelete(&table, keys[i]));
+        assert_false(tableDelete(&table, keys[i]));
+    }
+
+    Value value;
+    for (int i = 0; i < 64; i++) {
+        assert_int_equal(tableGet(&table, keys[i], &value), i % 2 == 1);
+    }
+
+    int capacity = table.capacity;
+    for (int i = 0; i < 64; i += 2) {
+        assert_true(tableSet(&table, keys[i], NUMBER_VAL(-i)));
+    }
+    assert_int_equal(table.capacity, capacity);
+    for (int i = 0; i < 64; i++) {
+        assert_true(tableGet(&table, keys[i], &value));
+        assert_true(valuesEqual(value, NUMBER_VAL(i % 2 == 1 ? i : -i)));
+    }
+
+    freeTable(&table);
+    releaseKeys();
+}
+
+/**
+ * @brief The table grows, spreading many keys over many groups without losing any.
+ *
+ * @param state unused
+ */
+static void table_grows(void** state)
+{
+    (void)state;
+
+    Table table;
+    initTable(&table);
+    ObjString* keys[1000];
+    for (int i = 0; i < 1000; i++) {
+        keys[i] = makeNumberedKey(i);
+        assert_true(tableSet(&table, keys[i], NUMBER_VAL(i)));
+    }
+
+    assert_int_equal(table.count, 1000);
+    assert_true(table.capacity >= 1000);
+
+    Value value;
+    for (int i = 0; i < 1000; i++) {
+        assert_true(tableGet(&table, keys[i], &value));
+        assert_true(valuesEqual(value, NUMBER_VAL(i)));
+    }
+
+    freeTable(&table);
+    assert_int_equal(table.capacity, 0);
+    releaseKeys();
+}
+
+/**
+ * @brief Strings are found by their characters, which is what interning relies on.
+ *
+ * @param state unused
+ */
+static void table_finds_strings(void** state)
+{
+    (void)state;
+
+    ObjString* key = makeKey("interned");
+
+    assert_ptr_equal(tableFindString(&vm.strings, "interned", 8, key->hash), key);
+    assert_ptr_equal(tableFindString(&vm.strings, "interned", 7, key->hash), NULL);
+    assert_ptr_equal(tableFindString(&vm.strings, "internet", 8, key->hash), NULL);
+
+    releaseKeys();
+}
+
+/**
+ * @brief All entries of a table can be copied into another one.
+ *
+ * @param state unused
+ */
+static void table_adds_all(void** state)
+{
+    (void)state;
+
+    Table from;
+    Table to;
+    initTable(&from);
+    initTable(&to);
+    for (int i = 0; i < 100; i++) {
+        tableSet(&from, makeNumberedKey(i), NUMBER_VAL(i));
+    }
+    ObjString* deleted = makeNumberedKey(0);
+    tableDelete(&from, deleted);
+
+    tableAddAll(&from, &to);
+
+    assert_int_equal(to.count, 99);
+    Value value;
+    assert_false(tableGet(&to, deleted, &value));
+    assert_true(tableGet(&to, makeNumberedKey(99), &value));
+    assert_true(valuesEqual(value, NUMBER_VAL(99)));
+
+    freeTable(&from);
+    freeTable(&to);
+    releaseKeys();
+}
+
+/**
+ * @brief Only live entries are counted, deleted ones are tracked as tombstones.
+ *
+ * @param state unused
+ */
+static void table_counts_live_entries(void** state)
+{
+    (void)state;
+
+    Table table;
+    initTable(&table);
+    ObjString* keys[200];
+    for (int i = 0; i < 200; i++) {
+        keys[i] = makeNumberedKey(i);
+        tableSet(&table, keys[i], NUMBER_VAL(i));
+    }
+    for (int i = 0; i < 100; i++) {
+        tableDelete(&table, keys[i]);
+    }
+
+    assert_int_equal(table.count, 100);
+    assert_true(table.tombstones <= 100);
+
+    freeTable(&table);
+    assert_int_equal(table.tombstones, 0);
+    releaseKeys();
+}
+
+/**
+ * @brief Inserting and deleting different keys over and over again does not grow the table. The
+ * tombstones are cleaned up instead.
+ *
+ * @param state unused
+ */
+static void table_rehashes_tombstones(void** state)
+{
+    (void)state;
+
+    Table table;
+    initTable(&table);
+    static ObjString* keys[5000];
+    for (int i = 0; i < 5000; i++) {
+        keys[i] = makeNumberedKey(i);
+    }
+
+    int capacity = 0;
+    for (int i = 0; i < 5000; i++) {
+        tableSet(&table, keys[i], NUMBER_VAL(i));
+        if (i >= 100) {
+            tableDelete(&table, keys[i - 100]);
+        }
+        assert_true(table.count + table.tombstones <= table.capacity);
+        if (i == 1000) {
+            capacity = table.capacity;
+        }
+    }
+
+    assert_int_equal(table.capacity, capacity);
+    assert_int_equal(table.count, 100);
+    Value value;
+    for (int i = 0; i < 5000; i++) {
+        assert_int_equal(tableGet(&table, keys[i], &value), i >= 4900);
+    }
+
+    freeTable(&table);
+    releaseKeys();
+}
+
+/**
+ * @brief After most entries are deleted, the table shrinks on the next insert.
+ *
+ * @param state unused
+ */
+static void table_shrinks(void** state)
+{
+    (void)state;
+
+    Table table;
+    initTable(&table);
+    ObjString* keys[1000];
+    for (int i = 0; i < 1000; i++) {
+        keys[i] = makeNumberedKey(i);
+        tableSet(&table, keys[i], NUMBER_VAL(i));
+    }
+    int capacity = table.capacity;
+    for (int i = 0; i < 990; i++) {
+        tableDelete(&table, keys[i]);
+    }
+    tableSet(&table, keys[0], NUMBER_VAL(0));
+
+    assert_true(table.capacity < capacity);
+    assert_int_equal(table.count, 11);
+    assert_int_equal(table.tombstones, 0);
+    Value value;
+    assert_true(tableGet(&table, keys[0], &value));
+    for (int i = 990; i < 1000; i++) {
+        assert_true(tableGet(&table, keys[i], &value));
+        assert_true(valuesEqual(value, NUMBER_VAL(i)));
+    }
+
+    freeTable(&table);
+    releaseKeys();
+}
+
+/*
+ * Main test program
+ *
+ */
+
+/**
+ * @brief Main
+ *
+ * @return int count of failed tests
+ */
+int main(void)
+{
+    initVM();
+
+    const struct CMUnitTest tests_nothing[] = {
+        cmocka_unit_test(table_initializes),
+        cmocka_unit_test(table_sets_and_gets),
+        cmocka_unit_test(table_stores_uint32),
+        cmocka_unit_test(table_deletes),
+        cmocka_unit_test(table_grows),
+        cmocka_unit_test(table_finds_strings),
+        cmocka_unit_test(table_adds_all),
+        cmocka_unit_test(table_counts_live_entries),
+        cmocka_unit_test(table_rehashes_tombstones),
+        cmocka_unit_test(table_shrinks),
+    };
+    int result = cmocka_run_group_tests(tests_nothing, NULL, NULL);
+
+    freeVM();
+    return result;
+}
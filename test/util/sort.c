@@ -0,0 +1,222 @@
+/**
+ * @file sort.c
+ * @brief Tests for the pattern-defeating quicksort
+ *
+ */
+
+
+/*
+ * Includes
+ *
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../test.h"
+#include "util/sort.h"
+#include "values/object.h"
+#include "vm.h"
+
+
+/**
+ * helpers
+ *
+ */
+
+#define COUNT 5000
+
+static double numbers[COUNT];
+static Value values[COUNT];
+
+static void assertSorted(const double* sorted, int count)
+{
+    for (int i = 1; i < count; i++) {
+        assert_true(sorted[i - 1] <= sorted[i]);
+    }
+}
+
+static double sumOf(const double* array, int count)
+{
+    double sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += array[i];
+    }
+    return sum;
+}
+
+static bool greater(void* context, Value a, Value b)
+{
+    (void)context;
+    return AS_NUMBER(a) > AS_NUMBER(b);
+}
+
+static bool coinFlip(void* context, Value a, Value b)
+{
+    (void)context;
+    (void)a;
+    (void)b;
+    return rand() % 2 == 0;
+}
+
+
+/*
+ * Tests
+ *
+ */
+
+/**
+ * @brief Random numbers and the patterns pdqsort special-cases end up sorted.
+ *
+ * @param state unused
+ */
+static void sort_sorts_numbers(void** state)
+{
+    (void)state;
+
+    srand(1);
+    for (int pattern = 0; pattern < 6; pattern++) {
+        for (int i = 0; i < COUNT; i++) {
+            switch (pattern) {
+            case 0: // random
+                numbers[i] = rand();
+                break;
+            case 1: // ascending
+                numbers[i] = i;
+                break;
+            case 2: // descending
+                numbers[i] = COUNT - i;
+                break;
+            case 3: // few distinct values
+                numbers[i] = rand() % 4;
+                break;
+            case 4: // sawtooth
+                numbers[i] = i % 50;
+                break;
+            default: // organ pipe
+                numbers[i] = i < COUNT / 2 ? i : COUNT - i;
+                break;
+            }
+        }
+        double sum = sumOf(numbers, COUNT);
+
+        sortNumbers(numbers, COUNT);
+
+        assertSorted(numbers, COUNT);
+        assert_true(sumOf(numbers, COUNT) == sum);
+    }
+}
+
+/**
+ * @brief NaNs don't compare with anything, they are moved to the end.
+ *
+ * @param state unused
+ */
+static void sort_puts_nan_last(void** state)
+{
+    (void)state;
+
+    double input[] = { 3, NAN, 1, NAN, 2 };
+    sortNumbers(input, 5);
+
+    assert_true(input[0] == 1);
+    assert_true(input[1] == 2);
+    assert_true(input[2] == 3);
+    assert_true(isnan(input[3]));
+    assert_true(isnan(input[4]));
+}
+
+/**
+ * @brief Strings are sorted by their bytes, a prefix goes before the longer string.
+ *
+ * @param state unused
+ */
+static void sort_sorts_strings(void** state)
+{
+    (void)state;
+
+    const char* input[] = { "pear", "apple", "app", "", "banana", "apple" };
+    const char* expected[] = { "", "app", "apple", "apple", "banana", "pear" };
+    for (int i = 0; i < 6; i++) {
+        push(OBJ_VAL(copyString(input[i], (int)strlen(input[i]))));
+    }
+
+    sortStrings(vm.stack, 6);
+
+    for (int i = 0; i < 6; i++) {
+        assert_string_equal(AS_CSTRING(vm.stack[i]), expected[i]);
+    }
+    vm.stackTop = vm.stack;
+}
+
+/**
+ * @brief A comparator decides the order.
+ *
+ * @param state unused
+ */
+static void sort_uses_comparator(void** state)
+{
+    (void)state;
+
+    for (int i = 0; i < COUNT; i++) {
+        values[i] = NUMBER_VAL(rand() % 1000);
+    }
+
+    sortValues(values, COUNT, greater, NULL);
+
+    for (int i = 1; i < COUNT; i++) {
+        assert_true(AS_NUMBER(values[i - 1]) >= AS_NUMBER(values[i]));
+    }
+}
+
+/**
+ * @brief A comparator that contradicts itself leaves the elements in some order, without losing
+ * or duplicating any.
+ *
+ * @param state unused
+ */
+static void sort_survives_inconsistent_comparator(void** state)
+{
+    (void)state;
+
+    for (int i = 0; i < COUNT; i++) {
+        values[i] = NUMBER_VAL(i);
+    }
+
+    sortValues(values, COUNT, coinFlip, NULL);
+
+    for (int i = 0; i < COUNT; i++) {
+        numbers[i] = AS_NUMBER(values[i]);
+    }
+    sortNumbers(numbers, COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        assert_true(numbers[i] == i);
+    }
+}
+
+/*
+ * Main test program
+ *
+ */
+
+/**
+ * @brief Main
+ *
+ * @return int count of failed tests
+ */
+int main(void)
+{
+    initVM();
+
+    const struct CMUnitTest tests_nothing[] = {
+        cmocka_unit_test(sort_sorts_numbers),
+        cmocka_unit_test(sort_puts_nan_last),
+        cmocka_unit_test(sort_sorts_strings),
+        cmocka_unit_test(sort_uses_comparator),
+        cmocka_unit_test(sort_survives_inconsistent_comparator),
+    };
+    int result = cmocka_run_group_tests(tests_nothing, NULL, NULL);
+
+    freeVM();
+    return result;
+}
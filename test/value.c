@@ -14,7 +14,9 @@
  * Includes
  *
  */
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "test.h"
 #include "values/value.h"
@@ -85,6 +87,27 @@ static void ValueArray_can_be_freed(void** state)
     assert_ptr_equal(valueArray.values, NULL);
 }
 
+/**
+ * @brief Numbers are formatted the way print shows them
+ *
+ * @param state unused
+ */
+static void formatNumber_matches_print(void** state)
+{
+    (void)state;
+
+    const double numbers[] = { 0, -0.0, 7, -42, 999999, -999999, 1000000, 0.5, -1.25, 1e-7,
+        123456789, 1.0 / 0.0 };
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        char expected[NUMBER_FORMAT_SIZE];
+        char buffer[NUMBER_FORMAT_SIZE];
+        int length = snprintf(expected, sizeof(expected), "%g", numbers[i]);
+
+        assert_int_equal(formatNumber(numbers[i], buffer), length);
+        assert_string_equal(buffer, expected);
+    }
+}
+
 /*
  * Main test program
  *
@@ -101,6 +124,7 @@ int main(void)
         cmocka_unit_test(ValueArray_initializes),
         cmocka_unit_test(ValueArray_is_writable),
         cmocka_unit_test(ValueArray_can_be_freed),
+        cmocka_unit_test(formatNumber_matches_print),
     };
     return cmocka_run_group_tests(tests_nothing, NULL, NULL);
 }